@@ -1,9 +1,11 @@
 #include "Base.h"
+#include "FrameUniforms.h"
 #include <iostream>
 using namespace std;
 
 Base::Base()
-    : baseVBO(0), baseVAO(0), baseEBO(0), shaderProgram(0), textureID(0), initialized(false) {
+    : baseVBO(0), baseVAO(0), baseEBO(0), modelUniform(INVALID_UNIFORM),
+    textureUniform(INVALID_UNIFORM), textureID(0), initialized(false) {
 }
 
 Base::~Base() {
@@ -11,17 +13,18 @@ Base::~Base() {
     if (baseVBO) glDeleteBuffers(1, &baseVBO);
     if (baseEBO) glDeleteBuffers(1, &baseEBO);
     if (baseVAO) glDeleteVertexArrays(1, &baseVAO);
-    if (shaderProgram) glDeleteProgram(shaderProgram);
+    shader.cleanup();
     if (textureID) glDeleteTextures(1, &textureID);
 }
 
 void Base::setupShaderProgram() {
-    shaderProgram = shaderCreator.createShaderProgram("shaders/vertex/BaseVertexShader.glsl",
-        "shaders/fragment/BaseFragmentShader.glsl");
-    if (shaderProgram == 0) {
+    if (!shader.load("shaders/vertex/BaseVertexShader.glsl", "shaders/fragment/BaseFragmentShader.glsl")) {
         cerr << "Failed to create base shader program" << endl;
         return;
     }
+    modelUniform = shader.getUniform("model");
+    FrameUniforms::attach(shader);
+    textureUniform = shader.getUniform("baseTexture");
     cout << "Base shader program created successfully" << endl;
 }
 
@@ -31,7 +34,7 @@ void Base::init() {
     }
 
     setupShaderProgram();
-    if (shaderProgram == 0) {
+    if (!shader.isValid()) {
         cerr << "Failed to setup shader program" << endl;
         return;
     }
@@ -88,7 +91,7 @@ void Base::createBase() {
     glBindVertexArray(0);
 }
 
-void Base::render(const mat4& view, const mat4& projection) {
+void Base::submit(RenderQueue& queue) {
     if (!initialized) {
         init();
         if (!initialized) {
@@ -96,36 +99,33 @@ void Base::render(const mat4& view, const mat4& projection) {
         }
     }
 
-    if (baseVAO == 0 || shaderProgram == 0) {
+    if (baseVAO == 0 || !shader.isValid()) {
         cerr << "Base not properly initialized" << endl;
         return;
     }
 
-    // Use shader program
-    glUseProgram(shaderProgram);
-
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    DrawPacket packet;
+    packet.program = &shader;
+    packet.vao = baseVAO;
+    packet.texture = textureID;
+    packet.depthFunc = GL_LESS;
+    packet.depthWrite = true;
+    packet.drawer = this;
+    packet.payload = 0;
+    packet.key = RenderQueue::makeKey(RenderPass::WORLD, shader.getId(), textureID, baseVAO, 0.0f);
+    queue.submit(packet);
+}
 
-    // Set texture uniform
-    glUniform1i(glGetUniformLocation(shaderProgram, "baseTexture"), 0);
+void Base::drawPacket(unsigned int) {
+    // Texture on unit 0, bound by the queue
+    shader.set(textureUniform, 0);
 
-    // Calculate MVP matrix
+    // Model matrix; view and projection come from the frame uniform block
     mat4 model = mat4(1.0f);
     model = scale(model, vec3(10.0f, 1.0f, 10.0f)); // Scale X and Z by 10, keep Y at 1
 
-    mat4 mvp = projection * view * model;
-
-    // Send MVP matrix to shader
-    unsigned int mvpLoc = glGetUniformLocation(shaderProgram, "mvp");
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, value_ptr(mvp));
+    shader.set(modelUniform, model);
 
     // Render the base
-    glBindVertexArray(baseVAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    // Unbind shader program
-    glUseProgram(0);
 }
\ No newline at end of file
@@ -7,18 +7,19 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include "ShaderProgramCreator.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
 #include "TextureLoader.h"
 
 using namespace glm;
 using namespace std;
 
-class Base {
+class Base : public PacketDrawer {
 private:
 	unsigned int baseVBO, baseVAO, baseEBO;
-	unsigned int shaderProgram;
+	ShaderProgram shader;
+	UniformHandle modelUniform, textureUniform;
 	GLuint textureID;
-	ShaderProgramCreator shaderCreator;
 	TextureLoader textureloader;
 	bool initialized;
 	void createBase();
@@ -28,7 +29,9 @@ public:
 	Base();
 	~Base();
 	void init();
-	void render(const mat4& view, const mat4& projection);
+	// Queues the ground in the WORLD pass; camera comes from the FrameUniforms block
+	void submit(RenderQueue& queue);
+	void drawPacket(unsigned int payload) override;
 };
 
 #endif // !BASE_H
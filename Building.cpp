@@ -1,12 +1,22 @@
 #include "Building.h"
+#include "ProxyBox.h"
+#include <algorithm>
+#include <cfloat>
 
 Building::Building(BuildingType buildingType, const string& objPath)
-    : type(buildingType), modelPath(objPath), position(0.0f),
-    rotation(0.0f), scale(1.0f), selected(false) {
+    : type(buildingType), modelPath(objPath), lodLevel(0), spatialIndex(nullptr),
+    spatialId(SpatialGrid::INVALID_ITEM), indexedWithMesh(false), placementMatrix(1.0f),
+    modelMatrix(1.0f), inverseModelMatrix(1.0f), normalMatrix(1.0f), transformDirty(true),
+    dirtyList(nullptr), inDirtyList(false), position(0.0f), rotation(0.0f), scale(1.0f), selected(false) {
 }
 
 Building::~Building() {
-    // Base destructor - derived classes handle their own cleanup
+    if (inDirtyList) {
+        dirtyList->erase(remove(dirtyList->begin(), dirtyList->end(), this), dirtyList->end());
+    }
+    if (spatialIndex) {
+        spatialIndex->remove(spatialId);
+    }
 }
 
 BuildingType Building::getType() const {
@@ -15,4 +25,123 @@ BuildingType Building::getType() const {
 
 const string& Building::getModelPath() const {
     return modelPath;
-}
\ No newline at end of file
+}
+
+void Building::updateTransform() const {
+    placementMatrix = glm::translate(mat4(1.0f), position);
+    placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.x), vec3(1.0f, 0.0f, 0.0f));
+    placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.y), vec3(0.0f, 1.0f, 0.0f));
+    placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.z), vec3(0.0f, 0.0f, 1.0f));
+    modelMatrix = glm::scale(placementMatrix, scale);
+    inverseModelMatrix = glm::inverse(modelMatrix);
+    // Inverse transpose of the 3x3 part is the transposed 3x3 of the inverse
+    normalMatrix = glm::transpose(mat3(inverseModelMatrix));
+    transformDirty = false;
+}
+
+const mat4& Building::getPlacementMatrix() const {
+    if (transformDirty) {
+        updateTransform();
+    }
+    return placementMatrix;
+}
+
+const mat4& Building::getModelMatrix() const {
+    if (transformDirty) {
+        updateTransform();
+    }
+    return modelMatrix;
+}
+
+const mat4& Building::getInverseModelMatrix() const {
+    if (transformDirty) {
+        updateTransform();
+    }
+    return inverseModelMatrix;
+}
+
+const mat3& Building::getNormalMatrix() const {
+    if (transformDirty) {
+        updateTransform();
+    }
+    return normalMatrix;
+}
+
+BoundingBox Building::getWorldBounds() const {
+    // The placeholder box is always included: it is drawn and picked
+    // until the mesh is in
+    BoundingBox bounds = BoundingBox::fromAABB(ProxyBox::BOUNDS_MIN, ProxyBox::BOUNDS_MAX,
+        glm::scale(getPlacementMatrix(), getProxySize()));
+    if (mesh && mesh->isLoaded()) {
+        BoundingBox meshBounds = BoundingBox::fromAABB(mesh->getBoundsMin(), mesh->getBoundsMax(), getModelMatrix());
+        bounds.boundsMin = glm::min(bounds.boundsMin, meshBounds.boundsMin);
+        bounds.boundsMax = glm::max(bounds.boundsMax, meshBounds.boundsMax);
+    }
+    return bounds;
+}
+
+void Building::attachSpatialIndex(SpatialGrid* index) {
+    if (spatialIndex) {
+        spatialIndex->remove(spatialId);
+    }
+
+    spatialIndex = index;
+    spatialId = SpatialGrid::INVALID_ITEM;
+    if (spatialIndex) {
+        BoundingBox bounds = getWorldBounds();
+        spatialId = spatialIndex->insert(bounds.boundsMin, bounds.boundsMax, this);
+        indexedWithMesh = mesh && mesh->isLoaded();
+    }
+}
+
+void Building::transformChanged() {
+    transformDirty = true;
+    if (dirtyList && !inDirtyList) {
+        dirtyList->push_back(this);
+        inDirtyList = true;
+    }
+    updateSpatialIndex();
+}
+
+void Building::setDirtyList(vector<Building*>* list) {
+    if (inDirtyList) {
+        dirtyList->erase(remove(dirtyList->begin(), dirtyList->end(), this), dirtyList->end());
+        inDirtyList = false;
+    }
+    dirtyList = list;
+}
+
+void Building::updateSpatialIndex() {
+    if (spatialIndex) {
+        BoundingBox bounds = getWorldBounds();
+        spatialIndex->update(spatialId, bounds.boundsMin, bounds.boundsMax);
+        indexedWithMesh = mesh && mesh->isLoaded();
+    }
+}
+
+bool Building::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, TriangleHit& hit) const {
+    // Test in model space; the ray parameter carries over unchanged
+    if (mesh && mesh->isLoaded() && mesh->getBvh()) {
+        const glm::mat4& inverseModel = getInverseModelMatrix();
+        return mesh->getBvh()->intersect(glm::vec3(inverseModel * glm::vec4(origin, 1.0f)),
+            glm::vec3(inverseModel * glm::vec4(direction, 0.0f)), maxDistance, hit);
+    }
+
+    glm::mat4 inverseProxy = glm::inverse(glm::scale(getPlacementMatrix(), getProxySize()));
+    float distance;
+    if (!SpatialGrid::rayIntersectsAABB(glm::vec3(inverseProxy * glm::vec4(origin, 1.0f)),
+        glm::vec3(inverseProxy * glm::vec4(direction, 0.0f)), ProxyBox::BOUNDS_MIN, ProxyBox::BOUNDS_MAX,
+        maxDistance, distance)) {
+        return false;
+    }
+    hit.distance = distance;
+    hit.triangle = TriangleBvh::NO_TRIANGLE;
+    hit.u = 0.0f;
+    hit.v = 0.0f;
+    return true;
+}
+
+bool Building::intersects(const glm::vec3& rayStart, const glm::vec3& rayDir) const {
+    TriangleHit hit;
+    return raycast(rayStart, glm::normalize(rayDir), FLT_MAX, hit);
+}
@@ -0,0 +1,56 @@
+#include "FrameUniforms.h"
+
+const char* const FrameUniforms::BLOCK_NAME = "FrameData";
+
+FrameUniforms::FrameUniforms()
+	: UBO(0), data(), stream(nullptr) {}
+
+FrameUniforms::~FrameUniforms() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+void FrameUniforms::init() {
+	if (UBO != 0) {
+		return;
+	}
+
+	glGenBuffers(1, &UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+}
+
+void FrameUniforms::cleanup() {
+	if (UBO != 0) {
+		glDeleteBuffers(1, &UBO);
+		UBO = 0;
+	}
+}
+
+bool FrameUniforms::attach(ShaderProgram& program) {
+	return program.bindUniformBlock(BLOCK_NAME, BINDING);
+}
+
+void FrameUniforms::update(const glm::mat4& view, const glm::mat4& projection,
+	const glm::vec3& lightPos, const glm::vec3& lightColor, const glm::vec3& viewPos) {
+	data.view = view;
+	data.projection = projection;
+	data.viewProjection = projection * view;
+	data.lightPos = glm::vec4(lightPos, 1.0f);
+	data.lightColor = glm::vec4(lightColor, 1.0f);
+	data.viewPos = glm::vec4(viewPos, 1.0f);
+
+	// One upload per frame for every program reading the block
+	if (stream) {
+		GLintptr offset = stream->write(&data, sizeof(FrameData), stream->getUniformAlignment());
+		if (offset != StreamBuffer::NO_OFFSET) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, stream->getBuffer(), offset, sizeof(FrameData));
+			return;
+		}
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+}
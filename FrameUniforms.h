@@ -0,0 +1,73 @@
+#pragma once
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+
+using namespace std;
+
+// CPU mirror of the std140 FrameData block declared in the shaders:
+//
+//   layout (std140) uniform FrameData {
+//       mat4 view;
+//       mat4 projection;
+//       mat4 viewProjection;
+//       vec4 lightPos;      // xyz
+//       vec4 lightColor;    // rgb
+//       vec4 viewPos;       // xyz, camera position
+//   };
+//
+// Only vec4 and mat4 members, so std140 adds no padding; keep both in sync.
+struct FrameData {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 lightPos;
+	glm::vec4 lightColor;
+	glm::vec4 viewPos;
+};
+
+static_assert(sizeof(FrameData) == 240, "FrameData must match the std140 block layout");
+
+// Uniform buffer holding the camera and lighting for the current frame.
+// Written once per frame and bound to a fixed binding point, so programs
+// that declare FrameData read it without any per-object uploads. With a
+// StreamBuffer the block is written there and bound by range; the own
+// buffer is the fallback.
+class FrameUniforms {
+private:
+	unsigned int UBO;
+	FrameData data;
+	StreamBuffer* stream;
+
+public:
+	static const GLuint BINDING = 0;
+	static const char* const BLOCK_NAME;
+
+	FrameUniforms();
+	~FrameUniforms();
+
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	void init();
+	void cleanup();
+
+	// Points the program's FrameData block at BINDING (GLSL 3.30 has no
+	// binding layout qualifier). Returns false if the block is not used.
+	static bool attach(ShaderProgram& program);
+
+	// Streams the block from buffer, which must outlive this; null uploads
+	// to the own buffer
+	void setStreamBuffer(StreamBuffer* buffer) { stream = buffer; }
+
+	void update(const glm::mat4& view, const glm::mat4& projection,
+		const glm::vec3& lightPos, const glm::vec3& lightColor, const glm::vec3& viewPos);
+
+	const FrameData& getData() const { return data; }
+};
+
+#endif // !FRAMEUNIFORMS_H
@@ -0,0 +1,177 @@
+#include "Frustum.h"
+#include <algorithm>
+#ifdef FRUSTUM_SIMD
+#include <emmintrin.h>
+#endif
+
+BoundingSphere BoundingSphere::fromAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model) {
+	glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+	float localRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+	// Largest axis scale of the model matrix
+	float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	BoundingSphere sphere;
+	sphere.center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+	sphere.radius = localRadius * scale;
+	return sphere;
+}
+
+BoundingBox BoundingBox::fromAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model) {
+	glm::vec3 translation(model[3]);
+	BoundingBox box;
+	box.boundsMin = translation;
+	box.boundsMax = translation;
+
+	// Each output axis takes the smaller and larger of every input axis'
+	// contribution
+	for (int column = 0; column < 3; ++column) {
+		for (int row = 0; row < 3; ++row) {
+			float a = model[column][row] * boundsMin[column];
+			float b = model[column][row] * boundsMax[column];
+			box.boundsMin[row] += min(a, b);
+			box.boundsMax[row] += max(a, b);
+		}
+	}
+	return box;
+}
+
+Frustum::Frustum() {
+	for (int i = 0; i < 6; ++i) {
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+	extract(viewProjection);
+}
+
+void Frustum::extract(const glm::mat4& viewProjection) {
+	// glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4& m = viewProjection;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+
+	for (int i = 0; i < 6; ++i) {
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f) {
+			planes[i] /= length;
+		}
+	}
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+	for (int i = 0; i < 6; ++i) {
+		// Corner furthest along the plane normal
+		glm::vec3 normal(planes[i]);
+		glm::vec3 positive(normal.x >= 0.0f ? boundsMax.x : boundsMin.x,
+			normal.y >= 0.0f ? boundsMax.y : boundsMin.y,
+			normal.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		if (glm::dot(normal, positive) + planes[i].w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+FrustumCuller::FrustumCuller()
+	: count(0), visibleCount(0) {}
+
+void FrustumCuller::begin() {
+	count = 0;
+	visibleCount = 0;
+	minX.clear();
+	minY.clear();
+	minZ.clear();
+	maxX.clear();
+	maxY.clear();
+	maxZ.clear();
+}
+
+size_t FrustumCuller::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	minX.push_back(boundsMin.x);
+	minY.push_back(boundsMin.y);
+	minZ.push_back(boundsMin.z);
+	maxX.push_back(boundsMax.x);
+	maxY.push_back(boundsMax.y);
+	maxZ.push_back(boundsMax.z);
+	return count++;
+}
+
+void FrustumCuller::cull(const Frustum& frustum) {
+	// Pad to whole batches; the padding is tested but never read back
+	size_t padded = (count + BATCH - 1) / BATCH * BATCH;
+	minX.resize(padded, 0.0f);
+	minY.resize(padded, 0.0f);
+	minZ.resize(padded, 0.0f);
+	maxX.resize(padded, 0.0f);
+	maxY.resize(padded, 0.0f);
+	maxZ.resize(padded, 0.0f);
+	visible.assign(padded, 0);
+	visibleCount = 0;
+
+	// Per plane, the box corner furthest along its normal: the same side of
+	// every box, so it is picked once per plane instead of per box
+	const float* cornerX[6];
+	const float* cornerY[6];
+	const float* cornerZ[6];
+	for (int i = 0; i < 6; ++i) {
+		const glm::vec4& plane = frustum.getPlane(i);
+		cornerX[i] = plane.x >= 0.0f ? maxX.data() : minX.data();
+		cornerY[i] = plane.y >= 0.0f ? maxY.data() : minY.data();
+		cornerZ[i] = plane.z >= 0.0f ? maxZ.data() : minZ.data();
+	}
+
+#ifdef FRUSTUM_SIMD
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int i = 0; i < 6; ++i) {
+		const glm::vec4& plane = frustum.getPlane(i);
+		planeX[i] = _mm_set1_ps(plane.x);
+		planeY[i] = _mm_set1_ps(plane.y);
+		planeZ[i] = _mm_set1_ps(plane.z);
+		planeW[i] = _mm_set1_ps(plane.w);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	for (size_t base = 0; base < padded; base += BATCH) {
+		// Outside if the corner is behind any plane
+		__m128 outside = _mm_setzero_ps();
+		for (int i = 0; i < 6; ++i) {
+			__m128 x = _mm_loadu_ps(cornerX[i] + base);
+			__m128 y = _mm_loadu_ps(cornerY[i] + base);
+			__m128 z = _mm_loadu_ps(cornerZ[i] + base);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[i], x), _mm_mul_ps(planeY[i], y)),
+				_mm_mul_ps(planeZ[i], z)), planeW[i]);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+		}
+
+		int outsideMask = _mm_movemask_ps(outside);
+		for (size_t lane = 0; lane < BATCH; ++lane) {
+			visible[base + lane] = (outsideMask & (1 << lane)) ? 0 : 1;
+		}
+	}
+#else
+	for (size_t box = 0; box < padded; ++box) {
+		unsigned char inside = 1;
+		for (int i = 0; i < 6 && inside; ++i) {
+			glm::vec3 corner(cornerX[i][box], cornerY[i][box], cornerZ[i][box]);
+			const glm::vec4& plane = frustum.getPlane(i);
+			inside = glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f ? 0 : 1;
+		}
+		visible[box] = inside;
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i) {
+		visibleCount += visible[i];
+	}
+}
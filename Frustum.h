@@ -0,0 +1,78 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// SSE is always there on x64 and on x86 builds with /arch:SSE2 (the default)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SIMD 1
+#endif
+
+struct BoundingSphere {
+	glm::vec3 center;
+	float radius;
+
+	// Sphere around a local AABB placed by model; the radius grows with the
+	// largest axis scale so it stays conservative under rotation
+	static BoundingSphere fromAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model);
+};
+
+struct BoundingBox {
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// World-space AABB enclosing a local AABB placed by model (Arvo)
+	static BoundingBox fromAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model);
+};
+
+// The six clip planes of a view-projection matrix, normalized and pointing
+// inwards (Gribb & Hartmann)
+class Frustum {
+private:
+	glm::vec4 planes[6];   // left, right, bottom, top, near, far
+
+public:
+	Frustum();
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	void extract(const glm::mat4& viewProjection);
+	const glm::vec4& getPlane(int index) const { return planes[index]; }
+
+	bool intersectsAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+};
+
+// Batched AABB-frustum test, the narrow phase behind SpatialGrid's cells.
+// Boxes are stored as structure-of-arrays so cull() tests four at a time
+// per plane with SSE (scalar otherwise), with the same corner-per-plane test
+// and arithmetic as Frustum::intersectsAABB, so both agree on every box.
+//
+// Usage: begin(), add() one box per candidate, cull(), then isVisible()
+// with the index add() returned.
+class FrustumCuller {
+private:
+	static const size_t BATCH = 4;
+
+	vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	vector<unsigned char> visible;
+	size_t count;
+	size_t visibleCount;
+
+public:
+	FrustumCuller();
+
+	void begin();
+	size_t add(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void cull(const Frustum& frustum);
+
+	bool isVisible(size_t index) const { return visible[index] != 0; }
+	size_t getCount() const { return count; }
+	size_t getVisibleCount() const { return visibleCount; }
+	size_t getCulledCount() const { return count - visibleCount; }
+};
+
+#endif // !FRUSTUM_H
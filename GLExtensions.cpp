@@ -0,0 +1,55 @@
+#include "GLExtensions.h"
+#include <cstring>
+#include <iostream>
+
+GLExtensions::MultiDrawElementsIndirectProc GLExtensions::multiDrawElementsIndirectProc = nullptr;
+GLExtensions::DispatchComputeProc GLExtensions::dispatchComputeProc = nullptr;
+GLExtensions::MemoryBarrierProc GLExtensions::memoryBarrierProc = nullptr;
+GLExtensions::BufferStorageProc GLExtensions::bufferStorageProc = nullptr;
+bool GLExtensions::multiDrawIndirect = false;
+bool GLExtensions::computeShaders = false;
+
+bool GLExtensions::hasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void GLExtensions::load(GLADloadproc loader, bool disableIndirect, bool disableBufferStorage) {
+	bufferStorageProc = nullptr;
+	if (!disableBufferStorage) {
+		bool core44 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+		if (core44 || hasExtension("GL_ARB_buffer_storage")) {
+			bufferStorageProc = (BufferStorageProc)loader("glBufferStorage");
+		}
+	}
+
+	multiDrawIndirect = false;
+	multiDrawElementsIndirectProc = nullptr;
+	computeShaders = false;
+	dispatchComputeProc = nullptr;
+	memoryBarrierProc = nullptr;
+	if (disableIndirect) {
+		cout << "Multi-draw-indirect disabled, using the GL 3.3 path" << endl;
+		return;
+	}
+
+	bool core43 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+	if (core43 || (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance"))) {
+		multiDrawElementsIndirectProc = (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect");
+	}
+	multiDrawIndirect = multiDrawElementsIndirectProc != nullptr;
+	cout << (multiDrawIndirect ? "Using multi-draw-indirect" : "Multi-draw-indirect not supported, using the GL 3.3 path") << endl;
+
+	if (multiDrawIndirect && core43) {
+		dispatchComputeProc = (DispatchComputeProc)loader("glDispatchCompute");
+		memoryBarrierProc = (MemoryBarrierProc)loader("glMemoryBarrier");
+	}
+	computeShaders = dispatchComputeProc != nullptr && memoryBarrierProc != nullptr;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef GLEXTENSIONS_H
+#define GLEXTENSIONS_H
+
+#include <glad/glad.h>
+
+using namespace std;
+
+// Not in the GL 3.3 headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// Layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Entry points beyond the GL 3.3 core profile glad was generated for. They
+// are looked up after the context is created and only used when present;
+// everything else in the renderer stays on GL 3.3.
+class GLExtensions {
+private:
+	typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type,
+		const void* indirect, GLsizei drawCount, GLsizei stride);
+
+	typedef void (APIENTRYP DispatchComputeProc)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+	typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+	typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+	static MultiDrawElementsIndirectProc multiDrawElementsIndirectProc;
+	static DispatchComputeProc dispatchComputeProc;
+	static MemoryBarrierProc memoryBarrierProc;
+	static BufferStorageProc bufferStorageProc;
+	static bool multiDrawIndirect;
+	static bool computeShaders;
+
+	static bool hasExtension(const char* name);
+
+public:
+	// Call after gladLoadGLLoader with the same loader and the context current.
+	// disableIndirect forces the GL 3.3 path and disableBufferStorage the
+	// orphaning StreamBuffer, e.g. for comparison.
+	static void load(GLADloadproc loader, bool disableIndirect = false, bool disableBufferStorage = false);
+
+	// GL 4.3, or ARB_multi_draw_indirect with ARB_base_instance (baseInstance
+	// must offset the instance attributes)
+	static bool hasMultiDrawIndirect() { return multiDrawIndirect; }
+	static void multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect,
+		GLsizei drawCount, GLsizei stride) {
+		multiDrawElementsIndirectProc(mode, type, indirect, drawCount, stride);
+	}
+
+	// GL 4.3, which the #version 430 compute shaders need. Also off when
+	// indirect drawing is disabled, since nothing could draw what they produce.
+	static bool hasComputeShaders() { return computeShaders; }
+	static void dispatchCompute(GLuint groupsX, GLuint groupsY, GLuint groupsZ) {
+		dispatchComputeProc(groupsX, groupsY, groupsZ);
+	}
+	static void memoryBarrier(GLbitfield barriers) { memoryBarrierProc(barriers); }
+
+	// GL 4.4 or ARB_buffer_storage: immutable buffers that can stay mapped
+	// while the GPU reads them (GL_MAP_PERSISTENT_BIT)
+	static bool hasBufferStorage() { return bufferStorageProc != nullptr; }
+	static void bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) {
+		bufferStorageProc(target, size, data, flags);
+	}
+};
+
+#endif // !GLEXTENSIONS_H
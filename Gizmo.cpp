@@ -1,19 +1,26 @@
 #include "Gizmo.h"
 #include <iostream>
 #include <cmath>
+#include <cstddef>
 
 const float M_PI = 3.14159265359f;
 
 // Shader sources
+// Lines stream their colors per vertex; the spheres set aColor as a
+// constant attribute (glVertexAttrib3f) since their VAO has no color array
 const char* gizmoVertexShaderSource = R"(
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+out vec3 gizmoColor;
+
 void main() {
+    gizmoColor = aColor;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
 )";
@@ -22,24 +29,33 @@ const char* gizmoFragmentShaderSource = R"(
 #version 330 core
 out vec4 FragColor;
 
-uniform vec3 gizmoColor;
+in vec3 gizmoColor;
 
 void main() {
     FragColor = vec4(gizmoColor, 1.0);
 }
 )";
 
+namespace {
+    const unsigned int COLOR_LOCATION = 1;
+    // Axis lines are this long, from the object's position
+    const float AXIS_LENGTH = 0.3f * 8.0f;
+}
+
 Gizmo::Gizmo()
-    : lineVAO(0), sphereVAO(0), sphereIndexCount(0), shaderProgram(0),
+    : lineVAO(0), lineVBO(0), lineCapacity(0), sphereVAO(0), sphereIndexCount(0),
+    viewUniform(INVALID_UNIFORM), projectionUniform(INVALID_UNIFORM), modelUniform(INVALID_UNIFORM), stream(nullptr),
     currentMode(GizmoMode::TRANSLATE), activeAxis(GizmoAxis::NONE),
-    dragging(false), dragStart(0.0f), transformStart(0.0f), initialized(false) {
+    dragging(false), dragStart(0.0f), transformStart(0.0f), initialized(false),
+    drawPosition(0.0f), drawView(1.0f), drawProjection(1.0f) {
 }
 
 Gizmo::~Gizmo() {
     if (initialized) {
         glDeleteVertexArrays(1, &lineVAO);
+        glDeleteBuffers(1, &lineVBO);
         glDeleteVertexArrays(1, &sphereVAO);
-        glDeleteProgram(shaderProgram);
+        shader.cleanup();
     }
 }
 
@@ -52,28 +68,13 @@ void Gizmo::initialize() {
 }
 
 void Gizmo::createGizmoGeometry() {
-    // Line geometry for axes
-    float lineVertices[] = {
-        // X axis (red)
-        0.0f, 0.0f, 0.0f,
-        0.3f, 0.0f, 0.0f,
-        // Y axis (green)
-        0.0f, 0.0f, 0.0f,
-        0.0f, 0.3f, 0.0f,
-        // Z axis (blue)
-        0.0f, 0.0f, 0.0f,
-        0.0f, 0.0f, 0.3f
-    };
-
-    unsigned int lineVBO;
+    // Axis lines are written every frame (see renderAxes), so their VAO is
+    // pointed at the data when drawn; lineVBO is only the fallback
     glGenVertexArrays(1, &lineVAO);
     glGenBuffers(1, &lineVBO);
-
     glBindVertexArray(lineVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(lineVertices), lineVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(COLOR_LOCATION);
 
     // Simple sphere for axis endpoints
     std::vector<float> sphereVertices;
@@ -153,73 +154,101 @@ void Gizmo::setupShaderProgram() {
     unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, gizmoVertexShaderSource);
     unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, gizmoFragmentShaderSource);
 
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // Check linking
-    int success;
-    char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "Gizmo shader program linking failed: " << infoLog << std::endl;
-    }
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
 
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
-}
 
-void Gizmo::render(Building* selectedBuilding, const glm::mat4& view, const glm::mat4& projection) {
-    if (!selectedBuilding || !initialized) return;
+    // Checks linking and reflects the uniforms
+    if (!shader.attach(program)) {
+        std::cout << "Gizmo shader program linking failed" << std::endl;
+        return;
+    }
+
+    viewUniform = shader.getUniform("view");
+    projectionUniform = shader.getUniform("projection");
+    modelUniform = shader.getUniform("model");
+}
 
-    glm::vec3 position = selectedBuilding->getPosition();
+void Gizmo::submit(RenderQueue& queue, const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection) {
+    drawPosition = position;
+    drawView = view;
+    drawProjection = projection;
+
+    // Lines and spheres use different VAOs, bound by drawPacket()
+    DrawPacket packet;
+    packet.program = &shader;
+    packet.vao = 0;
+    packet.texture = 0;
+    packet.depthFunc = GL_LESS;
+    packet.depthWrite = true;
+    packet.drawer = this;
+    packet.payload = 0;
+    packet.key = RenderQueue::makeKey(RenderPass::OVERLAY, shader.getId(), 0, 0, 0.0f);
+    queue.submit(packet);
+}
 
-    glUseProgram(shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+void Gizmo::render(RenderQueue& queue, Building* selectedBuilding, const glm::mat4& view, const glm::mat4& projection) {
+    if (!selectedBuilding || !initialized) return;
 
-    renderAxes(position, view, projection);
-    renderAxisSpheres(position, view, projection);
+    submit(queue, selectedBuilding->getPosition(), view, projection);
 }
 
-void Gizmo::renderRoad(Road* selectedRoad, const glm::mat4& view, const glm::mat4& projection) {
+void Gizmo::renderRoad(RenderQueue& queue, Road* selectedRoad, const glm::mat4& view, const glm::mat4& projection) {
     if (!selectedRoad || !initialized) return;
 
-    glm::vec3 position = selectedRoad->getPosition();
+    submit(queue, selectedRoad->getPosition(), view, projection);
+}
 
-    glUseProgram(shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+void Gizmo::drawPacket(unsigned int) {
+    shader.set(viewUniform, drawView);
+    shader.set(projectionUniform, drawProjection);
 
-    renderAxes(position, view, projection);
-    renderAxisSpheres(position, view, projection);
+    renderAxes(drawPosition, drawView, drawProjection);
+    renderAxisSpheres(drawPosition, drawView, drawProjection);
 }
 
-void Gizmo::renderAxes(const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection) {
-    // Gizmo at object position
-    glm::mat4 gizmoModel = glm::translate(glm::mat4(1.0f), position);
-    gizmoModel = glm::scale(gizmoModel, glm::vec3(8.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(gizmoModel));
-
-    // Draw axis lines
-    glBindVertexArray(lineVAO);
+glm::vec3 Gizmo::getAxisColor(GizmoAxis axis) const {
+    glm::vec3 color(0.0f);
+    color[(int)axis] = activeAxis == axis ? 1.0f : 0.8f;
+    return color;
+}
 
-    // X axis (red)
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        activeAxis == GizmoAxis::X_AXIS ? 1.0f : 0.8f, 0.0f, 0.0f);
-    glDrawArrays(GL_LINES, 0, 2);
+void Gizmo::renderAxes(const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection) {
+    // World space lines from the object's position, one draw for all three
+    lineVertices.clear();
+    for (GizmoAxis axis : { GizmoAxis::X_AXIS, GizmoAxis::Y_AXIS, GizmoAxis::Z_AXIS }) {
+        glm::vec3 end = position;
+        end[(int)axis] += AXIS_LENGTH;
+        lineVertices.push_back({ position, getAxisColor(axis) });
+        lineVertices.push_back({ end, getAxisColor(axis) });
+    }
+    shader.set(modelUniform, glm::mat4(1.0f));
 
-    // Y axis (green)
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        0.0f, activeAxis == GizmoAxis::Y_AXIS ? 1.0f : 0.8f, 0.0f);
-    glDrawArrays(GL_LINES, 2, 2);
+    size_t bytes = lineVertices.size() * sizeof(LineVertex);
+    GLintptr offset = stream ? stream->write(lineVertices.data(), bytes, sizeof(float)) : StreamBuffer::NO_OFFSET;
+    if (offset != StreamBuffer::NO_OFFSET) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->getBuffer());
+    }
+    else {
+        // Orphaned every frame, so the driver need not wait for the last draw
+        glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
+        if (lineVertices.size() > lineCapacity) {
+            lineCapacity = lineVertices.size();
+        }
+        glBufferData(GL_ARRAY_BUFFER, lineCapacity * sizeof(LineVertex), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, lineVertices.data());
+        offset = 0;
+    }
 
-    // Z axis (blue)
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        0.0f, 0.0f, activeAxis == GizmoAxis::Z_AXIS ? 1.0f : 0.8f);
-    glDrawArrays(GL_LINES, 4, 2);
+    glBindVertexArray(lineVAO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), (void*)(offset + offsetof(LineVertex, position)));
+    glVertexAttribPointer(COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), (void*)(offset + offsetof(LineVertex, color)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDrawArrays(GL_LINES, 0, (GLsizei)lineVertices.size());
 }
 
 void Gizmo::renderAxisSpheres(const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection) {
@@ -231,23 +260,23 @@ void Gizmo::renderAxisSpheres(const glm::vec3& position, const glm::mat4& view,
 
     // X axis sphere (red)
     glm::mat4 xSphere = glm::translate(gizmoModel, glm::vec3(0.8f, 0.0f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(xSphere));
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        activeAxis == GizmoAxis::X_AXIS ? 1.0f : 0.8f, 0.0f, 0.0f);
+    shader.set(modelUniform, xSphere);
+    glm::vec3 xColor = getAxisColor(GizmoAxis::X_AXIS);
+    glVertexAttrib3f(COLOR_LOCATION, xColor.r, xColor.g, xColor.b);
     glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
 
     // Y axis sphere (green)
     glm::mat4 ySphere = glm::translate(gizmoModel, glm::vec3(0.0f, 0.8f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(ySphere));
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        0.0f, activeAxis == GizmoAxis::Y_AXIS ? 1.0f : 0.8f, 0.0f);
+    shader.set(modelUniform, ySphere);
+    glm::vec3 yColor = getAxisColor(GizmoAxis::Y_AXIS);
+    glVertexAttrib3f(COLOR_LOCATION, yColor.r, yColor.g, yColor.b);
     glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
 
     // Z axis sphere (blue)
     glm::mat4 zSphere = glm::translate(gizmoModel, glm::vec3(0.0f, 0.0f, 0.8f));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(zSphere));
-    glUniform3f(glGetUniformLocation(shaderProgram, "gizmoColor"),
-        0.0f, 0.0f, activeAxis == GizmoAxis::Z_AXIS ? 1.0f : 0.8f);
+    shader.set(modelUniform, zSphere);
+    glm::vec3 zColor = getAxisColor(GizmoAxis::Z_AXIS);
+    glVertexAttrib3f(COLOR_LOCATION, zColor.r, zColor.g, zColor.b);
     glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
 }
 
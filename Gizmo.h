@@ -7,19 +7,32 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
-#include "ShaderProgramCreator.h"  // Assuming you have this
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
 #include "Building.h"  // Your base class
 #include "Road.h"
 
 enum class GizmoMode { TRANSLATE, ROTATE, SCALE };
 enum class GizmoAxis { NONE = -1, X_AXIS = 0, Y_AXIS = 1, Z_AXIS = 2 };
 
-class Gizmo {
+class Gizmo : public PacketDrawer {
 private:
+    struct LineVertex {
+        glm::vec3 position;   // World space
+        glm::vec3 color;
+    };
+
     // OpenGL objects
-    unsigned int lineVAO, sphereVAO, sphereIndexCount;
-    unsigned int shaderProgram;
-    ShaderProgramCreator shaderCreator;
+    unsigned int lineVAO, lineVBO;
+    size_t lineCapacity;   // Vertices in lineVBO
+    unsigned int sphereVAO, sphereIndexCount;
+    ShaderProgram shader;
+    UniformHandle viewUniform, projectionUniform, modelUniform;
+
+    // The axis lines are rebuilt every draw and streamed from here
+    StreamBuffer* stream;
+    std::vector<LineVertex> lineVertices;
 
     // Gizmo state
     GizmoMode currentMode;
@@ -29,9 +42,15 @@ private:
     glm::vec3 transformStart;
     bool initialized;
 
+    // What render() queued, drawn by drawPacket()
+    glm::vec3 drawPosition;
+    glm::mat4 drawView, drawProjection;
+
     // Private methods
     void createGizmoGeometry();
     void setupShaderProgram();
+    glm::vec3 getAxisColor(GizmoAxis axis) const;
+    void submit(RenderQueue& queue, const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection);
     void renderAxes(const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection);
     void renderAxisSpheres(const glm::vec3& position, const glm::mat4& view, const glm::mat4& projection);
 
@@ -40,8 +59,13 @@ public:
     ~Gizmo();
 
     void initialize();
-    void render(Building* selectedBuilding, const glm::mat4& view, const glm::mat4& projection);
-    void renderRoad(Road* selectedRoad, const glm::mat4& view, const glm::mat4& projection);
+    // Streams the axis lines from buffer, which must outlive the gizmo;
+    // null uploads them to the gizmo's own buffer
+    void setStreamBuffer(StreamBuffer* buffer) { stream = buffer; }
+    // Queue the gizmo at the object in the OVERLAY pass
+    void render(RenderQueue& queue, Building* selectedBuilding, const glm::mat4& view, const glm::mat4& projection);
+    void renderRoad(RenderQueue& queue, Road* selectedRoad, const glm::mat4& view, const glm::mat4& projection);
+    void drawPacket(unsigned int payload) override;
     GizmoAxis checkAxisSelection(const glm::vec3& rayStart, const glm::vec3& rayDir, const glm::vec3& objectPos);
 
     void startDrag(GizmoAxis axis, const glm::vec2& mousePos, Building* building);
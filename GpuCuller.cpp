@@ -0,0 +1,451 @@
+#include "GpuCuller.h"
+#include "LodSelector.h"
+#include "MeshCache.h"
+#include <algorithm>
+
+namespace {
+
+const char* const CULL_BLOCK_NAME = "CullData";
+const char* const CULL_SHADER_PATH = "shaders/compute/CullComputeShader.glsl";
+
+// Shader storage bindings declared in the compute shader
+enum StorageBinding : GLuint {
+	OBJECTS_BINDING,
+	MESHES_BINDING,
+	LODS_BINDING,
+	COMMANDS_BINDING,
+	INSTANCES_BINDING,
+	LOD_STATE_BINDING,
+	VISIBLE_BINDING
+};
+
+// Visible buffer: frustum survivors, occluded ones among them, then the
+// survivors' slots
+const unsigned int VISIBLE_HEADER_WORDS = 2;
+
+}
+
+// The compute shader writes both as arrays of uint
+static_assert(sizeof(InstanceData) == 7 * sizeof(unsigned int), "InstanceData must match the records CullComputeShader.glsl writes");
+static_assert(sizeof(DrawElementsIndirectCommand) == 5 * sizeof(unsigned int), "Commands are 5 words in CullComputeShader.glsl");
+
+GpuCuller::GpuCuller()
+	: drawProgram(nullptr), transforms(nullptr), occlusion(nullptr), stream(nullptr), layoutDirty(false), cullData(), instanceCapacity(0), vao(0),
+	cullUBO(0), objectBuffer(0), meshBuffer(0), lodBuffer(0), lodStateBuffer(0), visibleBuffer(0),
+	commandTemplate(0), commandBuffer(0), instanceBuffer(0), drawInfoBuffer(0), drawInfoTexture(0),
+	gpuSlotCapacity(0), countFrame(0), visibleCount(0), occludedCount(0), drawCalls(0), residentCount(0), dispatched(false) {
+	for (unsigned int i = 0; i < COUNT_READBACKS; ++i) {
+		countBuffers[i] = 0;
+		countFences[i] = nullptr;
+	}
+}
+
+GpuCuller::~GpuCuller() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool GpuCuller::isSupported() {
+	return GLExtensions::hasComputeShaders() && GLExtensions::hasMultiDrawIndirect()
+		&& MeshCache::getInstance().getPool() != nullptr;
+}
+
+bool GpuCuller::init(ShaderProgram& program, const TransformBuffer& transformBuffer) {
+	if (cullProgram.isValid()) {
+		return true;
+	}
+	if (!isSupported() || !cullProgram.loadCompute(CULL_SHADER_PATH)) {
+		return false;
+	}
+	cullProgram.bindUniformBlock(CULL_BLOCK_NAME, BINDING);
+	cullProgram.use();
+	cullProgram.set(cullProgram.getUniform("depthPyramid"), HiZBuffer::TEXTURE_UNIT);
+	drawProgram = &program;
+	transforms = &transformBuffer;
+
+	GLuint* buffers[] = { &cullUBO, &objectBuffer, &meshBuffer, &lodBuffer, &lodStateBuffer, &visibleBuffer,
+		&commandTemplate, &commandBuffer, &instanceBuffer, &drawInfoBuffer };
+	for (GLuint* buffer : buffers) {
+		glGenBuffers(1, buffer);
+	}
+	glGenTextures(1, &drawInfoTexture);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, cullUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CullData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenBuffers(COUNT_READBACKS, countBuffers);
+	for (unsigned int i = 0; i < COUNT_READBACKS; ++i) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffers[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, VISIBLE_HEADER_WORDS * sizeof(GLuint), nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Everything set before init() still has to go up
+	gpuSlotCapacity = 0;
+	layoutDirty = true;
+	return true;
+}
+
+void GpuCuller::cleanup() {
+	GLuint* buffers[] = { &cullUBO, &objectBuffer, &meshBuffer, &lodBuffer, &lodStateBuffer, &visibleBuffer,
+		&commandTemplate, &commandBuffer, &instanceBuffer, &drawInfoBuffer };
+	for (GLuint* buffer : buffers) {
+		if (*buffer != 0) {
+			glDeleteBuffers(1, buffer);
+			*buffer = 0;
+		}
+	}
+	if (drawInfoTexture != 0) {
+		glDeleteTextures(1, &drawInfoTexture);
+		drawInfoTexture = 0;
+	}
+	for (unsigned int i = 0; i < COUNT_READBACKS; ++i) {
+		if (countFences[i]) {
+			glDeleteSync(countFences[i]);
+			countFences[i] = nullptr;
+		}
+		if (countBuffers[i] != 0) {
+			glDeleteBuffers(1, &countBuffers[i]);
+			countBuffers[i] = 0;
+		}
+	}
+	cullProgram.cleanup();
+	gpuSlotCapacity = 0;
+	layoutDirty = true;
+	dispatched = false;
+}
+
+void GpuCuller::set(unsigned int slot, const Mesh* mesh, const BoundingBox& bounds, const BoundingSphere& sphere,
+	const glm::vec3& color, bool selected, bool hovered, unsigned int pickId) {
+	if (!mesh) {
+		remove(slot);
+		return;
+	}
+	if (slot >= objects.size()) {
+		CullObject empty = {};
+		empty.mesh = NO_MESH;
+		objects.resize(slot + 1, empty);
+		slotMeshes.resize(slot + 1, nullptr);
+		slotDirty.resize(slot + 1, 0);
+	}
+
+	const Mesh* previous = slotMeshes[slot];
+	auto entry = meshes.find(mesh);
+	if (previous != mesh) {
+		if (previous) {
+			remove(slot);
+		}
+		if (entry == meshes.end()) {
+			entry = meshes.emplace(mesh, MeshEntry{ 0, 0, NO_MESH }).first;
+		}
+		// A new mesh or one without room for another instance needs new commands
+		if (++entry->second.slotCount > entry->second.capacity) {
+			layoutDirty = true;
+		}
+		slotMeshes[slot] = mesh;
+		++residentCount;
+	}
+
+	CullObject& object = objects[slot];
+	object.boundsMin = glm::vec4(bounds.boundsMin, 0.0f);
+	object.boundsMax = glm::vec4(bounds.boundsMax, 0.0f);
+	object.sphere = glm::vec4(sphere.center, sphere.radius);
+	object.color = glm::vec4(color, selected ? 1.0f : (hovered ? 0.25f : 0.0f));
+	object.transformSlot = slot;
+	object.pickId = pickId;
+	object.mesh = entry->second.index;   // NO_MESH until the layout includes it
+
+	if (!slotDirty[slot]) {
+		slotDirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+}
+
+void GpuCuller::remove(unsigned int slot) {
+	if (!contains(slot)) {
+		return;
+	}
+
+	// Commands of a mesh nobody uses any more are dropped at the next
+	// rebuild; until then they just stay empty
+	auto entry = meshes.find(slotMeshes[slot]);
+	if (--entry->second.slotCount == 0) {
+		meshes.erase(entry);
+		layoutDirty = true;
+	}
+	slotMeshes[slot] = nullptr;
+	--residentCount;
+
+	objects[slot].mesh = NO_MESH;
+	if (!slotDirty[slot]) {
+		slotDirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+}
+
+void GpuCuller::rebuildLayout() {
+	layoutDirty = false;
+	commands.clear();
+	drawInfos.clear();
+	instanceCapacity = 0;
+	vao = 0;
+
+	vector<glm::uvec2> meshRecords;
+	vector<CullLod> lodRecords;
+	for (auto& item : meshes) {
+		const Mesh* mesh = item.first;
+		MeshEntry& entry = item.second;
+		// Doubling keeps objects added one at a time from rebuilding every frame
+		if (entry.slotCount > entry.capacity) {
+			entry.capacity = max(entry.slotCount, entry.capacity * 2);
+		}
+		entry.index = (unsigned int)meshRecords.size();
+		meshRecords.push_back(glm::uvec2((unsigned int)lodRecords.size(), mesh->getLodCount()));
+		vao = mesh->getVAO();
+
+		for (unsigned int lod = 0; lod < mesh->getLodCount(); ++lod) {
+			CullLod level = {};
+			level.error = mesh->getLods()[lod].error;
+			level.firstCommand = (unsigned int)commands.size();
+
+			ranges.clear();
+			mesh->getDrawRanges(lod, ranges);
+			for (const MeshDrawRange& range : ranges) {
+				DrawElementsIndirectCommand command;
+				command.count = range.indexCount;
+				command.instanceCount = 0;
+				command.firstIndex = range.firstIndex;
+				command.baseVertex = mesh->getBaseVertex();
+				command.baseInstance = (GLuint)instanceCapacity;
+				commands.push_back(command);
+				drawInfos.push_back(InstanceRenderer::makeDrawInfo(mesh, range.material->diffuse, range.material->shininess));
+				instanceCapacity += entry.capacity;
+			}
+			level.commandCount = (unsigned int)commands.size() - level.firstCommand;
+			lodRecords.push_back(level);
+		}
+	}
+
+	// Mesh indices changed for every slot
+	for (size_t slot = 0; slot < objects.size(); ++slot) {
+		objects[slot].mesh = slotMeshes[slot] ? meshes[slotMeshes[slot]].index : NO_MESH;
+	}
+	gpuSlotCapacity = 0;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, meshRecords.size() * sizeof(glm::uvec2), meshRecords.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lodRecords.size() * sizeof(CullLod), lodRecords.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// cull() copies the template, with every instanceCount 0, over the live commands
+	glBindBuffer(GL_COPY_WRITE_BUFFER, commandTemplate);
+	glBufferData(GL_COPY_WRITE_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_COPY);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, drawInfoBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, drawInfos.size() * sizeof(InstanceRenderer::DrawInfo), drawInfos.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, drawInfoTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawInfoBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void GpuCuller::uploadObjects() {
+	size_t slotCount = objects.size();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+
+	if (slotCount > gpuSlotCapacity) {
+		// Reallocating loses the contents, so send everything once. The
+		// levels start over from the finest, which select() leaves at once.
+		gpuSlotCapacity = max(slotCount, gpuSlotCapacity * 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, gpuSlotCapacity * sizeof(CullObject), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, slotCount * sizeof(CullObject), objects.data());
+
+		vector<GLuint> zeros(gpuSlotCapacity + VISIBLE_HEADER_WORDS, 0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodStateBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, gpuSlotCapacity * sizeof(GLuint), zeros.data(), GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (gpuSlotCapacity + VISIBLE_HEADER_WORDS) * sizeof(GLuint), zeros.data(), GL_DYNAMIC_COPY);
+	}
+	else if (!dirtySlots.empty()) {
+		// One call per run of consecutive slots
+		sort(dirtySlots.begin(), dirtySlots.end());
+		size_t first = 0;
+		while (first < dirtySlots.size()) {
+			size_t last = first + 1;
+			while (last < dirtySlots.size() && dirtySlots[last] == dirtySlots[last - 1] + 1) {
+				++last;
+			}
+			size_t slot = dirtySlots[first];
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * sizeof(CullObject), (last - first) * sizeof(CullObject), &objects[slot]);
+			first = last;
+		}
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (unsigned int slot : dirtySlots) {
+		slotDirty[slot] = 0;
+	}
+	dirtySlots.clear();
+}
+
+void GpuCuller::readCounts() {
+	// Oldest first, so the newest finished count is kept
+	for (unsigned int i = 0; i < COUNT_READBACKS; ++i) {
+		unsigned int index = (countFrame + i) % COUNT_READBACKS;
+		if (!countFences[index] || glClientWaitSync(countFences[index], 0, 0) == GL_TIMEOUT_EXPIRED) {
+			continue;
+		}
+		glDeleteSync(countFences[index]);
+		countFences[index] = nullptr;
+
+		GLuint counts[VISIBLE_HEADER_WORDS] = {};
+		glBindBuffer(GL_COPY_READ_BUFFER, countBuffers[index]);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		occludedCount = counts[1];
+		visibleCount = counts[0] - counts[1];
+	}
+}
+
+void GpuCuller::cull(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, RenderQueue& queue) {
+	drawCalls = 0;
+	dispatched = false;
+	if (!cullProgram.isValid()) {
+		return;
+	}
+	readCounts();
+	if (layoutDirty) {
+		rebuildLayout();
+	}
+	uploadObjects();
+	if (residentCount == 0 || commands.empty()) {
+		visibleCount = 0;
+		occludedCount = 0;
+		return;
+	}
+
+	Frustum frustum(projection * view);
+	for (int i = 0; i < 6; ++i) {
+		cullData.frustumPlanes[i] = frustum.getPlane(i);
+	}
+	cullData.view = view;
+	cullData.lodParams = glm::vec4(projection[1][1], viewportHeight, LodSelector::MAX_PIXEL_ERROR, LodSelector::HYSTERESIS);
+	cullData.counts = glm::uvec4((unsigned int)objects.size(), 0, 0, 0);
+	cullData.pyramidParams = glm::vec4(0.0f);
+	if (occlusion && occlusion->hasGpuPyramid()) {
+		cullData.pyramidViewProjection = occlusion->getPyramidViewProjection();
+		cullData.pyramidParams = occlusion->getPyramidParams();
+		occlusion->bindPyramid();
+	}
+	GLintptr streamed = stream ? stream->write(&cullData, sizeof(CullData), stream->getUniformAlignment())
+		: StreamBuffer::NO_OFFSET;
+	if (streamed != StreamBuffer::NO_OFFSET) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, stream->getBuffer(), streamed, sizeof(CullData));
+	}
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, cullUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CullData), &cullData);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, cullUBO);
+	}
+
+	// Instance counts and the visible list start empty every frame
+	GLuint zeros[VISIBLE_HEADER_WORDS] = {};
+	glBindBuffer(GL_COPY_READ_BUFFER, commandTemplate);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commands.size() * sizeof(DrawElementsIndirectCommand));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, visibleBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(zeros), zeros);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	cullProgram.use();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHES_BINDING, meshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LODS_BINDING, lodBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LOD_STATE_BINDING, lodStateBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, visibleBuffer);
+	GLExtensions::dispatchCompute((GLuint)((objects.size() + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE), 1, 1);
+	// The draw reads the commands and instances; copies read the visible count
+	GLExtensions::memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	dispatched = true;
+
+	// Skipped while the readback in this slot is still in flight
+	if (!countFences[countFrame]) {
+		glBindBuffer(GL_COPY_READ_BUFFER, visibleBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffers[countFrame]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, VISIBLE_HEADER_WORDS * sizeof(GLuint));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		countFences[countFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		countFrame = (countFrame + 1) % COUNT_READBACKS;
+	}
+
+	DrawPacket packet;
+	packet.program = drawProgram;
+	packet.vao = vao;
+	packet.texture = 0;
+	packet.depthFunc = GL_LESS;
+	packet.depthWrite = true;
+	packet.drawer = this;
+	packet.payload = 0;
+	packet.key = RenderQueue::makeKey(RenderPass::WORLD, drawProgram->getId(), 0, vao, 0.0f);
+	queue.submit(packet);
+}
+
+void GpuCuller::bindBuffers() const {
+	transforms->bind();
+	glActiveTexture(GL_TEXTURE0 + InstanceRenderer::DRAW_INFO_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, drawInfoTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GpuCuller::draw() const {
+	// Empty commands cost next to nothing, so all of them go out
+	InstanceRenderer::bindInstanceAttributes(instanceBuffer, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	GLExtensions::multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCuller::drawPacket(unsigned int) {
+	// The queue has bound the draw program and the pool's VAO
+	bindBuffers();
+	draw();
+	++drawCalls;
+}
+
+void GpuCuller::redraw() const {
+	if (!dispatched) {
+		return;
+	}
+	glBindVertexArray(vao);
+	bindBuffers();
+	draw();
+	glBindVertexArray(0);
+}
+
+void GpuCuller::readVisibleSlots(vector<unsigned int>& slots) const {
+	slots.clear();
+	if (!dispatched) {
+		return;
+	}
+
+	GLuint count = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, visibleBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(count), &count);
+	slots.resize(count);
+	if (count > 0) {
+		glGetBufferSubData(GL_COPY_READ_BUFFER, VISIBLE_HEADER_WORDS * sizeof(GLuint), count * sizeof(GLuint), slots.data());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
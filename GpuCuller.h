@@ -0,0 +1,189 @@
+#pragma once
+#ifndef GPUCULLER_H
+#define GPUCULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include "Frustum.h"
+#include "GLExtensions.h"
+#include "HiZBuffer.h"
+#include "InstanceRenderer.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TransformBuffer.h"
+
+using namespace std;
+
+// CPU mirror of the std140 CullData block in CullComputeShader.glsl. Only
+// vec4, uvec4 and mat4 members, so std140 adds no padding.
+struct CullData {
+	glm::vec4 frustumPlanes[6];
+	glm::mat4 view;
+	glm::vec4 lodParams;    // projection[1][1], viewport height, max pixel error, hysteresis
+	glm::uvec4 counts;      // x = slot count
+	glm::mat4 pyramidViewProjection;   // Camera of the HiZBuffer's depth pyramid
+	glm::vec4 pyramidParams;           // Screen width, height, level count; w = 0 skips the occlusion test
+};
+
+static_assert(sizeof(CullData) == 272, "CullData must match the std140 block layout");
+
+// Frustum culling and level of detail selection on the GPU, the optional
+// path for GL 4.3 contexts (GLExtensions::hasComputeShaders()) with a
+// MeshPool.
+//
+// Every object the manager owns has a record in a GPU buffer, indexed by the
+// same slot as its TransformBuffer entry and only rewritten when the object
+// changes. Each frame cull() runs CullComputeShader.glsl over all slots: it
+// tests the world AABB against the frustum like Frustum::intersectsAABB,
+// picks the level like LodSelector, and appends the survivors to the draw
+// commands of their mesh and level. The compacted instances and the
+// instance counts never leave the GPU; one glMultiDrawElementsIndirect
+// draws them. The CPU only touches objects that changed.
+//
+// With a HiZBuffer set, survivors of the frustum test are also tested
+// against its depth pyramid, the same way as HiZBuffer::isOccluded(), and
+// hidden ones are counted instead of drawn.
+//
+// The command layout (one command per material run of every level of every
+// mesh, like InstanceRenderer's) is rebuilt when a mesh is first used or a
+// mesh gains more objects than its commands have room for. Each command
+// reserves room for every object of its mesh, so capacity grows with
+// objects times commands per mesh.
+//
+// Only loaded meshes in the MeshPool can be culled here; the owner draws
+// anything else, e.g. proxy boxes, through its InstanceRenderer.
+class GpuCuller : public PacketDrawer {
+private:
+	// std430 records shared with the compute shader
+	struct CullObject {
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		glm::vec4 sphere;
+		glm::vec4 color;
+		unsigned int transformSlot;
+		unsigned int pickId;
+		unsigned int mesh;
+		unsigned int padding;
+	};
+
+	struct CullLod {
+		float error;
+		unsigned int firstCommand;
+		unsigned int commandCount;
+		unsigned int padding;
+	};
+
+	struct MeshEntry {
+		unsigned int slotCount;   // Slots using the mesh
+		unsigned int capacity;    // Instances reserved per command
+		unsigned int index;       // In the current layout, NO_MESH before the next rebuild
+	};
+
+	ShaderProgram cullProgram;
+	ShaderProgram* drawProgram;
+	const TransformBuffer* transforms;
+	const HiZBuffer* occlusion;
+	StreamBuffer* stream;     // For CullData; cullUBO when null or full
+
+	// Per slot
+	vector<CullObject> objects;
+	vector<const Mesh*> slotMeshes;
+	vector<unsigned int> dirtySlots;
+	vector<unsigned char> slotDirty;
+	unordered_map<const Mesh*, MeshEntry> meshes;
+	bool layoutDirty;
+	CullData cullData;
+
+	// Layout of the last rebuild
+	vector<DrawElementsIndirectCommand> commands;
+	vector<InstanceRenderer::DrawInfo> drawInfos;
+	vector<MeshDrawRange> ranges;   // Scratch
+	size_t instanceCapacity;
+	GLuint vao;
+
+	GLuint cullUBO;
+	GLuint objectBuffer, meshBuffer, lodBuffer, lodStateBuffer, visibleBuffer;
+	GLuint commandTemplate, commandBuffer, instanceBuffer;
+	GLuint drawInfoBuffer, drawInfoTexture;
+	size_t gpuSlotCapacity;
+
+	// Visible counts come back a few frames late, without waiting on the GPU
+	static const unsigned int COUNT_READBACKS = 3;
+	GLuint countBuffers[COUNT_READBACKS];
+	GLsync countFences[COUNT_READBACKS];
+	unsigned int countFrame;
+	size_t visibleCount;
+	size_t occludedCount;
+	unsigned int drawCalls;
+	size_t residentCount;
+	bool dispatched;      // The last cull() ran the compute pass
+
+	void rebuildLayout();
+	void uploadObjects();
+	void readCounts();
+	void bindBuffers() const;
+	void draw() const;
+
+public:
+	static const unsigned int NO_MESH = 0xFFFFFFFF;
+	static const unsigned int WORK_GROUP_SIZE = 64;
+	// Uniform buffer binding of CullData; FrameUniforms::BINDING is below
+	static const GLuint BINDING = 1;
+
+	GpuCuller();
+	~GpuCuller();
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	// Compute shaders and indirect drawing with a MeshPool in MeshCache
+	static bool isSupported();
+
+	// Loads the compute shader; false when unsupported or it fails to build.
+	// drawProgram and transformBuffer must outlive the culler.
+	bool init(ShaderProgram& drawProgram, const TransformBuffer& transformBuffer);
+	void cleanup();
+	bool isValid() const { return cullProgram.isValid(); }
+
+	// Record of one slot. mesh must be loaded and pooled; bounds is the
+	// world AABB to cull and sphere the world bounding sphere of the mesh
+	// for the level of detail (see LodSelector).
+	void set(unsigned int slot, const Mesh* mesh, const BoundingBox& bounds, const BoundingSphere& sphere,
+		const glm::vec3& color, bool selected, bool hovered, unsigned int pickId);
+	// Takes the slot out of culling, e.g. while its mesh is reloading
+	void remove(unsigned int slot);
+	bool contains(unsigned int slot) const { return slot < slotMeshes.size() && slotMeshes[slot] != nullptr; }
+
+	// Depth pyramid to test against; null turns occlusion culling off
+	void setOcclusionBuffer(const HiZBuffer* buffer) { occlusion = buffer; }
+	// Streams CullData from buffer, which must outlive the culler
+	void setStreamBuffer(StreamBuffer* buffer) { stream = buffer; }
+
+	// Uploads changed records, runs the compute pass and queues the packet
+	// that draws what survived. The transform buffer must be uploaded.
+	void cull(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, RenderQueue& queue);
+	void drawPacket(unsigned int payload) override;
+
+	// Draws the last cull's instances again with the program that is bound,
+	// e.g. the PickBuffer's
+	void redraw() const;
+
+	// Slots that passed the frustum test in the last cull, occluded or not.
+	// Waits for the GPU, so it is meant for checks against the CPU culler,
+	// not every frame.
+	void readVisibleSlots(vector<unsigned int>& slots) const;
+
+	size_t getObjectCount() const { return residentCount; }
+	// Drawn and occluded objects of a cull a few frames back; the GPU is
+	// never waited on for them
+	size_t getVisibleCount() const { return visibleCount; }
+	size_t getOccludedCount() const { return occludedCount; }
+	size_t getCommandCount() const { return commands.size(); }
+	unsigned int getDrawCallCount() const { return drawCalls; }
+};
+
+#endif // !GPUCULLER_H
@@ -0,0 +1,377 @@
+#include "HiZBuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+
+namespace {
+
+// Parameter of a read framebuffer attachment, 0 when there is none
+GLint getAttachmentParameter(GLenum attachment, GLenum name) {
+	GLint type = GL_NONE;
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+	if (type == GL_NONE) {
+		return 0;
+	}
+	GLint value = 0;
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, name, &value);
+	return value;
+}
+
+}
+
+HiZBuffer::HiZBuffer()
+	: sourceUniform(INVALID_UNIFORM), vao(0), depthFbo(0), depthTexture(0), pyramidFbo(0), pyramidTexture(0),
+	depthFormat(GL_NONE), layout(), gpuPyramidValid(false), submittedViewProjection(1.0f),
+	readbackBytes(0), firstPending(0), pendingCount(0), cpuLayout(), cpuPyramidValid(false) {
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		readbacks[i] = { 0, nullptr, Layout() };
+	}
+}
+
+HiZBuffer::~HiZBuffer() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool HiZBuffer::init() {
+	if (!shader.load("shaders/vertex/HiZVertexShader.glsl", "shaders/fragment/HiZFragmentShader.glsl")) {
+		return false;
+	}
+	sourceUniform = shader.getUniform("source");
+
+	// The fullscreen triangle comes from gl_VertexID, but core profiles
+	// still want a VAO bound
+	glGenVertexArrays(1, &vao);
+	glGenFramebuffers(1, &depthFbo);
+	glGenFramebuffers(1, &pyramidFbo);
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		glGenBuffers(1, &readbacks[i].pbo);
+	}
+	return true;
+}
+
+void HiZBuffer::cleanup() {
+	dropReadbacks();
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		if (readbacks[i].pbo != 0) {
+			glDeleteBuffers(1, &readbacks[i].pbo);
+			readbacks[i].pbo = 0;
+		}
+	}
+	releaseTextures();
+	if (depthFbo != 0) {
+		glDeleteFramebuffers(1, &depthFbo);
+		depthFbo = 0;
+	}
+	if (pyramidFbo != 0) {
+		glDeleteFramebuffers(1, &pyramidFbo);
+		pyramidFbo = 0;
+	}
+	if (vao != 0) {
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	shader.cleanup();
+	cpuPyramidValid = false;
+}
+
+int HiZBuffer::getLevelWidth(const Layout& pyramid, int level) {
+	return max(1, pyramid.screenWidth >> (level + 1));
+}
+
+int HiZBuffer::getLevelHeight(const Layout& pyramid, int level) {
+	return max(1, pyramid.screenHeight >> (level + 1));
+}
+
+size_t HiZBuffer::getReadbackBytes(const Layout& pyramid) {
+	size_t bytes = 0;
+	for (int level = pyramid.firstReadLevel; level < pyramid.levelCount; ++level) {
+		bytes += (size_t)getLevelWidth(pyramid, level) * getLevelHeight(pyramid, level) * sizeof(float);
+	}
+	return bytes;
+}
+
+void HiZBuffer::releaseTextures() {
+	if (depthTexture != 0) {
+		glDeleteTextures(1, &depthTexture);
+		depthTexture = 0;
+	}
+	if (pyramidTexture != 0) {
+		glDeleteTextures(1, &pyramidTexture);
+		pyramidTexture = 0;
+	}
+	gpuPyramidValid = false;
+}
+
+void HiZBuffer::dropReadbacks() {
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		if (readbacks[i].fence) {
+			glDeleteSync(readbacks[i].fence);
+			readbacks[i].fence = nullptr;
+		}
+	}
+	firstPending = 0;
+	pendingCount = 0;
+}
+
+bool HiZBuffer::allocate(int width, int height) {
+	releaseTextures();
+	dropReadbacks();
+	layout.screenWidth = width;
+	layout.screenHeight = height;
+
+	// The depth blit needs the source's exact format
+	GLint framebuffer, readFramebuffer;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	GLint depthBits = getAttachmentParameter(framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE);
+	GLint stencilBits = getAttachmentParameter(framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE);
+	GLint componentType = depthBits > 0
+		? getAttachmentParameter(framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE)
+		: GL_NONE;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	if (depthBits == 0) {
+		cerr << "Occlusion culling needs a depth buffer" << endl;
+		return false;
+	}
+
+	GLenum format = GL_DEPTH_COMPONENT;
+	GLenum type = GL_UNSIGNED_INT;
+	if (componentType == GL_FLOAT) {
+		depthFormat = stencilBits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+		format = stencilBits > 0 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+		type = stencilBits > 0 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_FLOAT;
+	}
+	else if (depthBits <= 16) {
+		depthFormat = GL_DEPTH_COMPONENT16;
+	}
+	else if (depthBits <= 24 && stencilBits > 0) {
+		depthFormat = GL_DEPTH24_STENCIL8;
+		format = GL_DEPTH_STENCIL;
+		type = GL_UNSIGNED_INT_24_8;
+	}
+	else {
+		depthFormat = depthBits <= 24 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT32;
+	}
+
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, depthFormat, width, height, 0, format, type, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+	layout.levelCount = 1;
+	while (getLevelWidth(layout, layout.levelCount - 1) > 1 || getLevelHeight(layout, layout.levelCount - 1) > 1) {
+		++layout.levelCount;
+	}
+	layout.firstReadLevel = 0;
+	while (getLevelWidth(layout, layout.firstReadLevel) > READBACK_WIDTH) {
+		++layout.firstReadLevel;
+	}
+
+	glGenTextures(1, &pyramidTexture);
+	glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+	for (int level = 0; level < layout.levelCount; ++level) {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, getLevelWidth(layout, level), getLevelHeight(layout, level),
+			0, GL_RED, GL_FLOAT, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, layout.levelCount - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previousFramebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Depth pyramid framebuffer incomplete: 0x" << hex << status << dec << endl;
+		releaseTextures();
+		return false;
+	}
+
+	readbackBytes = getReadbackBytes(layout);
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackBytes, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+void HiZBuffer::poll() {
+	while (pendingCount > 0) {
+		Readback& readback = readbacks[firstPending];
+		GLenum state = glClientWaitSync(readback.fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+			return;
+		}
+		glDeleteSync(readback.fence);
+		readback.fence = nullptr;
+		firstPending = (firstPending + 1) % READBACK_SLOTS;
+		--pendingCount;
+
+		size_t bytes = getReadbackBytes(readback.layout);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		const float* depths = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+		if (depths) {
+			cpuLayout = readback.layout;
+			cpuDepths.assign(depths, depths + bytes / sizeof(float));
+			cpuLevelOffsets.clear();
+			size_t offset = 0;
+			for (int level = cpuLayout.firstReadLevel; level < cpuLayout.levelCount; ++level) {
+				cpuLevelOffsets.push_back(offset);
+				offset += (size_t)getLevelWidth(cpuLayout, level) * getLevelHeight(cpuLayout, level);
+			}
+			cpuPyramidValid = true;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+void HiZBuffer::submit(RenderQueue& queue, const glm::mat4& view, const glm::mat4& projection, int width, int height) {
+	if (!isValid() || width <= 0 || height <= 0) {
+		return;
+	}
+	// A failed allocation is only retried at the next size
+	if (width != layout.screenWidth || height != layout.screenHeight) {
+		allocate(width, height);
+	}
+	if (pyramidTexture == 0) {
+		return;
+	}
+	submittedViewProjection = projection * view;
+
+	DrawPacket packet;
+	packet.program = &shader;
+	packet.vao = vao;
+	packet.texture = pyramidTexture;
+	packet.depthFunc = GL_LESS;
+	packet.depthWrite = true;
+	packet.drawer = this;
+	packet.payload = 0;
+	packet.key = RenderQueue::makeKey(RenderPass::DEPTH_PYRAMID, shader.getId(), pyramidTexture, vao, 0.0f);
+	queue.submit(packet);
+}
+
+void HiZBuffer::drawPacket(unsigned int) {
+	GLint framebuffer, readFramebuffer, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbo);
+	glBlitFramebuffer(0, 0, layout.screenWidth, layout.screenHeight, 0, 0, layout.screenWidth, layout.screenHeight,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	// Each level reads the one above it, which is made the only level
+	// visible to the sampler so the target level isn't read from
+	glBindFramebuffer(GL_FRAMEBUFFER, pyramidFbo);
+	shader.set(sourceUniform, 0);
+	glActiveTexture(GL_TEXTURE0);
+	for (int level = 0; level < layout.levelCount; ++level) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+		glViewport(0, 0, getLevelWidth(layout, level), getLevelHeight(layout, level));
+		if (level == 0) {
+			glBindTexture(GL_TEXTURE_2D, depthTexture);
+		}
+		else {
+			glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+		}
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	// Left bound as the queue bound it
+	glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, layout.levelCount - 1);
+	layout.viewProjection = submittedViewProjection;
+	gpuPyramidValid = true;
+
+	// The copy into the PBO is queued; the fence says when it has landed
+	if (pendingCount < READBACK_SLOTS) {
+		Readback& readback = readbacks[(firstPending + pendingCount) % READBACK_SLOTS];
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		size_t offset = 0;
+		for (int level = layout.firstReadLevel; level < layout.levelCount; ++level) {
+			glGetTexImage(GL_TEXTURE_2D, level, GL_RED, GL_FLOAT, (void*)offset);
+			offset += (size_t)getLevelWidth(layout, level) * getLevelHeight(layout, level) * sizeof(float);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		readback.layout = layout;
+		++pendingCount;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool HiZBuffer::isOccluded(const BoundingBox& bounds) const {
+	if (!cpuPyramidValid) {
+		return false;
+	}
+
+	// Screen rectangle and nearest depth with the pyramid's camera
+	glm::vec3 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+	for (int corner = 0; corner < 8; ++corner) {
+		glm::vec4 point((corner & 1) ? bounds.boundsMax.x : bounds.boundsMin.x,
+			(corner & 2) ? bounds.boundsMax.y : bounds.boundsMin.y,
+			(corner & 4) ? bounds.boundsMax.z : bounds.boundsMin.z, 1.0f);
+		glm::vec4 clip = cpuLayout.viewProjection * point;
+		if (clip.w <= 0.0f) {
+			return false; // Reaches behind the camera
+		}
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+	// Nothing is known beyond the edges of the view
+	if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f || ndcMax.y > 1.0f) {
+		return false;
+	}
+
+	// Screen pixels, then the first level where the rectangle spans at
+	// most 2x2 texels (a texel of level L covers 2^(L+1) pixels)
+	int x0 = min((int)((ndcMin.x * 0.5f + 0.5f) * cpuLayout.screenWidth), cpuLayout.screenWidth - 1);
+	int x1 = min((int)((ndcMax.x * 0.5f + 0.5f) * cpuLayout.screenWidth), cpuLayout.screenWidth - 1);
+	int y0 = min((int)((ndcMin.y * 0.5f + 0.5f) * cpuLayout.screenHeight), cpuLayout.screenHeight - 1);
+	int y1 = min((int)((ndcMax.y * 0.5f + 0.5f) * cpuLayout.screenHeight), cpuLayout.screenHeight - 1);
+	int level = cpuLayout.firstReadLevel;
+	while (level + 1 < cpuLayout.levelCount
+		&& ((x1 >> (level + 1)) - (x0 >> (level + 1)) > 1 || (y1 >> (level + 1)) - (y0 >> (level + 1)) > 1)) {
+		++level;
+	}
+
+	int width = getLevelWidth(cpuLayout, level);
+	int height = getLevelHeight(cpuLayout, level);
+	const float* depths = &cpuDepths[cpuLevelOffsets[level - cpuLayout.firstReadLevel]];
+	float farthest = 0.0f;
+	for (int y = min(y0 >> (level + 1), height - 1); y <= min(y1 >> (level + 1), height - 1); ++y) {
+		for (int x = min(x0 >> (level + 1), width - 1); x <= min(x1 >> (level + 1), width - 1); ++x) {
+			farthest = max(farthest, depths[y * width + x]);
+		}
+	}
+	return ndcMin.z * 0.5f + 0.5f > farthest;
+}
+
+void HiZBuffer::bindPyramid() const {
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+glm::vec4 HiZBuffer::getPyramidParams() const {
+	return glm::vec4((float)layout.screenWidth, (float)layout.screenHeight, (float)layout.levelCount, 1.0f);
+}
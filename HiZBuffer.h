@@ -0,0 +1,118 @@
+#pragma once
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+
+using namespace std;
+
+// Hierarchical depth buffer for occlusion culling. At the end of the WORLD
+// pass the frame's depth is copied and reduced into a mip chain where every
+// texel holds the farthest depth of the pixels it covers. A box whose
+// nearest point is farther than that over its whole screen rectangle is
+// hidden behind what was drawn.
+//
+// The tests run against the pyramid of an earlier frame, with the camera
+// it was drawn with, so an object that comes into view can show up a frame
+// or two late. Boxes crossing that camera's near plane or the edge of its
+// view always pass.
+//
+// The coarse levels (READBACK_WIDTH wide or less) are read back through
+// PBOs and fences like the PickBuffer's, never waiting on the GPU; the
+// managers test against them in isOccluded(). GpuCuller samples the whole
+// pyramid texture instead, on TEXTURE_UNIT.
+//
+// Usage per frame: poll() before the managers render, submit() with the
+// rest of the frame's packets.
+class HiZBuffer : public PacketDrawer {
+public:
+	// Widest level copied back for the CPU tests
+	static const int READBACK_WIDTH = 256;
+	// Readbacks in flight; a frame's pyramid is not read back while all are
+	static const unsigned int READBACK_SLOTS = 3;
+	// Texture unit GpuCuller samples the pyramid from; the instance
+	// renderer's units are below
+	static const GLint TEXTURE_UNIT = 6;
+
+private:
+	// Sizes of one pyramid; level 0 is half the screen, rounded down
+	struct Layout {
+		glm::mat4 viewProjection;
+		int screenWidth, screenHeight;
+		int levelCount;
+		int firstReadLevel;   // Coarsest levels from here are read back
+	};
+
+	struct Readback {
+		GLuint pbo;
+		GLsync fence;
+		Layout layout;
+	};
+
+	ShaderProgram shader;
+	UniformHandle sourceUniform;
+	GLuint vao;
+	GLuint depthFbo, depthTexture;
+	GLuint pyramidFbo, pyramidTexture;
+	GLenum depthFormat;
+
+	// Of the textures, and of the pyramid the GPU holds once drawn
+	Layout layout;
+	bool gpuPyramidValid;
+	glm::mat4 submittedViewProjection;
+
+	Readback readbacks[READBACK_SLOTS];
+	size_t readbackBytes;
+	unsigned int firstPending;   // Oldest readback in flight
+	unsigned int pendingCount;
+
+	// The newest pyramid read back
+	Layout cpuLayout;
+	vector<float> cpuDepths;
+	vector<size_t> cpuLevelOffsets;   // Into cpuDepths, from cpuLayout.firstReadLevel
+	bool cpuPyramidValid;
+
+	static int getLevelWidth(const Layout& pyramid, int level);
+	static int getLevelHeight(const Layout& pyramid, int level);
+	static size_t getReadbackBytes(const Layout& pyramid);
+	bool allocate(int width, int height);
+	void releaseTextures();
+	void dropReadbacks();
+
+public:
+	HiZBuffer();
+	~HiZBuffer();
+
+	HiZBuffer(const HiZBuffer&) = delete;
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+	bool init();
+	void cleanup();
+	bool isValid() const { return vao != 0; }
+
+	// Copies finished readbacks into the CPU pyramid; never waits
+	void poll();
+
+	// Queues the pyramid build in the DEPTH_PYRAMID pass, from the depth of
+	// the framebuffer bound now (width x height) and the frame's camera
+	void submit(RenderQueue& queue, const glm::mat4& view, const glm::mat4& projection, int width, int height);
+	void drawPacket(unsigned int payload) override;
+
+	// True when bounds (world space) was hidden in the newest pyramid read
+	// back; false whenever that can't be shown
+	bool isOccluded(const BoundingBox& bounds) const;
+
+	// The pyramid texture on TEXTURE_UNIT, for GpuCuller. Only meaningful
+	// while hasGpuPyramid().
+	bool hasGpuPyramid() const { return gpuPyramidValid; }
+	void bindPyramid() const;
+	const glm::mat4& getPyramidViewProjection() const { return layout.viewProjection; }
+	glm::vec4 getPyramidParams() const;
+};
+
+#endif // !HIZBUFFER_H
@@ -0,0 +1,355 @@
+#include "InstanceRenderer.h"
+#include "ProxyBox.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+namespace {
+
+// Material of the loading placeholder
+const glm::vec3 PROXY_DIFFUSE(0.6f, 0.6f, 0.6f);
+const float PROXY_SHININESS = 32.0f;
+
+const char* const DRAW_INFO_SAMPLER = "drawInfos";
+
+size_t getIndexSize(GLenum indexType) {
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+}
+
+InstanceRenderer::InstanceRenderer()
+	: shader(nullptr), transforms(nullptr), indirectGroupCount(0), indirectCommandCount(0),
+	stream(nullptr), instanceVBO(0), instanceCapacity(0), instanceSource(0), instanceBase(0),
+	drawInfoBuffer(0), drawInfoTexture(0), drawInfoCapacity(0),
+	indirectBuffer(0), indirectCapacity(0), indirectSource(0), indirectOffset(0), drawCalls(0) {}
+
+InstanceRenderer::~InstanceRenderer() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool InstanceRenderer::attach(ShaderProgram& program) {
+	UniformHandle sampler = program.getUniform(DRAW_INFO_SAMPLER);
+	program.set(sampler, (int)DRAW_INFO_TEXTURE_UNIT);
+	return sampler != INVALID_UNIFORM;
+}
+
+void InstanceRenderer::init(ShaderProgram& program, const TransformBuffer& transformBuffer) {
+	shader = &program;
+	transforms = &transformBuffer;
+	program.use();
+	attach(program);
+
+	if (instanceVBO == 0) {
+		glGenBuffers(1, &instanceVBO);
+		glGenBuffers(1, &drawInfoBuffer);
+		glGenTextures(1, &drawInfoTexture);
+		if (GLExtensions::hasMultiDrawIndirect()) {
+			glGenBuffers(1, &indirectBuffer);
+		}
+	}
+}
+
+void InstanceRenderer::cleanup() {
+	if (instanceVBO != 0) {
+		glDeleteBuffers(1, &instanceVBO);
+		instanceVBO = 0;
+	}
+	if (drawInfoTexture != 0) {
+		glDeleteTextures(1, &drawInfoTexture);
+		drawInfoTexture = 0;
+	}
+	if (drawInfoBuffer != 0) {
+		glDeleteBuffers(1, &drawInfoBuffer);
+		drawInfoBuffer = 0;
+	}
+	if (indirectBuffer != 0) {
+		glDeleteBuffers(1, &indirectBuffer);
+		indirectBuffer = 0;
+	}
+	instanceCapacity = 0;
+	instanceSource = 0;
+	instanceBase = 0;
+	drawInfoCapacity = 0;
+	indirectCapacity = 0;
+	indirectSource = 0;
+	indirectOffset = 0;
+	queue.clear();
+	instances.clear();
+	drawInfos.clear();
+	commands.clear();
+	groups.clear();
+	indirectGroupCount = 0;
+	indirectCommandCount = 0;
+}
+
+void InstanceRenderer::begin() {
+	queue.clear();
+}
+
+void InstanceRenderer::add(const Mesh* mesh, unsigned int lod, unsigned int transformSlot,
+	const glm::vec3& color, bool selected, bool hovered, unsigned int pickId) {
+	QueuedInstance instance;
+	instance.mesh = mesh;
+	instance.lod = mesh ? min(lod, mesh->getLodCount() - 1) : 0;
+	instance.data.transformSlot = transformSlot;
+	instance.data.pickId = pickId;
+	instance.data.drawInfo = 0;
+	instance.data.color = glm::vec4(color, selected ? 1.0f : (hovered ? 0.25f : 0.0f));
+	queue.push_back(instance);
+}
+
+InstanceRenderer::DrawInfo InstanceRenderer::makeDrawInfo(const Mesh* mesh, const glm::vec3& diffuse, float shininess) {
+	DrawInfo info;
+	info.positionScale = glm::vec4(mesh ? mesh->getPositionScale() : glm::vec3(1.0f), shininess);
+	info.positionOffset = glm::vec4(mesh ? mesh->getPositionOffset() : glm::vec3(0.0f), 0.0f);
+	info.diffuse = glm::vec4(diffuse, 1.0f);
+	return info;
+}
+
+void InstanceRenderer::bindInstanceAttributes(GLuint buffer, size_t firstInstance) {
+	// Attribute state lives in the VAO that is bound, so point the instance
+	// attributes of this mesh's VAO at the command's slice of the buffer
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	size_t base = firstInstance * sizeof(InstanceData);
+	glVertexAttribIPointer(FIRST_INSTANCE_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+		(void*)(base + offsetof(InstanceData, transformSlot)));
+	glEnableVertexAttribArray(FIRST_INSTANCE_LOCATION);
+	glVertexAttribDivisor(FIRST_INSTANCE_LOCATION, 1);
+
+	glVertexAttribPointer(COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+		(void*)(base + offsetof(InstanceData, color)));
+	glEnableVertexAttribArray(COLOR_LOCATION);
+	glVertexAttribDivisor(COLOR_LOCATION, 1);
+
+	glVertexAttribIPointer(PICK_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+		(void*)(base + offsetof(InstanceData, pickId)));
+	glEnableVertexAttribArray(PICK_ID_LOCATION);
+	glVertexAttribDivisor(PICK_ID_LOCATION, 1);
+
+	glVertexAttribIPointer(DRAW_INFO_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+		(void*)(base + offsetof(InstanceData, drawInfo)));
+	glEnableVertexAttribArray(DRAW_INFO_LOCATION);
+	glVertexAttribDivisor(DRAW_INFO_LOCATION, 1);
+}
+
+void InstanceRenderer::addCommands(const Mesh* mesh, unsigned int lod, size_t firstQueued, size_t lastQueued) {
+	Group group;
+	group.mesh = mesh;
+	group.lod = lod;
+	group.vao = mesh ? mesh->getVAO() : ProxyBox::getVAO();
+	group.indexType = mesh ? mesh->getIndexType() : GL_UNSIGNED_SHORT;
+	group.firstCommand = commands.size();
+
+	auto addCommand = [&](GLuint indexCount, GLuint firstIndex, const glm::vec3& diffuse, float shininess) {
+		DrawElementsIndirectCommand command;
+		command.count = indexCount;
+		command.instanceCount = (GLuint)(lastQueued - firstQueued);
+		command.firstIndex = firstIndex;
+		command.baseVertex = mesh ? mesh->getBaseVertex() : 0;
+		command.baseInstance = (GLuint)instances.size();
+		commands.push_back(command);
+
+		// Each command draws its own copy of the instances, tagged with its entry
+		for (size_t i = firstQueued; i < lastQueued; ++i) {
+			instances.push_back(queue[i].data);
+			instances.back().drawInfo = (unsigned int)drawInfos.size();
+		}
+		drawInfos.push_back(makeDrawInfo(mesh, diffuse, shininess));
+	};
+
+	if (!mesh) {
+		addCommand(ProxyBox::INDEX_COUNT, 0, PROXY_DIFFUSE, PROXY_SHININESS);
+	}
+	else {
+		ranges.clear();
+		mesh->getDrawRanges(lod, ranges);
+		for (const MeshDrawRange& range : ranges) {
+			addCommand(range.indexCount, range.firstIndex, range.material->diffuse, range.material->shininess);
+		}
+	}
+
+	group.commandCount = commands.size() - group.firstCommand;
+	groups.push_back(group);
+}
+
+void InstanceRenderer::flush(RenderQueue& renderQueue) {
+	drawCalls = 0;
+	instances.clear();
+	drawInfos.clear();
+	commands.clear();
+	groups.clear();
+	indirectGroupCount = 0;
+	indirectCommandCount = 0;
+	if (queue.empty() || !shader) {
+		return;
+	}
+
+	// Group by mesh and level, pooled meshes first so their commands form
+	// one range; order inside a group does not matter
+	bool indirect = GLExtensions::hasMultiDrawIndirect() && indirectBuffer != 0;
+	sort(queue.begin(), queue.end(), [indirect](const QueuedInstance& a, const QueuedInstance& b) {
+		bool aIndirect = indirect && a.mesh && a.mesh->isPooled();
+		bool bIndirect = indirect && b.mesh && b.mesh->isPooled();
+		if (aIndirect != bIndirect) {
+			return aIndirect;
+		}
+		if (a.mesh != b.mesh) {
+			return less<const Mesh*>()(a.mesh, b.mesh);
+		}
+		return a.lod < b.lod;
+	});
+
+	size_t first = 0;
+	while (first < queue.size()) {
+		const Mesh* mesh = queue[first].mesh;
+		unsigned int lod = queue[first].lod;
+		size_t last = first + 1;
+		while (last < queue.size() && queue[last].mesh == mesh && queue[last].lod == lod) {
+			++last;
+		}
+		addCommands(mesh, lod, first, last);
+		if (indirect && mesh && mesh->isPooled()) {
+			indirectGroupCount = groups.size();
+			indirectCommandCount = commands.size();
+		}
+		first = last;
+	}
+
+	// One upload per buffer for the whole frame, into the stream buffer when
+	// there is room. Otherwise growing reallocates the own buffer, and the
+	// old storage is orphaned so the driver need not wait for last frame.
+	GLintptr streamed = stream ? stream->write(instances.data(), instances.size() * sizeof(InstanceData), sizeof(InstanceData))
+		: StreamBuffer::NO_OFFSET;
+	if (streamed != StreamBuffer::NO_OFFSET) {
+		instanceSource = stream->getBuffer();
+		instanceBase = (size_t)streamed / sizeof(InstanceData);
+	}
+	else {
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		if (instances.size() > instanceCapacity) {
+			instanceCapacity = max(instances.size(), instanceCapacity * 2);
+		}
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		instanceSource = instanceVBO;
+		instanceBase = 0;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, drawInfoBuffer);
+	bool drawInfoGrown = drawInfos.size() > drawInfoCapacity;
+	if (drawInfoGrown) {
+		drawInfoCapacity = max(drawInfos.size(), drawInfoCapacity * 2);
+	}
+	glBufferData(GL_TEXTURE_BUFFER, drawInfoCapacity * sizeof(DrawInfo), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, drawInfos.size() * sizeof(DrawInfo), drawInfos.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (drawInfoGrown) {
+		glBindTexture(GL_TEXTURE_BUFFER, drawInfoTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawInfoBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	if (indirectCommandCount > 0) {
+		size_t commandBytes = indirectCommandCount * sizeof(DrawElementsIndirectCommand);
+		streamed = stream ? stream->write(commands.data(), commandBytes, sizeof(GLuint)) : StreamBuffer::NO_OFFSET;
+		if (streamed != StreamBuffer::NO_OFFSET) {
+			indirectSource = stream->getBuffer();
+			indirectOffset = streamed;
+		}
+		else {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			if (indirectCommandCount > indirectCapacity) {
+				indirectCapacity = max(indirectCommandCount, indirectCapacity * 2);
+			}
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandBytes, commands.data());
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			indirectSource = indirectBuffer;
+			indirectOffset = 0;
+		}
+	}
+
+	// One packet for all pooled meshes, one per group for the rest
+	DrawPacket packet;
+	packet.program = shader;
+	packet.texture = 0;
+	packet.depthFunc = GL_LESS;
+	packet.depthWrite = true;
+	packet.drawer = this;
+	if (indirectGroupCount > 0) {
+		packet.vao = groups[0].vao;
+		packet.payload = INDIRECT_PAYLOAD;
+		packet.key = RenderQueue::makeKey(RenderPass::WORLD, shader->getId(), 0, packet.vao, 0.0f);
+		renderQueue.submit(packet);
+	}
+	for (size_t i = indirectGroupCount; i < groups.size(); ++i) {
+		packet.vao = groups[i].vao;
+		packet.payload = (unsigned int)i;
+		packet.key = RenderQueue::makeKey(RenderPass::WORLD, shader->getId(), 0, packet.vao, 0.0f);
+		renderQueue.submit(packet);
+	}
+}
+
+void InstanceRenderer::bindBuffers() const {
+	if (transforms) {
+		transforms->bind();
+	}
+	glActiveTexture(GL_TEXTURE0 + DRAW_INFO_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, drawInfoTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+unsigned int InstanceRenderer::drawIndirect() const {
+	// baseInstance selects each command's instances, so the attributes
+	// start at the front of the frame's instances
+	bindInstanceAttributes(instanceSource, instanceBase);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectSource);
+	GLExtensions::multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)indirectOffset,
+		(GLsizei)indirectCommandCount, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return 1;
+}
+
+unsigned int InstanceRenderer::drawGroup(const Group& group) const {
+	// Without baseInstance, every command points the attributes at its slice
+	size_t indexSize = getIndexSize(group.indexType);
+	for (size_t i = 0; i < group.commandCount; ++i) {
+		const DrawElementsIndirectCommand& command = commands[group.firstCommand + i];
+		bindInstanceAttributes(instanceSource, instanceBase + command.baseInstance);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, group.indexType,
+			(void*)(command.firstIndex * indexSize), (GLsizei)command.instanceCount, command.baseVertex);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return (unsigned int)group.commandCount;
+}
+
+void InstanceRenderer::drawPacket(unsigned int payload) {
+	// The queue has bound the program and the group's VAO
+	bindBuffers();
+	if (payload == INDIRECT_PAYLOAD) {
+		drawCalls += drawIndirect();
+	}
+	else {
+		drawCalls += drawGroup(groups[payload]);
+	}
+}
+
+void InstanceRenderer::redraw() const {
+	if (groups.empty()) {
+		return;
+	}
+	bindBuffers();
+
+	if (indirectGroupCount > 0) {
+		glBindVertexArray(groups[0].vao);
+		drawIndirect();
+	}
+	for (size_t i = indirectGroupCount; i < groups.size(); ++i) {
+		glBindVertexArray(groups[i].vao);
+		drawGroup(groups[i]);
+	}
+	glBindVertexArray(0);
+}
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef INSTANCERENDERER_H
+#define INSTANCERENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "GLExtensions.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TransformBuffer.h"
+
+using namespace std;
+
+// Per-object attributes read by the building, road and pick vertex shaders
+// from the instance buffer (transformSlot at location 3, color at 4, pickId
+// at 5, drawInfo at 6). The matrices themselves stay in the TransformBuffer,
+// which is only written when objects move.
+struct InstanceData {
+	unsigned int transformSlot;  // TransformBuffer slot of the model and normal matrices
+	unsigned int pickId;         // PickBuffer id, 0 for none
+	unsigned int drawInfo;       // Entry in drawInfos: position decode and material
+	glm::vec4 color;             // rgb, a = 1 when selected, 0.25 when hovered
+};
+
+// Draws every object sharing a mesh and level of detail with one instanced
+// call per material, so draw calls grow with the number of distinct models
+// instead of the number of objects. Objects whose mesh is still loading are
+// batched onto the shared ProxyBox the same way.
+//
+// flush() turns the frame's objects into DrawElementsIndirectCommands: one
+// per run of submeshes with the same material, with its own copy of the
+// instances (found through baseInstance) and its own drawInfos entry, read
+// by the shaders as
+//
+//   uniform samplerBuffer drawInfos;
+//   texelFetch(drawInfos, drawInfo * 3 + i)
+//
+// i = 0: position scale (xyz) and shininess (w), 1: position offset (xyz),
+// 2: diffuse color (rgb). When multi-draw-indirect is available, commands of
+// meshes in the MeshPool go out in one glMultiDrawElementsIndirect; the rest
+// (the proxy box, meshes outside the pool, or everything on GL 3.3) are
+// drawn one command at a time from the same data.
+//
+// Usage per frame: begin(), add() for each visible object, then flush(),
+// which uploads the instances and queues packets on the RenderQueue. The
+// commands are drawn when it executes; the transform buffer must be
+// uploaded by then.
+class InstanceRenderer : public PacketDrawer {
+public:
+	// Per-command material and position decode, DRAW_INFO_TEXELS texels
+	struct DrawInfo {
+		glm::vec4 positionScale;   // w = shininess
+		glm::vec4 positionOffset;
+		glm::vec4 diffuse;
+	};
+
+private:
+	struct QueuedInstance {
+		const Mesh* mesh;      // nullptr draws the proxy box
+		unsigned int lod;
+		InstanceData data;
+	};
+
+	// Commands of one mesh and level, drawn from the same VAO
+	struct Group {
+		const Mesh* mesh;
+		unsigned int lod;
+		GLuint vao;
+		GLenum indexType;
+		size_t firstCommand;
+		size_t commandCount;
+	};
+
+	ShaderProgram* shader;
+	const TransformBuffer* transforms;
+
+	vector<QueuedInstance> queue;
+	vector<InstanceData> instances;
+	vector<DrawInfo> drawInfos;
+	vector<DrawElementsIndirectCommand> commands;
+	vector<Group> groups;
+	vector<MeshDrawRange> ranges;   // Scratch
+	// Groups [0, indirectGroupCount) are pooled and drawn by one indirect
+	// call covering commands [0, indirectCommandCount)
+	size_t indirectGroupCount;
+	size_t indirectCommandCount;
+
+	// The frame's instances and indirect commands go to the stream buffer;
+	// the own buffers take them when it is missing or full
+	StreamBuffer* stream;
+	unsigned int instanceVBO;
+	size_t instanceCapacity;
+	GLuint instanceSource;     // Holding the last flush's instances,
+	size_t instanceBase;       // from this instance on
+	GLuint drawInfoBuffer, drawInfoTexture;
+	size_t drawInfoCapacity;
+	GLuint indirectBuffer;
+	size_t indirectCapacity;
+	GLuint indirectSource;     // Holding the last flush's commands,
+	GLintptr indirectOffset;   // from this byte on
+
+	unsigned int drawCalls;
+
+	void bindBuffers() const;
+	unsigned int drawIndirect() const;
+	unsigned int drawGroup(const Group& group) const;
+	void addCommands(const Mesh* mesh, unsigned int lod, size_t firstQueued, size_t lastQueued);
+
+public:
+	static const unsigned int FIRST_INSTANCE_LOCATION = 3;
+	static const unsigned int COLOR_LOCATION = FIRST_INSTANCE_LOCATION + 1;
+	static const unsigned int PICK_ID_LOCATION = FIRST_INSTANCE_LOCATION + 2;
+	static const unsigned int DRAW_INFO_LOCATION = FIRST_INSTANCE_LOCATION + 3;
+
+	static const unsigned int DRAW_INFO_TEXELS = 3;
+	// Texture unit of drawInfos; TransformBuffer::TEXTURE_UNIT is below
+	static const GLint DRAW_INFO_TEXTURE_UNIT = 5;
+	// Payload of the packet drawing the indirect commands
+	static const unsigned int INDIRECT_PAYLOAD = 0xFFFFFFFF;
+
+	InstanceRenderer();
+	~InstanceRenderer();
+
+	InstanceRenderer(const InstanceRenderer&) = delete;
+	InstanceRenderer& operator=(const InstanceRenderer&) = delete;
+
+	// Points the program's drawInfos sampler at DRAW_INFO_TEXTURE_UNIT; the
+	// program must be bound
+	static bool attach(ShaderProgram& program);
+
+	// Shared with GpuCuller, which produces the same records on the GPU.
+	// mesh is null for the proxy box.
+	static DrawInfo makeDrawInfo(const Mesh* mesh, const glm::vec3& diffuse, float shininess);
+	// Points the instance attributes of the bound VAO at buffer, an array of
+	// InstanceData, starting at firstInstance
+	static void bindInstanceAttributes(GLuint buffer, size_t firstInstance);
+
+	// program and transformBuffer must outlive the renderer
+	void init(ShaderProgram& program, const TransformBuffer& transformBuffer);
+	void cleanup();
+
+	// Streams instances and indirect commands from buffer, which must
+	// outlive the renderer; null uploads to the own buffers
+	void setStreamBuffer(StreamBuffer* buffer) { stream = buffer; }
+
+	void begin();
+	void add(const Mesh* mesh, unsigned int lod, unsigned int transformSlot, const glm::vec3& color,
+		bool selected, bool hovered = false, unsigned int pickId = 0);
+	void flush(RenderQueue& queue);
+	void drawPacket(unsigned int payload) override;
+
+	// Draws the last flush's commands again from the same buffers with the
+	// program that is bound, e.g. the PickBuffer's
+	void redraw() const;
+
+	// Statistics of the last flush, complete once its packets have run.
+	// Draw calls count GL calls; an indirect batch is one.
+	unsigned int getDrawCallCount() const { return drawCalls; }
+	unsigned int getGroupCount() const { return (unsigned int)groups.size(); }
+	size_t getCommandCount() const { return commands.size(); }
+	size_t getIndirectCommandCount() const { return indirectCommandCount; }
+	size_t getInstanceCount() const { return queue.size(); }
+};
+
+#endif // !INSTANCERENDERER_H
@@ -0,0 +1,50 @@
+#include "LodSelector.h"
+#include <algorithm>
+#include <cfloat>
+
+float LodSelector::getScreenSize(const Mesh& mesh, const glm::mat4& model, const glm::mat4& view,
+	const glm::mat4& projection, float viewportHeight) {
+	glm::vec3 center = (mesh.getBoundsMin() + mesh.getBoundsMax()) * 0.5f;
+	float radius = glm::length(mesh.getBoundsMax() - mesh.getBoundsMin()) * 0.5f;
+
+	// Largest axis scale of the model matrix
+	float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	radius *= scale;
+
+	glm::vec4 viewCenter = view * model * glm::vec4(center, 1.0f);
+	float depth = -viewCenter.z;
+	if (depth <= radius) {
+		// Camera inside or right next to the sphere
+		return FLT_MAX;
+	}
+
+	// projection[1][1] is cot(fov / 2): view-space size at depth 1 to NDC
+	return 2.0f * radius * projection[1][1] / depth * viewportHeight * 0.5f;
+}
+
+unsigned int LodSelector::select(const Mesh& mesh, float screenSize, unsigned int currentLod) {
+	const vector<MeshLod>& lods = mesh.getLods();
+	if (lods.size() <= 1) {
+		return 0;
+	}
+	currentLod = min(currentLod, (unsigned int)lods.size() - 1);
+
+	// Errors are relative to the bounding box diagonal, i.e. the sphere's diameter
+	auto pixelError = [&](unsigned int lod) { return lods[lod].error * screenSize; };
+
+	if (pixelError(currentLod) > MAX_PIXEL_ERROR * (1.0f + HYSTERESIS)) {
+		// Too coarse: go finer until the error is acceptable again
+		unsigned int lod = currentLod;
+		while (lod > 0 && pixelError(lod) > MAX_PIXEL_ERROR) {
+			--lod;
+		}
+		return lod;
+	}
+
+	// Go coarser only while clearly under the threshold
+	unsigned int lod = currentLod;
+	while (lod + 1 < lods.size() && pixelError(lod + 1) <= MAX_PIXEL_ERROR * (1.0f - HYSTERESIS)) {
+		++lod;
+	}
+	return lod;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef LODSELECTOR_H
+#define LODSELECTOR_H
+
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+using namespace std;
+
+// Picks a mesh's level of detail from how large it appears on screen: the
+// coarsest level whose error, projected to pixels, stays under
+// MAX_PIXEL_ERROR. Switching only happens once the projected error is
+// HYSTERESIS past the threshold, so objects near the boundary don't pop
+// back and forth while the camera moves slightly.
+class LodSelector {
+public:
+	static constexpr float MAX_PIXEL_ERROR = 1.0f;
+	static constexpr float HYSTERESIS = 0.25f;
+
+	// Projected diameter, in pixels, of the mesh's bounding sphere
+	static float getScreenSize(const Mesh& mesh, const glm::mat4& model, const glm::mat4& view,
+		const glm::mat4& projection, float viewportHeight);
+
+	static unsigned int select(const Mesh& mesh, float screenSize, unsigned int currentLod);
+};
+
+#endif // !LODSELECTOR_H
@@ -6,6 +6,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <algorithm>
 #include <vector>
 #include "OBJLoader.h"
 #include "ResidentialBuilding.h"
@@ -16,6 +18,16 @@
 #include "Skybox.h"
 #include <map>
 #include "Base.h"
+#include "OBJBenchmark.h"
+#include "MeshCache.h"
+#include "ProxyBox.h"
+#include "FrameUniforms.h"
+#include "PickBuffer.h"
+#include "HiZBuffer.h"
+#include "RenderQueue.h"
+#include "GLExtensions.h"
+#include "MeshPool.h"
+#include "StreamBuffer.h"
 
 glm::vec3 cameraPos = glm::vec3(0.0f, 2.0f, 5.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -26,6 +38,7 @@ bool firstMouse = true;
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+float lastStatsTime = 0.0f;
 
 bool keys[1024];
 bool mousePressed = false;
@@ -44,8 +57,35 @@ RoadManager roadManager;
 Gizmo gizmo;
 Skybox skybox;
 Base base;
+FrameUniforms frameUniforms;
+PickBuffer pickBuffer;
+HiZBuffer hiZBuffer;
+// Per-frame uniforms, instances, transform updates and gizmo lines
+StreamBuffer streamBuffer;
+// Every draw of the frame goes through here, sorted by state
+RenderQueue renderQueue;
 bool dragging = false;
 
+// Clicks and hover go through the id buffer unless --cpu-picking is given
+bool gpuPicking = true;
+bool indirectDrawing = true;
+bool gpuCulling = false;
+bool checkGpuCulling = false;
+bool occlusionCulling = true;
+bool persistentMapping = true;
+const unsigned int PICK_HOVER = 0;
+const unsigned int PICK_CLICK = 1;
+bool clickPickPending = false;
+double clickPickX, clickPickY;
+// Hover is only re-picked when the cursor or the camera moved
+bool hoverPickDirty = true;
+glm::mat4 lastPickView(0.0f);
+
+// Main-thread time per frame for uploading freshly loaded meshes
+const double MESH_UPLOAD_BUDGET_MS = 2.0;
+// What one frame may stream; uploads that don't fit take the old path
+const size_t STREAM_BYTES_PER_FRAME = 4 << 20;
+
 void processInput(GLFWwindow* window) {
     if (!gizmo.isDragging()) {  
         float cameraSpeed = 2.5f * deltaTime;
@@ -77,6 +117,8 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+    hoverPickDirty = true;
+
     Building* selectedBuilding = objectManager.getSelectedBuilding();
     Road* selectedRoad = roadManager.getSelectedRoad();
 
@@ -136,6 +178,28 @@ std::map<string, bool> objectTable = {
                 {"road", 0}
 };
 
+void applySelection(Building* building, Road* road) {
+    if (building) {
+        objectManager.selectBuilding(building);
+        cubeSelected = true;
+        objectTable["building"] = 1;
+        objectTable["road"] = 0;
+    }
+    else if (road) {
+        roadManager.selectRoad(road);
+        cubeSelected = true;
+        objectTable["building"] = 0;
+        objectTable["road"] = 1;
+    }
+    else {
+        objectManager.clearSelection();
+        roadManager.clearSelection();
+        cubeSelected = false;
+        objectTable["building"] = 0;
+        objectTable["road"] = 0;
+    }
+}
+
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
 
@@ -165,29 +229,25 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
                 (selectedRoad ? selectedRoad->getPosition() : glm::vec3(0.0f));
             GizmoAxis selectedAxis = gizmo.checkAxisSelection(cameraPos, rayDir, gizmoPos);
             
-            if (selectedAxis == GizmoAxis::NONE) {
-                Building* clickedBuilding = objectManager.checkBuildingSelection(cameraPos, rayDir);
-                Road* clickedRoad = roadManager.checkRoadSelection(cameraPos, rayDir);
-                
-                if (clickedBuilding) {
-                    objectManager.selectBuilding(cameraPos, rayDir);
-                    cubeSelected = true;
-                    objectTable["building"] = 1;
-                    objectTable["road"] = 0;
-                }
-                else if (clickedRoad) {
-                    roadManager.selectRoad(cameraPos, rayDir);
-                    cubeSelected = true;
-                    objectTable["building"] = 0;
-                    objectTable["road"] = 1;
-                }
-                else {
-                    objectManager.clearSelection();
-                    roadManager.clearSelection();
-                    cubeSelected = false;
-                    objectTable["building"] = 0;
-                    objectTable["road"] = 0;
+            if (selectedAxis == GizmoAxis::NONE && gpuPicking) {
+                // Resolved in the render loop once the id readback arrives
+                clickPickPending = true;
+                clickPickX = mouseX;
+                clickPickY = mouseY;
+            }
+            else if (selectedAxis == GizmoAxis::NONE) {
+                BuildingHit buildingHit;
+                RoadHit roadHit;
+                bool clickedBuilding = objectManager.raycast(cameraPos, rayDir, buildingHit);
+                bool clickedRoad = roadManager.raycast(cameraPos, rayDir, roadHit);
+
+                // A building standing on a road wins only if it is in front
+                if (clickedBuilding && clickedRoad && roadHit.distance < buildingHit.distance) {
+                    clickedBuilding = false;
                 }
+
+                applySelection(clickedBuilding ? buildingHit.building : nullptr,
+                    clickedRoad ? roadHit.road : nullptr);
             }
             
             if (selectedAxis != GizmoAxis::NONE && objectTable["building"] == 1) {
@@ -210,7 +270,44 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // Headless parser benchmark: CityBuilder --bench-obj <file.obj> [iterations]
+    if (argc >= 3 && string(argv[1]) == "--bench-obj") {
+        return OBJBenchmark::run(argv[2], argc >= 4 ? atoi(argv[3]) : 5);
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        // Half-size vertices for buildings and roads (see VertexLayout::quantized)
+        if (string(argv[i]) == "--compact-vertices") {
+            MeshCache::getInstance().setVertexFormat(VertexFormat::QUANTIZED);
+        }
+        // Synchronous ray casts instead of the id buffer
+        if (string(argv[i]) == "--cpu-picking") {
+            gpuPicking = false;
+        }
+        // GL 3.3 draw path even where multi-draw-indirect is available
+        if (string(argv[i]) == "--no-indirect") {
+            indirectDrawing = false;
+        }
+        // Frustum culling and levels of detail in a compute shader (GL 4.3)
+        if (string(argv[i]) == "--gpu-culling") {
+            gpuCulling = true;
+        }
+        // Draw everything in the frustum, hidden or not
+        if (string(argv[i]) == "--no-occlusion-culling") {
+            occlusionCulling = false;
+        }
+        // Orphaned stream buffer even where buffer storage is available
+        if (string(argv[i]) == "--no-persistent-mapping") {
+            persistentMapping = false;
+        }
+        // Same, compared against the CPU culler once a second
+        if (string(argv[i]) == "--check-gpu-culling") {
+            gpuCulling = true;
+            checkGpuCulling = true;
+        }
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -228,6 +325,15 @@ int main() {
         std::cerr << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    GLExtensions::load((GLADloadproc)glfwGetProcAddress, !indirectDrawing, !persistentMapping);
+
+    // Indirect draws need every mesh in one set of buffers
+    shared_ptr<MeshPool> meshPool;
+    if (GLExtensions::hasMultiDrawIndirect()) {
+        meshPool = make_shared<MeshPool>();
+        meshPool->init();
+        MeshCache::getInstance().setPool(meshPool);
+    }
 
     gizmo.initialize();
 
@@ -242,10 +348,28 @@ int main() {
 
     glm::vec3 lightPos(4.0f, 8.0f, 2.0f);
 
+    if (streamBuffer.init(STREAM_BYTES_PER_FRAME)) {
+        frameUniforms.setStreamBuffer(&streamBuffer);
+        objectManager.setStreamBuffer(&streamBuffer);
+        roadManager.setStreamBuffer(&streamBuffer);
+        gizmo.setStreamBuffer(&streamBuffer);
+    }
+    frameUniforms.init();
     skybox.init();
     base.init();
     objectManager.init();
     roadManager.init();
+    if (gpuPicking && !pickBuffer.init()) {
+        gpuPicking = false;
+    }
+    if (occlusionCulling && hiZBuffer.init()) {
+        objectManager.setOcclusionBuffer(&hiZBuffer);
+        roadManager.setOcclusionBuffer(&hiZBuffer);
+    }
+    if (gpuCulling && !(objectManager.enableGpuCulling() && roadManager.enableGpuCulling())) {
+        std::cerr << "GPU culling needs OpenGL 4.3 and indirect drawing; culling on the CPU" << std::endl;
+        checkGpuCulling = false;
+    }
 
     objectManager.addBuilding(std::make_unique<ResidentialBuilding>(glm::vec3(-2.0f, 0.0f, 0.0f)));
     objectManager.addBuilding(std::make_unique<ResidentialBuilding>(glm::vec3(5.0f, 0.0f, 1.0f)));
@@ -260,6 +384,12 @@ int main() {
 
         processInput(window);
 
+        // Waits only if the GPU is still reading this region three frames on
+        streamBuffer.beginFrame();
+
+        // Finish meshes the loader threads have parsed, without stalling the frame
+        MeshCache::getInstance().processUploads(MESH_UPLOAD_BUDGET_MS);
+
         glClearColor(0.68f, 0.68f, 0.98f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -270,29 +400,116 @@ int main() {
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 8000.0f);
 
-        skybox.render(view, projection);
+        // Camera and lighting for every shader reading the FrameData block
+        frameUniforms.update(view, projection, lightPos, glm::vec3(1.0f), cameraPos);
+
+        // Picks finished since the last frame, so this frame already shows
+        // the new selection and hover
+        PickBuffer::Result pick;
+        while (pickBuffer.poll(pick)) {
+            if (pick.tag == PICK_CLICK) {
+                applySelection(objectManager.getBuildingByPickId(pick.centerId),
+                    roadManager.getRoadByPickId(pick.centerId));
+            }
+            objectManager.setHoveredBuilding(objectManager.getBuildingByPickId(pick.nearestId));
+            roadManager.setHoveredRoad(roadManager.getRoadByPickId(pick.nearestId));
+        }
+
+        // Depth pyramids read back since the last frame, for this frame's
+        // occlusion tests
+        hiZBuffer.poll();
+
+        renderQueue.begin();
 
-		base.render(view, projection);
+		base.submit(renderQueue);
         
-        objectManager.renderObjects(view, projection, lightPos, cameraPos);
+        objectManager.renderObjects(view, projection, renderQueue);
 
-        roadManager.renderObjects(view, projection, lightPos, cameraPos);
+        roadManager.renderObjects(view, projection, renderQueue);
 
+        // Drawn after the world, so pixels it covers are rejected early
+        skybox.submit(renderQueue);
+
+        // Built from the world's depth once it is drawn, before the gizmo
+        hiZBuffer.submit(renderQueue, view, projection, width, height);
 
         Building* selectedBuilding = objectManager.getSelectedBuilding();
         Road* selectedRoad = roadManager.getSelectedRoad();
 
         if (selectedBuilding) {
-            gizmo.render(selectedBuilding, view, projection);
+            gizmo.render(renderQueue, selectedBuilding, view, projection);
         }
         else if (selectedRoad) {
-            gizmo.renderRoad(selectedRoad, view, projection); 
+            gizmo.renderRoad(renderQueue, selectedRoad, view, projection); 
+        }
+
+        renderQueue.execute();
+
+        // Culling, batching and state change counts in the title bar, once a second
+        if (currentFrame - lastStatsTime >= 1.0f) {
+            lastStatsTime = currentFrame;
+            const RenderQueue::Stats& queueStats = renderQueue.getStats();
+            char title[256];
+            snprintf(title, sizeof(title), "CityBuilder - buildings %zu visible / %zu culled (%zu occluded), roads %zu / %zu (%zu), %u draw calls, %u packets, %u binds",
+                objectManager.getVisibleCount(), objectManager.getCulledCount(), objectManager.getOccludedCount(),
+                roadManager.getVisibleCount(), roadManager.getCulledCount(), roadManager.getOccludedCount(),
+                objectManager.getDrawCallCount() + roadManager.getDrawCallCount(),
+                queueStats.packets, queueStats.programBinds + queueStats.textureBinds + queueStats.vaoBinds);
+            glfwSetWindowTitle(window, title);
+
+            if (checkGpuCulling) {
+                objectManager.checkGpuCulling(view, projection);
+                roadManager.checkGpuCulling(view, projection);
+            }
         }
 
+        // Ids under the cursor from this frame's instance data; the result is
+        // picked up by poll() a frame or two later, without a stall
+        if (gpuPicking && !gizmo.isDragging() && (clickPickPending || hoverPickDirty || view != lastPickView)) {
+            int windowWidth, windowHeight;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            double cursorX, cursorY;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            if (clickPickPending) {
+                cursorX = clickPickX;
+                cursorY = clickPickY;
+            }
+
+            int pickX = (int)(cursorX * width / std::max(windowWidth, 1));
+            int pickY = height - 1 - (int)(cursorY * height / std::max(windowHeight, 1));
+            if (pickBuffer.begin(width, height, pickX, pickY)) {
+                pickBuffer.draw(objectManager.getInstanceRenderer());
+                pickBuffer.draw(roadManager.getInstanceRenderer());
+                pickBuffer.draw(objectManager.getGpuCuller());
+                pickBuffer.draw(roadManager.getGpuCuller());
+                pickBuffer.end(clickPickPending ? PICK_CLICK : PICK_HOVER);
+                clickPickPending = false;
+                hoverPickDirty = false;
+                lastPickView = view;
+            }
+        }
+
+        // Everything reading the frame's streamed data is issued
+        streamBuffer.endFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // Models still loading would otherwise be parsed at exit, after the
+    // shared thread pool their parser uses is gone
+    MeshCache::getInstance().shutdown();
+
+    objectManager.cleanup();
+    roadManager.cleanup();
+    pickBuffer.cleanup();
+    hiZBuffer.cleanup();
+    frameUniforms.cleanup();
+    streamBuffer.cleanup();
+    ProxyBox::cleanup();
+    if (meshPool) {
+        meshPool->cleanup();
+    }
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: data(nullptr), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {
+}
+
+bool MappedFile::open(const string& path) {
+	close();
+
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	if (size == 0) {
+		// Zero-length files cannot be mapped, but are valid (empty) input
+		return true;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close() {
+	if (data) {
+		UnmapViewOfFile(data);
+		data = nullptr;
+	}
+
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+
+	size = 0;
+}
+
+bool MappedFile::isOpen() const {
+	return fileHandle != INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: data(nullptr), size(0), fileDescriptor(-1) {
+}
+
+bool MappedFile::open(const string& path) {
+	close();
+
+	fileDescriptor = ::open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+
+	struct stat fileInfo;
+	if (fstat(fileDescriptor, &fileInfo) != 0) {
+		close();
+		return false;
+	}
+
+	size = (size_t)fileInfo.st_size;
+	if (size == 0) {
+		return true;
+	}
+
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (view == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	madvise(view, size, MADV_SEQUENTIAL);
+	data = (const char*)view;
+	return true;
+}
+
+void MappedFile::close() {
+	if (data) {
+		munmap((void*)data, size);
+		data = nullptr;
+	}
+
+	if (fileDescriptor >= 0) {
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+
+	size = 0;
+}
+
+bool MappedFile::isOpen() const {
+	return fileDescriptor >= 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
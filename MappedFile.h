@@ -0,0 +1,38 @@
+#pragma once
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Read-only memory mapping of a whole file. The view stays valid until
+// close() is called or the object is destroyed.
+class MappedFile {
+private:
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const string& path);
+	void close();
+
+	bool isOpen() const;
+	const char* getData() const { return data; }
+	size_t getSize() const { return size; }
+};
+
+#endif // !MAPPEDFILE_H
@@ -0,0 +1,216 @@
+#include "Mesh.h"
+#include "OBJLoader.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <iostream>
+
+Mesh::Mesh(const string& modelPath)
+	: path(modelPath), VAO(0), VBO(0), EBO(0), vertexCount(0), indexCount(0),
+	indexType(GL_UNSIGNED_INT), boundsMin(0.0f), boundsMax(0.0f), positionScale(1.0f),
+	positionOffset(0.0f), poolAllocation(), loaded(false), failed(false) {
+}
+
+Mesh::~Mesh() {
+	cleanup();
+}
+
+bool Mesh::loadData(const string& modelPath, VertexFormat format, MeshData& data) {
+	OBJLoader objModel;
+	objModel.setOptimizeOutput(true);
+	objModel.setLodLevels(MeshSimplifier::DEFAULT_LOD_LEVELS);
+	objModel.setVertexFormat(format);
+	if (!objModel.loadMeshData(modelPath, data)) {
+		cerr << "Failed to load mesh: " << modelPath << endl;
+		return false;
+	}
+
+	if (data.isEmpty()) {
+		cerr << "No vertex data available for mesh: " << modelPath << endl;
+		return false;
+	}
+
+	// Picking structure over the final vertex and index order
+	data.bvh = TriangleBvh::build(data);
+
+	cout << "Mesh data ready: " << modelPath << (data.mapping ? " (from cache)" : "")
+		<< ", " << data.layout.stride << " bytes per vertex" << endl;
+	if (!data.mapping) {
+		objModel.printInfo();
+	}
+	return true;
+}
+
+void Mesh::beginUpload(const MeshData& data, const shared_ptr<MeshPool>& sharedPool) {
+	cleanup();
+
+	if (sharedPool && sharedPool->allocate(data.layout, data.vertexCount, data.indexCount, poolAllocation)) {
+		pool = sharedPool;
+		return;
+	}
+
+	// Generate and bind VAO
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+
+	// Storage only; the contents follow in continueUpload()
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, data.getVertexBytes(), nullptr, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.getIndexBytes(), nullptr, GL_STATIC_DRAW);
+
+	// Attributes as described by the vertex layout
+	for (unsigned int i = 0; i < data.layout.attributeCount; ++i) {
+		const VertexAttribute& attribute = data.layout.attributes[i];
+		glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+			attribute.normalized ? GL_TRUE : GL_FALSE, data.layout.stride, (void*)(size_t)attribute.offset);
+		glEnableVertexAttribArray(attribute.location);
+	}
+
+	// Unbind VAO
+	glBindVertexArray(0);
+}
+
+bool Mesh::continueUpload(const MeshData& data, size_t& uploadedBytes, size_t maxBytes) {
+	size_t vertexBytes = data.getVertexBytes();
+	size_t totalBytes = vertexBytes + data.getIndexBytes();
+	size_t end = min(totalBytes, uploadedBytes + maxBytes);
+
+	if (pool) {
+		if (uploadedBytes < vertexBytes) {
+			size_t chunkEnd = min(end, vertexBytes);
+			pool->uploadVertices(poolAllocation, uploadedBytes, chunkEnd - uploadedBytes, data.vertices + uploadedBytes);
+			uploadedBytes = chunkEnd;
+		}
+		if (uploadedBytes >= vertexBytes && uploadedBytes < end) {
+			// Whole indices only, since the pool widens them
+			size_t indexSize = data.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+			size_t first = (uploadedBytes - vertexBytes) / indexSize;
+			size_t last = min(max(first + 1, (end - vertexBytes) / indexSize), data.indexCount);
+			pool->uploadIndices(poolAllocation, first, last - first, data.indexType,
+				(const unsigned char*)data.indices + first * indexSize);
+			uploadedBytes = vertexBytes + last * indexSize;
+		}
+	}
+	else {
+		glBindVertexArray(VAO);
+
+		// Vertex blob first, then the index blob, straight from the loader's
+		// storage or the mapped cache file
+		if (uploadedBytes < vertexBytes) {
+			size_t chunkEnd = min(end, vertexBytes);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glBufferSubData(GL_ARRAY_BUFFER, uploadedBytes, chunkEnd - uploadedBytes, data.vertices + uploadedBytes);
+			uploadedBytes = chunkEnd;
+		}
+		if (uploadedBytes >= vertexBytes && uploadedBytes < end) {
+			size_t offset = uploadedBytes - vertexBytes;
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, end - uploadedBytes,
+				(const unsigned char*)data.indices + offset);
+			uploadedBytes = end;
+		}
+		glBindVertexArray(0);
+	}
+
+	if (uploadedBytes < totalBytes) {
+		return false;
+	}
+
+	vertexCount = data.vertexCount;
+	indexCount = data.indexCount;
+	indexType = pool ? GL_UNSIGNED_INT : data.indexType;
+	boundsMin = data.boundsMin;
+	boundsMax = data.boundsMax;
+	positionScale = data.getPositionScale();
+	positionOffset = data.getPositionOffset();
+	subMeshes = data.subMeshes;
+	materials = data.materials;
+	lods = data.lods;
+	bvh = data.bvh;
+	if (lods.empty()) {
+		MeshLod all;
+		all.subMeshCount = (unsigned int)subMeshes.size();
+		all.indexCount = (unsigned int)indexCount;
+		lods.push_back(all);
+	}
+	loaded = true;
+
+	cout << "Mesh uploaded: " << path << endl;
+	return true;
+}
+
+void Mesh::setFailed() {
+	cleanup();
+	failed = true;
+}
+
+unsigned int Mesh::clampLod(unsigned int lod) const {
+	return lods.empty() ? 0 : min(lod, (unsigned int)lods.size() - 1);
+}
+
+void Mesh::getDrawRanges(unsigned int lod, vector<MeshDrawRange>& ranges) const {
+	if (!loaded) {
+		return;
+	}
+
+	static const Material defaultMaterial;
+	const MeshLod& level = lods[clampLod(lod)];
+	GLuint first = (GLuint)getFirstIndex();
+	if (level.subMeshCount == 0) {
+		ranges.push_back({ first, level.indexCount, &defaultMaterial });
+	}
+
+	// Submeshes are sorted by material, so runs of one material are
+	// usually a single contiguous range
+	unsigned int i = 0;
+	while (i < level.subMeshCount) {
+		const SubMesh& subMesh = subMeshes[level.firstSubMesh + i];
+		GLuint indexCount = subMesh.indexCount;
+		unsigned int next = i + 1;
+		while (next < level.subMeshCount) {
+			const SubMesh& following = subMeshes[level.firstSubMesh + next];
+			if (following.materialIndex != subMesh.materialIndex || following.indexOffset != subMesh.indexOffset + indexCount) {
+				break;
+			}
+			indexCount += following.indexCount;
+			++next;
+		}
+
+		const Material* material = subMesh.materialIndex < materials.size() ? &materials[subMesh.materialIndex] : &defaultMaterial;
+		ranges.push_back({ first + subMesh.indexOffset, indexCount, material });
+		i = next;
+	}
+}
+
+void Mesh::cleanup() {
+	if (pool) {
+		pool->release(poolAllocation);
+		pool.reset();
+	}
+
+	if (VAO != 0) {
+		glDeleteVertexArrays(1, &VAO);
+		VAO = 0;
+	}
+
+	if (VBO != 0) {
+		glDeleteBuffers(1, &VBO);
+		VBO = 0;
+	}
+
+	if (EBO != 0) {
+		glDeleteBuffers(1, &EBO);
+		EBO = 0;
+	}
+
+	vertexCount = 0;
+	indexCount = 0;
+	subMeshes.clear();
+	materials.clear();
+	lods.clear();
+	bvh.reset();
+	loaded = false;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MeshData.h"
+#include "MeshPool.h"
+#include "TriangleBvh.h"
+
+using namespace std;
+
+// Part of a level of detail drawn with one material: consecutive submeshes
+// of the same material whose index ranges touch, merged
+struct MeshDrawRange {
+	GLuint firstIndex;   // Includes Mesh::getFirstIndex()
+	GLuint indexCount;
+	const Material* material;
+};
+
+// GPU-side geometry for one model file. A Mesh is shared by every object that
+// uses the same model, so it must not hold any per-instance state.
+// Meshes are created empty by MeshCache and become loaded a few frames later.
+class Mesh {
+private:
+	string path;
+	unsigned int VAO, VBO, EBO;
+	size_t vertexCount;
+	size_t indexCount;
+	GLenum indexType;
+	glm::vec3 boundsMin, boundsMax;
+	glm::vec3 positionScale, positionOffset;
+	vector<SubMesh> subMeshes;
+	vector<Material> materials;
+	vector<MeshLod> lods;
+	shared_ptr<const TriangleBvh> bvh;
+	// Set when the geometry lives in a shared MeshPool instead of VBO/EBO
+	shared_ptr<MeshPool> pool;
+	MeshPool::Allocation poolAllocation;
+	bool loaded;
+	bool failed;
+
+	void cleanup();
+	unsigned int clampLod(unsigned int lod) const;
+
+public:
+	Mesh(const string& modelPath);
+	~Mesh();
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	// CPU side of loading: parse (or map the .cbmesh) and optimize. Touches
+	// no GL state, so it runs on the loader threads.
+	static bool loadData(const string& modelPath, VertexFormat format, MeshData& data);
+
+	// GPU side, main thread only. beginUpload allocates the buffers (in pool
+	// when given and the layout fits), then continueUpload copies at most
+	// maxBytes per call and returns true once the mesh is complete and drawable.
+	void beginUpload(const MeshData& data, const shared_ptr<MeshPool>& sharedPool = nullptr);
+	bool continueUpload(const MeshData& data, size_t& uploadedBytes, size_t maxBytes);
+	void setFailed();
+
+	// Not loaded yet: the owner should draw a placeholder
+	bool isLoaded() const { return loaded; }
+	bool isFailed() const { return failed; }
+
+	const string& getPath() const { return path; }
+	// The pool's VAO for pooled meshes. Their indices start at getFirstIndex()
+	// and are relative to getBaseVertex(); both are 0 otherwise.
+	unsigned int getVAO() const { return pool ? pool->getVAO() : VAO; }
+	bool isPooled() const { return (bool)pool; }
+	size_t getFirstIndex() const { return pool ? poolAllocation.firstIndex : 0; }
+	GLint getBaseVertex() const { return pool ? (GLint)poolAllocation.firstVertex : 0; }
+	size_t getVertexCount() const { return vertexCount; }
+	size_t getIndexCount() const { return indexCount; }
+	GLenum getIndexType() const { return indexType; }
+	const glm::vec3& getBoundsMin() const { return boundsMin; }
+	const glm::vec3& getBoundsMax() const { return boundsMax; }
+	// Shaders reconstruct positions as attribute * scale + offset, which is
+	// the identity for float meshes and the AABB mapping for quantized ones
+	const glm::vec3& getPositionScale() const { return positionScale; }
+	const glm::vec3& getPositionOffset() const { return positionOffset; }
+	const vector<SubMesh>& getSubMeshes() const { return subMeshes; }
+	const vector<Material>& getMaterials() const { return materials; }
+	// Level 0 is the source mesh; errors grow with the level
+	const vector<MeshLod>& getLods() const { return lods; }
+	unsigned int getLodCount() const { return (unsigned int)lods.size(); }
+	// Model-space triangles of level 0 for ray picking; null until loaded
+	const TriangleBvh* getBvh() const { return bvh.get(); }
+
+	// The ranges a level is drawn as, e.g. for indirect draw commands;
+	// appended to ranges. Out of range levels are clamped.
+	void getDrawRanges(unsigned int lod, vector<MeshDrawRange>& ranges) const;
+};
+
+// Reference-counted handle to a cached mesh. The GPU buffers are released
+// when the last handle goes away.
+typedef shared_ptr<Mesh> MeshHandle;
+
+#endif // !MESH_H
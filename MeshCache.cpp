@@ -0,0 +1,119 @@
+#include "MeshCache.h"
+#include <chrono>
+#include <iostream>
+
+MeshCache& MeshCache::getInstance() {
+	static MeshCache instance;
+	return instance;
+}
+
+MeshHandle MeshCache::acquire(const string& modelPath) {
+	auto it = meshes.find(modelPath);
+	if (it != meshes.end()) {
+		MeshHandle mesh = it->second.lock();
+		if (mesh) {
+			return mesh;
+		}
+	}
+
+	MeshHandle mesh = make_shared<Mesh>(modelPath);
+	meshes[modelPath] = mesh;
+	releaseUnused();
+
+	if (!loaderPool) {
+		loaderPool = make_unique<ThreadPool>(LOADER_THREADS);
+	}
+
+	++loadingCount;
+	weak_ptr<Mesh> weakMesh = mesh;
+	VertexFormat format = vertexFormat;
+	loaderPool->submit([this, weakMesh, modelPath, format]() {
+		PendingUpload pending;
+		pending.mesh = weakMesh;
+		pending.data = make_shared<MeshData>();
+		pending.succeeded = Mesh::loadData(modelPath, format, *pending.data);
+		pending.started = false;
+		pending.uploadedBytes = 0;
+
+		lock_guard<mutex> lock(readyMutex);
+		ready.push_back(move(pending));
+	});
+
+	return mesh;
+}
+
+void MeshCache::processUploads(double budgetMilliseconds) {
+	{
+		lock_guard<mutex> lock(readyMutex);
+		while (!ready.empty()) {
+			uploads.push_back(move(ready.front()));
+			ready.pop_front();
+		}
+	}
+
+	auto start = chrono::steady_clock::now();
+	bool first = true;
+	while (!uploads.empty()) {
+		double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		if (!first && elapsed >= budgetMilliseconds) {
+			break;
+		}
+		first = false;
+
+		PendingUpload& upload = uploads.front();
+		MeshHandle mesh = upload.mesh.lock();
+		if (!mesh) {
+			// Every user went away while it was loading
+			--loadingCount;
+			uploads.pop_front();
+			continue;
+		}
+
+		if (!upload.succeeded) {
+			mesh->setFailed();
+			--loadingCount;
+			uploads.pop_front();
+			continue;
+		}
+
+		if (!upload.started) {
+			mesh->beginUpload(*upload.data, pool);
+			upload.started = true;
+		}
+
+		if (mesh->continueUpload(*upload.data, upload.uploadedBytes, UPLOAD_CHUNK_BYTES)) {
+			--loadingCount;
+			uploads.pop_front();
+		}
+	}
+}
+
+void MeshCache::releaseUnused() {
+	for (auto it = meshes.begin(); it != meshes.end(); ) {
+		if (it->second.expired()) {
+			it = meshes.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+size_t MeshCache::getLiveMeshCount() const {
+	size_t count = 0;
+	for (const auto& entry : meshes) {
+		if (!entry.second.expired()) {
+			++count;
+		}
+	}
+	return count;
+}
+
+void MeshCache::shutdown() {
+	if (!loaderPool) {
+		return;
+	}
+	loaderPool->discardPending();
+	// Joins the loader threads once the models being parsed are done
+	loaderPool.reset();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Loads each model path once and hands out shared handles to it.
+// The cache only keeps weak references, so a mesh is freed as soon as the
+// last building or road using it is destroyed.
+//
+// Loading is asynchronous: acquire() returns an empty mesh at once and a
+// loader thread parses the model. processUploads() then copies finished
+// meshes to the GPU on the main thread within a per-frame time budget.
+class MeshCache {
+private:
+	// Mesh parsed on a loader thread, waiting for its GPU upload
+	struct PendingUpload {
+		weak_ptr<Mesh> mesh;
+		shared_ptr<MeshData> data;
+		bool succeeded;
+		bool started;
+		size_t uploadedBytes;
+	};
+
+	static constexpr size_t LOADER_THREADS = 2;
+	// Granularity of buffer uploads; small enough to stay inside the budget
+	static const size_t UPLOAD_CHUNK_BYTES = 256 * 1024;
+
+	unordered_map<string, weak_ptr<Mesh>> meshes;
+	VertexFormat vertexFormat;
+	shared_ptr<MeshPool> pool;
+	size_t loadingCount;
+
+	mutex readyMutex;
+	deque<PendingUpload> ready;   // Filled by loader threads
+	deque<PendingUpload> uploads; // Main thread only
+
+	// Declared last so its threads are joined before the queues go away.
+	// Separate from ThreadPool::getShared(), whose workers the OBJ parser
+	// waits on; blocking those from a loader job could deadlock.
+	unique_ptr<ThreadPool> loaderPool;
+
+	MeshCache() : vertexFormat(VertexFormat::FLOAT), loadingCount(0) {}
+
+public:
+	static MeshCache& getInstance();
+
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	// Never blocks; the returned mesh is not loaded until a later processUploads()
+	MeshHandle acquire(const string& modelPath);
+
+	// Format used for meshes loaded from now on; already loaded meshes keep theirs
+	void setVertexFormat(VertexFormat format) { vertexFormat = format; }
+	VertexFormat getVertexFormat() const { return vertexFormat; }
+
+	// Meshes uploaded from now on go into pool when their layout fits it;
+	// null gives every mesh its own buffers
+	void setPool(const shared_ptr<MeshPool>& meshPool) { pool = meshPool; }
+	const shared_ptr<MeshPool>& getPool() const { return pool; }
+
+	// Call once per frame with the GL context current. Uploads finished meshes
+	// until budgetMilliseconds is used up (always at least one chunk).
+	void processUploads(double budgetMilliseconds);
+
+	// Meshes still being parsed or uploaded
+	size_t getPendingCount() const { return loadingCount; }
+
+	void releaseUnused();
+
+	size_t getLiveMeshCount() const;
+
+	// Drops the models not yet parsing and waits for the ones that are.
+	// Call before main returns: the loader threads use the shared
+	// ThreadPool, which is destroyed before this cache.
+	void shutdown();
+};
+
+#endif // !MESHCACHE_H
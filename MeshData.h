@@ -0,0 +1,150 @@
+#pragma once
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+using namespace std;
+
+class TriangleBvh;
+
+const unsigned int MAX_VERTEX_ATTRIBUTES = 8;
+
+// One glVertexAttribPointer call. Plain integers only, because layouts are
+// stored verbatim in .cbmesh files.
+struct VertexAttribute {
+	unsigned int location;
+	unsigned int components;
+	unsigned int type;        // GL_FLOAT, GL_UNSIGNED_SHORT, ...
+	unsigned int normalized;  // GL_TRUE / GL_FALSE
+	unsigned int offset;      // Byte offset inside one vertex
+};
+
+struct VertexLayout {
+	unsigned int stride;
+	unsigned int attributeCount;
+	VertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
+
+	// Interleaved float position (location 0) and normal (location 1)
+	static VertexLayout positionNormal() {
+		VertexLayout layout = {};
+		layout.stride = 6 * sizeof(float);
+		layout.attributeCount = 2;
+		layout.attributes[0] = { 0, 3, GL_FLOAT, GL_FALSE, 0 };
+		layout.attributes[1] = { 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float) };
+		return layout;
+	}
+
+	// Position (0), normal (1) and texture coordinate (2), all floats
+	static VertexLayout positionNormalTexCoord() {
+		VertexLayout layout = positionNormal();
+		layout.stride = 8 * sizeof(float);
+		layout.attributeCount = 3;
+		layout.attributes[2] = { 2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float) };
+		return layout;
+	}
+
+	// Compact layout (12 or 16 bytes): 16-bit unorm position relative to the
+	// mesh AABB, 2_10_10_10 snorm normal and, when present, half-float UVs
+	static VertexLayout quantized(bool hasTexCoords) {
+		VertexLayout layout = {};
+		layout.stride = hasTexCoords ? 16 : 12;
+		layout.attributeCount = hasTexCoords ? 3 : 2;
+		layout.attributes[0] = { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0 };
+		layout.attributes[1] = { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8 };
+		layout.attributes[2] = { 2, 2, GL_HALF_FLOAT, GL_FALSE, 12 };
+		return layout;
+	}
+};
+
+enum class VertexFormat {
+	FLOAT,      // VertexLayout::positionNormalTexCoord()
+	QUANTIZED   // VertexLayout::quantized(); decode with MeshData::getPositionScale/Offset
+};
+
+// Surface parameters read from a .mtl file
+struct Material {
+	string name;
+	glm::vec3 ambient = glm::vec3(0.0f);
+	glm::vec3 diffuse = glm::vec3(1.0f);
+	glm::vec3 specular = glm::vec3(0.5f);
+	float shininess = 32.0f;
+	float opacity = 1.0f;
+	string diffuseMap;
+};
+
+const unsigned int NO_MATERIAL = 0xFFFFFFFF;
+
+// Contiguous range of the index buffer sharing one group and material.
+// Submeshes are sorted by material so consecutive draws rarely change state.
+struct SubMesh {
+	string name;
+	unsigned int materialIndex = NO_MATERIAL;
+	unsigned int indexOffset = 0;
+	unsigned int indexCount = 0;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// One level of detail: a run of submeshes drawn instead of level 0's. All
+// levels share the vertex buffer; only the index ranges differ.
+struct MeshLod {
+	unsigned int firstSubMesh = 0;
+	unsigned int subMeshCount = 0;
+	unsigned int indexCount = 0;   // Sum over the level's submeshes
+	float error = 0.0f;            // Deviation from level 0, relative to the AABB diagonal
+};
+
+// CPU-side geometry ready to be uploaded. The vertex and index pointers either
+// point into the owned storage vectors or straight into a mapped .cbmesh file,
+// in which case the upload reads from the mapping without an extra copy.
+struct MeshData {
+	VertexLayout layout = VertexLayout::positionNormalTexCoord();
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	const unsigned char* vertices = nullptr;
+	size_t vertexCount = 0;
+	const void* indices = nullptr;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+
+	vector<SubMesh> subMeshes;
+	vector<Material> materials;
+	// Empty means a single level made of all submeshes
+	vector<MeshLod> lods;
+	// Level count that was asked for when the data was built
+	unsigned int requestedLodLevels = 1;
+
+	// Triangle and vertex order were rewritten by MeshOptimizer
+	bool optimized = false;
+	VertexFormat vertexFormat = VertexFormat::FLOAT;
+
+	// Level 0 triangles for picking; built by Mesh::loadData
+	shared_ptr<TriangleBvh> bvh;
+
+	vector<unsigned char> vertexStorage;
+	vector<unsigned char> indexStorage;
+	unique_ptr<MappedFile> mapping;
+
+	size_t getVertexBytes() const { return vertexCount * layout.stride; }
+	size_t getIndexBytes() const {
+		return indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+	}
+	bool isEmpty() const { return vertexCount == 0 || indexCount == 0; }
+
+	// Model-space position = attribute * scale + offset
+	glm::vec3 getPositionScale() const {
+		return vertexFormat == VertexFormat::QUANTIZED ? boundsMax - boundsMin : glm::vec3(1.0f);
+	}
+	glm::vec3 getPositionOffset() const {
+		return vertexFormat == VertexFormat::QUANTIZED ? boundsMin : glm::vec3(0.0f);
+	}
+};
+
+#endif // !MESHDATA_H
@@ -0,0 +1,412 @@
+#include "MeshFile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace {
+
+const char MESH_FILE_MAGIC[4] = { 'C', 'B', 'M', 'F' };
+const uint64_t BLOB_ALIGNMENT = 16;
+
+const uint32_t MESH_FLAG_OPTIMIZED = 1;
+const uint32_t MESH_FLAG_QUANTIZED = 2;
+
+struct MeshFileHeader {
+	char magic[4];
+	uint32_t version;
+	MeshSourceStamp source;
+	float boundsMin[3];
+	float boundsMax[3];
+	VertexLayout layout;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint32_t flags;
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+	uint64_t metadataOffset;
+	uint64_t metadataBytes;
+};
+
+static_assert(std::is_trivially_copyable<MeshFileHeader>::value, "MeshFileHeader is written verbatim");
+
+inline uint64_t alignOffset(uint64_t offset) {
+	return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+// Materials and submeshes are serialized as native-endian scalars and
+// length-prefixed strings after the index blob.
+class MetadataWriter {
+public:
+	string bytes;
+
+	template <typename T>
+	void put(const T& value) {
+		bytes.append((const char*)&value, sizeof(T));
+	}
+
+	void putString(const string& value) {
+		put((uint32_t)value.size());
+		bytes.append(value);
+	}
+
+	void putVec3(const glm::vec3& value) {
+		put(value.x);
+		put(value.y);
+		put(value.z);
+	}
+};
+
+class MetadataReader {
+private:
+	const char* cursor;
+	const char* end;
+	bool valid;
+
+public:
+	MetadataReader(const char* data, size_t size) : cursor(data), end(data + size), valid(true) {}
+
+	bool isValid() const { return valid; }
+
+	template <typename T>
+	T get() {
+		T value = {};
+		if ((size_t)(end - cursor) < sizeof(T)) {
+			valid = false;
+			return value;
+		}
+		memcpy(&value, cursor, sizeof(T));
+		cursor += sizeof(T);
+		return value;
+	}
+
+	string getString() {
+		uint32_t length = get<uint32_t>();
+		if (!valid || (size_t)(end - cursor) < length) {
+			valid = false;
+			return string();
+		}
+		string value(cursor, length);
+		cursor += length;
+		return value;
+	}
+
+	glm::vec3 getVec3() {
+		float x = get<float>();
+		float y = get<float>();
+		float z = get<float>();
+		return glm::vec3(x, y, z);
+	}
+};
+
+string writeMetadata(const MeshData& data) {
+	MetadataWriter writer;
+	writer.put((uint32_t)data.materials.size());
+	for (const Material& material : data.materials) {
+		writer.putString(material.name);
+		writer.putVec3(material.ambient);
+		writer.putVec3(material.diffuse);
+		writer.putVec3(material.specular);
+		writer.put(material.shininess);
+		writer.put(material.opacity);
+		writer.putString(material.diffuseMap);
+	}
+	writer.put((uint32_t)data.subMeshes.size());
+	for (const SubMesh& subMesh : data.subMeshes) {
+		writer.putString(subMesh.name);
+		writer.put((uint32_t)subMesh.materialIndex);
+		writer.put((uint32_t)subMesh.indexOffset);
+		writer.put((uint32_t)subMesh.indexCount);
+		writer.putVec3(subMesh.boundsMin);
+		writer.putVec3(subMesh.boundsMax);
+	}
+	writer.put((uint32_t)data.requestedLodLevels);
+	writer.put((uint32_t)data.lods.size());
+	for (const MeshLod& lod : data.lods) {
+		writer.put((uint32_t)lod.firstSubMesh);
+		writer.put((uint32_t)lod.subMeshCount);
+		writer.put((uint32_t)lod.indexCount);
+		writer.put(lod.error);
+	}
+	return writer.bytes;
+}
+
+// Bytes one attribute reads from a vertex; 0 for a type/components pair no
+// layout in MeshData.h produces
+uint64_t getAttributeSize(const VertexAttribute& attribute) {
+	if (attribute.components < 1 || attribute.components > 4) {
+		return 0;
+	}
+	switch (attribute.type) {
+	case GL_FLOAT:
+		return attribute.components * sizeof(float);
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
+		return attribute.components * sizeof(unsigned short);
+	case GL_INT_2_10_10_10_REV:
+		return attribute.components == 4 ? sizeof(uint32_t) : 0;
+	default:
+		return 0;
+	}
+}
+
+// Every attribute inside the stride at a distinct location below the
+// instance renderer's, and a position TriangleBvh can read (three floats or
+// unsigned shorts at location 0)
+bool isValidLayout(const VertexLayout& layout) {
+	const unsigned int MESH_ATTRIBUTE_LOCATIONS = 3;   // InstanceRenderer::FIRST_INSTANCE_LOCATION
+	bool usedLocations[MESH_ATTRIBUTE_LOCATIONS] = {};
+	for (unsigned int i = 0; i < layout.attributeCount; ++i) {
+		const VertexAttribute& attribute = layout.attributes[i];
+		uint64_t size = getAttributeSize(attribute);
+		if (size == 0 || (uint64_t)attribute.offset + size > layout.stride ||
+			attribute.location >= MESH_ATTRIBUTE_LOCATIONS || usedLocations[attribute.location] ||
+			(attribute.normalized != GL_TRUE && attribute.normalized != GL_FALSE)) {
+			return false;
+		}
+		usedLocations[attribute.location] = true;
+
+		if (attribute.location == 0 && (attribute.components != 3 ||
+			(attribute.type != GL_FLOAT && attribute.type != GL_UNSIGNED_SHORT))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename Index>
+bool indicesInRange(const char* indices, size_t indexCount, size_t vertexCount) {
+	for (size_t i = 0; i < indexCount; ++i) {
+		Index index;
+		memcpy(&index, indices + i * sizeof(Index), sizeof(Index));
+		if (index >= vertexCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool readMetadata(const char* bytes, size_t size, size_t indexCount, MeshData& data) {
+	MetadataReader reader(bytes, size);
+
+	uint32_t materialCount = reader.get<uint32_t>();
+	data.materials.clear();
+	for (uint32_t i = 0; i < materialCount && reader.isValid(); ++i) {
+		Material material;
+		material.name = reader.getString();
+		material.ambient = reader.getVec3();
+		material.diffuse = reader.getVec3();
+		material.specular = reader.getVec3();
+		material.shininess = reader.get<float>();
+		material.opacity = reader.get<float>();
+		material.diffuseMap = reader.getString();
+		data.materials.push_back(material);
+	}
+
+	uint32_t subMeshCount = reader.get<uint32_t>();
+	data.subMeshes.clear();
+	for (uint32_t i = 0; i < subMeshCount && reader.isValid(); ++i) {
+		SubMesh subMesh;
+		subMesh.name = reader.getString();
+		subMesh.materialIndex = reader.get<uint32_t>();
+		subMesh.indexOffset = reader.get<uint32_t>();
+		subMesh.indexCount = reader.get<uint32_t>();
+		subMesh.boundsMin = reader.getVec3();
+		subMesh.boundsMax = reader.getVec3();
+
+		if ((subMesh.materialIndex != NO_MATERIAL && subMesh.materialIndex >= materialCount) ||
+			(uint64_t)subMesh.indexOffset + subMesh.indexCount > indexCount) {
+			return false;
+		}
+		data.subMeshes.push_back(subMesh);
+	}
+
+	data.requestedLodLevels = reader.get<uint32_t>();
+	uint32_t lodCount = reader.get<uint32_t>();
+	data.lods.clear();
+	for (uint32_t i = 0; i < lodCount && reader.isValid(); ++i) {
+		MeshLod lod;
+		lod.firstSubMesh = reader.get<uint32_t>();
+		lod.subMeshCount = reader.get<uint32_t>();
+		lod.indexCount = reader.get<uint32_t>();
+		lod.error = reader.get<float>();
+
+		if ((uint64_t)lod.firstSubMesh + lod.subMeshCount > data.subMeshes.size()) {
+			return false;
+		}
+		data.lods.push_back(lod);
+	}
+	return reader.isValid();
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t mix64(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// Word-at-a-time hash; fast enough to run over large .obj files on every launch
+uint64_t hashBytes(const char* data, size_t size) {
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ size;
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t k;
+		memcpy(&k, data + i, 8);
+		k *= 0x87c37b91114253d5ULL;
+		k = rotl64(k, 31);
+		k *= 0x4cf5ad432745937fULL;
+		h ^= k;
+		h = rotl64(h, 27) * 5 + 0x52dce729;
+	}
+
+	// data may be null for an empty file, and memcpy from null is undefined even for 0 bytes
+	uint64_t tail = 0;
+	if (size > i) {
+		memcpy(&tail, data + i, size - i);
+	}
+	h ^= mix64(tail);
+
+	return mix64(h);
+}
+
+}
+
+string MeshFile::getCachePath(const string& sourcePath) {
+	return sourcePath + ".cbmesh";
+}
+
+bool MeshFile::computeSourceStamp(const string& sourcePath, MeshSourceStamp& stamp) {
+	std::error_code error;
+	auto modified = std::filesystem::last_write_time(sourcePath, error);
+	if (error) {
+		return false;
+	}
+
+	MappedFile source;
+	if (!source.open(sourcePath)) {
+		return false;
+	}
+
+	stamp.size = source.getSize();
+	stamp.modifiedTime = (int64_t)modified.time_since_epoch().count();
+	stamp.contentHash = hashBytes(source.getData(), source.getSize());
+	return true;
+}
+
+bool MeshFile::read(const string& cachePath, const MeshSourceStamp& stamp, MeshData& data) {
+	unique_ptr<MappedFile> file = make_unique<MappedFile>();
+	if (!file->open(cachePath) || file->getSize() < sizeof(MeshFileHeader)) {
+		return false;
+	}
+
+	MeshFileHeader header;
+	memcpy(&header, file->getData(), sizeof(header));
+
+	if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC)) != 0 ||
+		header.version != VERSION || !(header.source == stamp)) {
+		return false;
+	}
+
+	// Reject anything that would read outside the mapping
+	uint64_t fileSize = file->getSize();
+	uint64_t indexSize = header.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	if (header.layout.stride == 0 || header.layout.attributeCount > MAX_VERTEX_ATTRIBUTES ||
+		!isValidLayout(header.layout) ||
+		(header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT) ||
+		header.vertexBytes != (uint64_t)header.vertexCount * header.layout.stride ||
+		header.indexBytes != (uint64_t)header.indexCount * indexSize ||
+		header.vertexOffset > fileSize || header.vertexBytes > fileSize - header.vertexOffset ||
+		header.indexOffset > fileSize || header.indexBytes > fileSize - header.indexOffset ||
+		header.metadataOffset > fileSize || header.metadataBytes > fileSize - header.metadataOffset ||
+		!readMetadata(file->getData() + header.metadataOffset, (size_t)header.metadataBytes, header.indexCount, data) ||
+		!(header.indexType == GL_UNSIGNED_SHORT
+			? indicesInRange<unsigned short>(file->getData() + header.indexOffset, header.indexCount, header.vertexCount)
+			: indicesInRange<uint32_t>(file->getData() + header.indexOffset, header.indexCount, header.vertexCount))) {
+		cerr << "Ignoring corrupt mesh cache: " << cachePath << endl;
+		return false;
+	}
+
+	data.layout = header.layout;
+	data.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	data.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	data.vertices = (const unsigned char*)file->getData() + header.vertexOffset;
+	data.vertexCount = header.vertexCount;
+	data.indices = file->getData() + header.indexOffset;
+	data.indexCount = header.indexCount;
+	data.indexType = header.indexType;
+	data.optimized = (header.flags & MESH_FLAG_OPTIMIZED) != 0;
+	data.vertexFormat = (header.flags & MESH_FLAG_QUANTIZED) != 0 ? VertexFormat::QUANTIZED : VertexFormat::FLOAT;
+	data.vertexStorage.clear();
+	data.indexStorage.clear();
+	data.mapping = move(file);
+	return true;
+}
+
+bool MeshFile::write(const string& cachePath, const MeshSourceStamp& stamp, const MeshData& data) {
+	MeshFileHeader header = {};
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC));
+	header.version = VERSION;
+	header.source = stamp;
+	for (int i = 0; i < 3; ++i) {
+		header.boundsMin[i] = data.boundsMin[i];
+		header.boundsMax[i] = data.boundsMax[i];
+	}
+	header.layout = data.layout;
+	header.vertexCount = (uint32_t)data.vertexCount;
+	header.indexCount = (uint32_t)data.indexCount;
+	header.indexType = data.indexType;
+	header.flags = (data.optimized ? MESH_FLAG_OPTIMIZED : 0) |
+		(data.vertexFormat == VertexFormat::QUANTIZED ? MESH_FLAG_QUANTIZED : 0);
+	header.vertexBytes = data.getVertexBytes();
+	header.indexBytes = data.getIndexBytes();
+	header.vertexOffset = alignOffset(sizeof(MeshFileHeader));
+	header.indexOffset = alignOffset(header.vertexOffset + header.vertexBytes);
+
+	string metadata = writeMetadata(data);
+	header.metadataOffset = header.indexOffset + header.indexBytes;
+	header.metadataBytes = metadata.size();
+
+	// Write to a temporary file first so a crash never leaves a torn cache behind
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out.is_open()) {
+			return false;
+		}
+
+		const char padding[BLOB_ALIGNMENT] = {};
+		out.write((const char*)&header, sizeof(header));
+		out.write(padding, header.vertexOffset - sizeof(header));
+		out.write((const char*)data.vertices, header.vertexBytes);
+		out.write(padding, header.indexOffset - (header.vertexOffset + header.vertexBytes));
+		out.write((const char*)data.indices, header.indexBytes);
+		out.write(metadata.data(), metadata.size());
+
+		if (!out.good()) {
+			out.close();
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <cstdint>
+#include <string>
+#include "MeshData.h"
+
+using namespace std;
+
+// Identifies the exact source file a .cbmesh sidecar was generated from.
+struct MeshSourceStamp {
+	uint64_t size;
+	int64_t modifiedTime;
+	uint64_t contentHash;
+
+	bool operator==(const MeshSourceStamp& other) const {
+		return size == other.size && modifiedTime == other.modifiedTime &&
+			contentHash == other.contentHash;
+	}
+};
+
+// Versioned binary mesh cache written next to a model ("<model>.cbmesh").
+// Layout: header (source stamp, AABB, vertex layout, blob offsets) followed by
+// 16-byte aligned vertex and index blobs that can be uploaded straight from a
+// memory mapping, then the material, submesh and LOD tables.
+class MeshFile {
+public:
+	static const uint32_t VERSION = 3;
+
+	static string getCachePath(const string& sourcePath);
+
+	static bool computeSourceStamp(const string& sourcePath, MeshSourceStamp& stamp);
+
+	// Maps the sidecar and points data at its blobs. Fails (and the caller
+	// should rebuild) when the file is missing, corrupt, from another version
+	// or generated from a different source.
+	static bool read(const string& cachePath, const MeshSourceStamp& stamp, MeshData& data);
+
+	static bool write(const string& cachePath, const MeshSourceStamp& stamp, const MeshData& data);
+};
+
+#endif // !MESHFILE_H
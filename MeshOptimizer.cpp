@@ -0,0 +1,402 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// The triangle just drawn; don't favour it too much or we get long strips
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			const float scaler = 1.0f / (MeshOptimizer::OPTIMIZE_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// Finish off vertices with few triangles left so they leave the cache for good
+	score += VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+// FIFO post-transform cache model. Uses timestamps so resetting is O(1).
+class FifoCache {
+private:
+	vector<unsigned int> timestamps;
+	unsigned int cacheSize;
+	unsigned int now;
+
+public:
+	FifoCache(size_t vertexCount, unsigned int size)
+		: timestamps(vertexCount, 0), cacheSize(size), now(size + 1) {}
+
+	void reset() { now += cacheSize + 1; }
+
+	// Number of vertices of the triangle that had to be transformed
+	unsigned int addTriangle(const unsigned int* triangle) {
+		unsigned int misses = 0;
+		for (int i = 0; i < 3; ++i) {
+			unsigned int vertex = triangle[i];
+			if (now - timestamps[vertex] > cacheSize) {
+				timestamps[vertex] = now++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+};
+
+inline glm::vec3 readPosition(const float* vertices, size_t floatsPerVertex, unsigned int vertex) {
+	const float* p = vertices + (size_t)vertex * floatsPerVertex;
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const unsigned int* indices, size_t indexCount,
+	size_t vertexCount, unsigned int cacheSize) {
+	VertexCacheStats stats = { 0.0, 0.0 };
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return stats;
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	vector<bool> referenced(vertexCount, false);
+	size_t transformed = 0;
+	size_t unique = 0;
+
+	for (size_t t = 0; t < triangleCount; ++t) {
+		transformed += cache.addTriangle(indices + t * 3);
+		for (int i = 0; i < 3; ++i) {
+			unsigned int vertex = indices[t * 3 + i];
+			if (!referenced[vertex]) {
+				referenced[vertex] = true;
+				++unique;
+			}
+		}
+	}
+
+	stats.acmr = (double)transformed / triangleCount;
+	stats.atvr = (double)transformed / unique;
+	return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount) {
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+
+	// Vertex -> live triangles adjacency; a vertex's first remaining[v] entries are live
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		++remaining[indices[i]];
+	}
+
+	vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+	}
+
+	vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; ++t) {
+			for (int i = 0; i < 3; ++i) {
+				adjacency[fill[indices[t * 3 + i]]++] = (unsigned int)t;
+			}
+		}
+	}
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> scores(vertexCount, 0.0f);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		scores[v] = vertexScore(-1, remaining[v]);
+	}
+
+	vector<float> triangleScores(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		const unsigned int* triangle = indices + t * 3;
+		triangleScores[t] = scores[triangle[0]] + scores[triangle[1]] + scores[triangle[2]];
+	}
+
+	vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+
+	// Cache holds OPTIMIZE_CACHE_SIZE entries plus room for the new triangle
+	vector<unsigned int> cache, nextCache;
+	cache.reserve(OPTIMIZE_CACHE_SIZE + 3);
+	nextCache.reserve(OPTIMIZE_CACHE_SIZE + 3);
+
+	size_t inputCursor = 0;
+	long long bestTriangle = 0;
+	for (size_t t = 1; t < triangleCount; ++t) {
+		if (triangleScores[t] > triangleScores[bestTriangle]) {
+			bestTriangle = (long long)t;
+		}
+	}
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+		if (bestTriangle < 0) {
+			// Nothing in the cache touches a live triangle; continue in input order
+			while (emitted[inputCursor]) {
+				++inputCursor;
+			}
+			bestTriangle = (long long)inputCursor;
+		}
+
+		const unsigned int* triangle = indices + bestTriangle * 3;
+		emitted[bestTriangle] = true;
+
+		nextCache.clear();
+		for (int i = 0; i < 3; ++i) {
+			unsigned int vertex = triangle[i];
+			output.push_back(vertex);
+			if (find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end()) {
+				nextCache.push_back(vertex);
+			}
+
+			// Drop the triangle from the vertex's live list
+			unsigned int* begin = &adjacency[adjacencyOffset[vertex]];
+			unsigned int* end = begin + remaining[vertex];
+			unsigned int* found = find(begin, end, (unsigned int)bestTriangle);
+			if (found != end) {
+				*found = end[-1];
+				--remaining[vertex];
+			}
+		}
+		for (unsigned int vertex : cache) {
+			if (find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end()) {
+				nextCache.push_back(vertex);
+			}
+		}
+
+		// Rescore everything that was or is in the cache
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			unsigned int vertex = nextCache[i];
+			cachePosition[vertex] = i < OPTIMIZE_CACHE_SIZE ? (int)i : -1;
+			scores[vertex] = vertexScore(cachePosition[vertex], remaining[vertex]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (unsigned int vertex : nextCache) {
+			const unsigned int* begin = &adjacency[adjacencyOffset[vertex]];
+			for (unsigned int j = 0; j < remaining[vertex]; ++j) {
+				unsigned int t = begin[j];
+				const unsigned int* corners = indices + (size_t)t * 3;
+				float score = scores[corners[0]] + scores[corners[1]] + scores[corners[2]];
+				triangleScores[t] = score;
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = (long long)t;
+				}
+			}
+		}
+
+		if (nextCache.size() > OPTIMIZE_CACHE_SIZE) {
+			nextCache.resize(OPTIMIZE_CACHE_SIZE);
+		}
+		cache.swap(nextCache);
+	}
+
+	copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices,
+	size_t floatsPerVertex, size_t vertexCount, float threshold) {
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+
+	// Hard boundaries: points where the cache order starts over (every vertex missed)
+	FifoCache cache(vertexCount, ANALYZE_CACHE_SIZE);
+	vector<size_t> hardClusters;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		if (cache.addTriangle(indices + t * 3) == 3) {
+			hardClusters.push_back(t);
+		}
+	}
+	hardClusters.push_back(triangleCount);
+
+	// Soft boundaries: split a hard cluster wherever the prefix is already
+	// within threshold of the cluster's ACMR, so reordering costs little cache
+	vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hardClusters.size(); ++c) {
+		size_t start = hardClusters[c];
+		size_t end = hardClusters[c + 1];
+
+		cache.reset();
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; ++t) {
+			clusterMisses += cache.addTriangle(indices + t * 3);
+		}
+		double clusterThreshold = threshold * (double)clusterMisses / (end - start);
+
+		cache.reset();
+		size_t subStart = start;
+		size_t misses = 0;
+		clusters.push_back(start);
+		for (size_t t = start; t < end; ++t) {
+			misses += cache.addTriangle(indices + t * 3);
+			if (t + 1 < end && (double)misses / (t + 1 - subStart) <= clusterThreshold) {
+				clusters.push_back(t + 1);
+				subStart = t + 1;
+				misses = 0;
+				cache.reset();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Area-weighted centroids and normals
+	size_t clusterCount = clusters.size() - 1;
+	vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+	vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+	vector<float> clusterArea(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterCount; ++c) {
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			glm::vec3 p0 = readPosition(vertices, floatsPerVertex, indices[t * 3 + 0]);
+			glm::vec3 p1 = readPosition(vertices, floatsPerVertex, indices[t * 3 + 1]);
+			glm::vec3 p2 = readPosition(vertices, floatsPerVertex, indices[t * 3 + 2]);
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+			clusterCentroid[c] += centroid * area;
+			clusterNormal[c] += normal;
+			clusterArea[c] += area;
+		}
+		meshCentroid += clusterCentroid[c];
+		meshArea += clusterArea[c];
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters far out along their own normal are likely occluders: draw them first
+	vector<float> sortKey(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		float normalLength = glm::length(clusterNormal[c]);
+		if (clusterArea[c] > 0.0f && normalLength > 0.0f) {
+			glm::vec3 centroid = clusterCentroid[c] / clusterArea[c];
+			sortKey[c] = glm::dot(centroid - meshCentroid, clusterNormal[c] / normalLength);
+		}
+	}
+
+	vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		order[c] = c;
+	}
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (size_t c : order) {
+		output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	}
+	copy(output.begin(), output.end(), indices);
+}
+
+size_t MeshOptimizer::optimizeVertexFetch(vector<float>& vertexData, size_t floatsPerVertex,
+	vector<unsigned int>& indices) {
+	size_t vertexCount = vertexData.size() / floatsPerVertex;
+	const unsigned int UNUSED = 0xFFFFFFFF;
+
+	vector<unsigned int> remap(vertexCount, UNUSED);
+	vector<float> reordered;
+	reordered.reserve(vertexData.size());
+
+	unsigned int nextVertex = 0;
+	for (unsigned int& index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = nextVertex++;
+			const float* source = vertexData.data() + (size_t)index * floatsPerVertex;
+			reordered.insert(reordered.end(), source, source + floatsPerVertex);
+		}
+		index = remap[index];
+	}
+
+	vertexData.swap(reordered);
+	return nextVertex;
+}
+
+void MeshOptimizer::optimize(vector<float>& vertexData, size_t floatsPerVertex, vector<unsigned int>& indices,
+	const vector<SubMesh>& subMeshes, MeshOptimizerReport* report) {
+	if (indices.empty() || floatsPerVertex == 0) {
+		return;
+	}
+
+	// Without submeshes the whole buffer is one range
+	vector<SubMesh> ranges = subMeshes;
+	if (ranges.empty()) {
+		SubMesh all;
+		all.indexCount = (unsigned int)indices.size();
+		ranges.push_back(all);
+	}
+
+	auto runStage = [&](const char* name, auto stage) {
+		size_t vertexCount = vertexData.size() / floatsPerVertex;
+		MeshOptimizerStage result;
+		result.name = name;
+		result.before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+		stage();
+		vertexCount = vertexData.size() / floatsPerVertex;
+		result.after = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+		if (report) {
+			report->push_back(result);
+		}
+	};
+
+	runStage("vertex cache", [&]() {
+		size_t vertexCount = vertexData.size() / floatsPerVertex;
+		for (const SubMesh& range : ranges) {
+			optimizeVertexCache(indices.data() + range.indexOffset, range.indexCount, vertexCount);
+		}
+	});
+
+	runStage("overdraw", [&]() {
+		size_t vertexCount = vertexData.size() / floatsPerVertex;
+		for (const SubMesh& range : ranges) {
+			optimizeOverdraw(indices.data() + range.indexOffset, range.indexCount,
+				vertexData.data(), floatsPerVertex, vertexCount);
+		}
+	});
+
+	runStage("vertex fetch", [&]() {
+		optimizeVertexFetch(vertexData, floatsPerVertex, indices);
+	});
+}
+
+void MeshOptimizer::printReport(const MeshOptimizerReport& report) {
+	cout << fixed << setprecision(3);
+	for (const MeshOptimizerStage& stage : report) {
+		cout << "  " << left << setw(14) << stage.name << right
+			<< "ACMR " << stage.before.acmr << " -> " << stage.after.acmr
+			<< ", ATVR " << stage.before.atvr << " -> " << stage.after.atvr << endl;
+	}
+	cout.unsetf(ios::floatfield);
+	cout << setprecision(6);
+}
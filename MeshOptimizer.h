@@ -0,0 +1,64 @@
+#pragma once
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MeshData.h"
+
+using namespace std;
+
+// Post-transform cache efficiency of an index buffer.
+// ACMR: transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst).
+// ATVR: transformed vertices per referenced vertex (1.0 is ideal).
+struct VertexCacheStats {
+	double acmr;
+	double atvr;
+};
+
+struct MeshOptimizerStage {
+	string name;
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+typedef vector<MeshOptimizerStage> MeshOptimizerReport;
+
+// Triangle and vertex reordering for indexed meshes. Every pass works inside
+// the submesh ranges, so draw ranges and their materials are preserved.
+class MeshOptimizer {
+public:
+	// Size of the FIFO the statistics are measured with
+	static const unsigned int ANALYZE_CACHE_SIZE = 16;
+	// Size of the LRU cache the triangle order is optimized for
+	static const unsigned int OPTIMIZE_CACHE_SIZE = 32;
+	// Overdraw pass may raise ACMR by at most this factor
+	static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+	static VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount,
+		size_t vertexCount, unsigned int cacheSize = ANALYZE_CACHE_SIZE);
+
+	// Forsyth's linear-speed vertex cache optimization
+	static void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+	// Splits the (cache-optimized) triangle order into clusters and sorts them
+	// so outward-facing clusters on the outside of the mesh draw first.
+	// Positions are read from vertices with the given stride in floats.
+	static void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices,
+		size_t floatsPerVertex, size_t vertexCount, float threshold = OVERDRAW_THRESHOLD);
+
+	// Renumbers vertices in first-use order and drops unreferenced ones.
+	// Returns the new vertex count.
+	static size_t optimizeVertexFetch(vector<float>& vertexData, size_t floatsPerVertex,
+		vector<unsigned int>& indices);
+
+	// Runs all three stages over every submesh and records before/after
+	// statistics for each stage in report (when given).
+	static void optimize(vector<float>& vertexData, size_t floatsPerVertex, vector<unsigned int>& indices,
+		const vector<SubMesh>& subMeshes, MeshOptimizerReport* report);
+
+	static void printReport(const MeshOptimizerReport& report);
+};
+
+#endif // !MESHOPTIMIZER_H
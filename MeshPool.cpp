@@ -0,0 +1,202 @@
+#include "MeshPool.h"
+#include <algorithm>
+
+MeshPool::MeshPool()
+	: VAO(0), VBO(0), EBO(0), layout(), hasLayout(false), vertexCapacity(0), indexCapacity(0),
+	usedVertices(0), usedIndices(0) {}
+
+MeshPool::~MeshPool() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+void MeshPool::init() {
+	if (VAO != 0) {
+		return;
+	}
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+}
+
+void MeshPool::cleanup() {
+	if (VAO != 0) {
+		glDeleteVertexArrays(1, &VAO);
+		VAO = 0;
+	}
+	if (VBO != 0) {
+		glDeleteBuffers(1, &VBO);
+		VBO = 0;
+	}
+	if (EBO != 0) {
+		glDeleteBuffers(1, &EBO);
+		EBO = 0;
+	}
+	// Meshes still holding allocations only return them to the free lists
+	vertexCapacity = 0;
+	indexCapacity = 0;
+	freeVertices.clear();
+	freeIndices.clear();
+}
+
+bool MeshPool::accepts(const VertexLayout& meshLayout) const {
+	if (VAO == 0) {
+		return false;
+	}
+	if (!hasLayout) {
+		return true;
+	}
+	if (meshLayout.stride != layout.stride || meshLayout.attributeCount != layout.attributeCount) {
+		return false;
+	}
+	for (unsigned int i = 0; i < layout.attributeCount; ++i) {
+		const VertexAttribute& a = meshLayout.attributes[i];
+		const VertexAttribute& b = layout.attributes[i];
+		if (a.location != b.location || a.components != b.components || a.type != b.type
+			|| a.normalized != b.normalized || a.offset != b.offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MeshPool::allocateRange(vector<Range>& freeRanges, size_t count, size_t& first) {
+	// First fit keeps the buffers compact from the front
+	for (size_t i = 0; i < freeRanges.size(); ++i) {
+		if (freeRanges[i].count >= count) {
+			first = freeRanges[i].first;
+			freeRanges[i].first += count;
+			freeRanges[i].count -= count;
+			if (freeRanges[i].count == 0) {
+				freeRanges.erase(freeRanges.begin() + i);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void MeshPool::releaseRange(vector<Range>& freeRanges, size_t first, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	auto it = lower_bound(freeRanges.begin(), freeRanges.end(), first,
+		[](const Range& range, size_t value) { return range.first < value; });
+	it = freeRanges.insert(it, { first, count });
+
+	// Merge with the following and the preceding span
+	auto next = it + 1;
+	if (next != freeRanges.end() && it->first + it->count == next->first) {
+		it->count += next->count;
+		freeRanges.erase(next);
+	}
+	if (it != freeRanges.begin()) {
+		auto previous = it - 1;
+		if (previous->first + previous->count == it->first) {
+			previous->count += it->count;
+			freeRanges.erase(it);
+		}
+	}
+}
+
+void MeshPool::growBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes) {
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+	if (oldBytes > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+}
+
+void MeshPool::setupVertexArray() {
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	for (unsigned int i = 0; i < layout.attributeCount; ++i) {
+		const VertexAttribute& attribute = layout.attributes[i];
+		glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+			attribute.normalized ? GL_TRUE : GL_FALSE, layout.stride, (void*)(size_t)attribute.offset);
+		glEnableVertexAttribArray(attribute.location);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool MeshPool::allocate(const VertexLayout& meshLayout, size_t vertexCount, size_t indexCount, Allocation& allocation) {
+	if (!accepts(meshLayout)) {
+		return false;
+	}
+	if (!hasLayout) {
+		layout = meshLayout;
+		hasLayout = true;
+	}
+
+	bool rebind = false;
+	size_t firstVertex;
+	if (!allocateRange(freeVertices, vertexCount, firstVertex)) {
+		size_t capacity = max(max(vertexCapacity * 2, vertexCapacity + vertexCount), INITIAL_VERTICES);
+		growBuffer(VBO, vertexCapacity * layout.stride, capacity * layout.stride);
+		releaseRange(freeVertices, vertexCapacity, capacity - vertexCapacity);
+		vertexCapacity = capacity;
+		allocateRange(freeVertices, vertexCount, firstVertex);
+		rebind = true;
+	}
+
+	size_t firstIndex;
+	if (!allocateRange(freeIndices, indexCount, firstIndex)) {
+		size_t capacity = max(max(indexCapacity * 2, indexCapacity + indexCount), INITIAL_INDICES);
+		growBuffer(EBO, indexCapacity * sizeof(GLuint), capacity * sizeof(GLuint));
+		releaseRange(freeIndices, indexCapacity, capacity - indexCapacity);
+		indexCapacity = capacity;
+		allocateRange(freeIndices, indexCount, firstIndex);
+		rebind = true;
+	}
+
+	// Grown buffers are new GL objects
+	if (rebind) {
+		setupVertexArray();
+	}
+
+	allocation.firstVertex = firstVertex;
+	allocation.vertexCount = vertexCount;
+	allocation.firstIndex = firstIndex;
+	allocation.indexCount = indexCount;
+	usedVertices += vertexCount;
+	usedIndices += indexCount;
+	return true;
+}
+
+void MeshPool::release(const Allocation& allocation) {
+	usedVertices -= allocation.vertexCount;
+	usedIndices -= allocation.indexCount;
+	if (VAO == 0) {
+		return; // Cleaned up; nothing left to reuse
+	}
+	releaseRange(freeVertices, allocation.firstVertex, allocation.vertexCount);
+	releaseRange(freeIndices, allocation.firstIndex, allocation.indexCount);
+}
+
+void MeshPool::uploadVertices(const Allocation& allocation, size_t byteOffset, size_t bytes, const void* vertices) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * layout.stride + byteOffset, bytes, vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MeshPool::uploadIndices(const Allocation& allocation, size_t indexOffset, size_t count, GLenum type, const void* indices) {
+	const void* source = indices;
+	if (type == GL_UNSIGNED_SHORT) {
+		const unsigned short* narrow = (const unsigned short*)indices;
+		indexScratch.assign(narrow, narrow + count);
+		source = indexScratch.data();
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (allocation.firstIndex + indexOffset) * sizeof(GLuint),
+		count * sizeof(GLuint), source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include <glad/glad.h>
+#include <vector>
+#include "MeshData.h"
+
+using namespace std;
+
+// Shared vertex and index buffer that meshes of one vertex layout are
+// suballocated from, so every pooled mesh draws from the same VAO. That is
+// what lets InstanceRenderer send all of them in one multi-draw-indirect
+// call: a command only differs in firstIndex, baseVertex and baseInstance.
+//
+// Indices are always stored as GL_UNSIGNED_INT and stay relative to the
+// mesh's first vertex (drawn with baseVertex). The buffers grow by copying
+// on the GPU; allocations keep their offsets, so meshes never notice.
+//
+// Created by Main when indirect drawing is available and handed to
+// MeshCache. Meshes hold a shared_ptr to it, so it outlives them; the GL
+// objects are released in cleanup(), while the context is alive.
+class MeshPool {
+public:
+	struct Allocation {
+		size_t firstVertex;
+		size_t vertexCount;
+		size_t firstIndex;
+		size_t indexCount;
+	};
+
+private:
+	// Free span of vertices or indices
+	struct Range {
+		size_t first;
+		size_t count;
+	};
+
+	GLuint VAO, VBO, EBO;
+	VertexLayout layout;
+	bool hasLayout;
+	size_t vertexCapacity, indexCapacity;
+	vector<Range> freeVertices, freeIndices;   // Sorted by first, never adjacent
+	vector<GLuint> indexScratch;
+	size_t usedVertices, usedIndices;
+
+	static bool allocateRange(vector<Range>& freeRanges, size_t count, size_t& first);
+	static void releaseRange(vector<Range>& freeRanges, size_t first, size_t count);
+	static void growBuffer(GLuint& buffer, size_t oldBytes, size_t newBytes);
+	void setupVertexArray();
+
+public:
+	static constexpr size_t INITIAL_VERTICES = 64 * 1024;
+	static constexpr size_t INITIAL_INDICES = 3 * 64 * 1024;
+
+	MeshPool();
+	~MeshPool();
+
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+
+	void init();
+	void cleanup();
+
+	// The first mesh decides the layout; others must match it
+	bool accepts(const VertexLayout& meshLayout) const;
+	bool allocate(const VertexLayout& meshLayout, size_t vertexCount, size_t indexCount, Allocation& allocation);
+	void release(const Allocation& allocation);
+
+	// Copy part of a mesh into its allocation. Offsets are relative to the
+	// allocation; 16-bit indices are widened.
+	void uploadVertices(const Allocation& allocation, size_t byteOffset, size_t bytes, const void* vertices);
+	void uploadIndices(const Allocation& allocation, size_t indexOffset, size_t count, GLenum type, const void* indices);
+
+	// Has the pooled meshes' vertex attributes and index buffer; instance
+	// attributes are added by whoever draws
+	GLuint getVAO() const { return VAO; }
+	bool isValid() const { return VAO != 0; }
+
+	size_t getUsedVertexCount() const { return usedVertices; }
+	size_t getUsedIndexCount() const { return usedIndices; }
+	size_t getVertexCapacity() const { return vertexCapacity; }
+	size_t getIndexCapacity() const { return indexCapacity; }
+};
+
+#endif // !MESHPOOL_H
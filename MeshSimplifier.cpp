@@ -0,0 +1,475 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Triangle ratio and error budget for levels 1, 2, 3, ... relative to the
+// previous level; later levels reuse the last entry
+const float LOD_TRIANGLE_RATIO = 0.5f;
+const float LOD_TARGET_ERRORS[] = { 0.01f, 0.02f, 0.04f, 0.08f };
+const size_t LOD_TARGET_ERROR_COUNT = sizeof(LOD_TARGET_ERRORS) / sizeof(LOD_TARGET_ERRORS[0]);
+// A level must drop at least this share of the previous level's triangles
+const float LOD_MIN_REDUCTION = 0.2f;
+// Submeshes this small are copied unchanged into every level
+const size_t LOD_MIN_TRIANGLES = 16;
+
+// Border edges get a constraint plane this much heavier than a face plane
+const double BORDER_WEIGHT = 10.0;
+
+const unsigned int MAX_PASSES = 32;
+
+// cos(60 degrees): the most a triangle's normal may turn in one collapse
+const double MAX_NORMAL_TURN_COS = 0.5;
+
+enum VertexKind {
+	KIND_MANIFOLD,
+	KIND_BORDER,
+	KIND_LOCKED
+};
+
+// Symmetric 4x4 quadric stored as its 10 unique coefficients plus the
+// accumulated weight, so errors can be normalized back to distances
+struct Quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	void clear() { memset(this, 0, sizeof(*this)); }
+
+	void addPlane(const glm::dvec3& n, double d, double w) {
+		a00 += w * n.x * n.x;
+		a11 += w * n.y * n.y;
+		a22 += w * n.z * n.z;
+		a01 += w * n.x * n.y;
+		a02 += w * n.x * n.z;
+		a12 += w * n.y * n.z;
+		b0 += w * n.x * d;
+		b1 += w * n.y * d;
+		b2 += w * n.z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& other) {
+		a00 += other.a00; a11 += other.a11; a22 += other.a22;
+		a01 += other.a01; a02 += other.a02; a12 += other.a12;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	// Weighted sum of squared plane distances
+	double evaluate(const glm::dvec3& p) const {
+		double rx = a00 * p.x + a01 * p.y + a02 * p.z;
+		double ry = a01 * p.x + a11 * p.y + a12 * p.z;
+		double rz = a02 * p.x + a12 * p.y + a22 * p.z;
+		double r = p.x * rx + p.y * ry + p.z * rz;
+		r += 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z);
+		r += c;
+		return r < 0.0 ? 0.0 : r;
+	}
+};
+
+struct Collapse {
+	unsigned int from;
+	unsigned int to;
+	double error;
+};
+
+inline uint64_t edgeKey(unsigned int a, unsigned int b) {
+	if (a > b) {
+		swap(a, b);
+	}
+	return ((uint64_t)a << 32) | b;
+}
+
+struct PositionKey {
+	float x, y, z;
+	bool operator==(const PositionKey& other) const {
+		return memcmp(this, &other, sizeof(PositionKey)) == 0;
+	}
+};
+
+struct PositionKeyHash {
+	size_t operator()(const PositionKey& key) const {
+		uint32_t bits[3];
+		memcpy(bits, &key, sizeof(bits));
+		size_t h = bits[0] * 73856093u;
+		h ^= bits[1] * 19349663u;
+		h ^= bits[2] * 83492791u;
+		return h;
+	}
+};
+
+}
+
+float MeshSimplifier::simplify(const float* vertices, size_t floatsPerVertex, size_t vertexCount,
+	const unsigned int* indices, size_t indexCount, size_t targetIndexCount, float targetError,
+	float extent, vector<unsigned int>& output) {
+	output.assign(indices, indices + indexCount);
+	if (indexCount <= targetIndexCount || vertexCount == 0) {
+		return 0.0f;
+	}
+
+	double scale = extent > 0.0f ? 1.0 / extent : 1.0;
+	auto positionOf = [&](unsigned int vertex) {
+		const float* p = vertices + (size_t)vertex * floatsPerVertex;
+		return glm::dvec3(p[0], p[1], p[2]) * scale;
+	};
+	auto normalOf = [&](unsigned int vertex) {
+		const float* p = vertices + (size_t)vertex * floatsPerVertex;
+		return glm::vec3(p[3], p[4], p[5]);
+	};
+
+	// Weld attribute vertices by position; simplification runs on the welded
+	// "positions", corners keep pointing at attribute vertices (wedges)
+	const unsigned int UNUSED = 0xFFFFFFFF;
+	vector<unsigned int> weld(vertexCount, UNUSED);
+	vector<glm::dvec3> positions;
+	{
+		unordered_map<PositionKey, unsigned int, PositionKeyHash> unique;
+		for (size_t i = 0; i < indexCount; ++i) {
+			unsigned int vertex = indices[i];
+			if (weld[vertex] != UNUSED) {
+				continue;
+			}
+			const float* p = vertices + (size_t)vertex * floatsPerVertex;
+			PositionKey key = { p[0], p[1], p[2] };
+			auto inserted = unique.emplace(key, (unsigned int)positions.size());
+			if (inserted.second) {
+				positions.push_back(positionOf(vertex));
+			}
+			weld[vertex] = inserted.first->second;
+		}
+	}
+	size_t positionCount = positions.size();
+
+	// Wedges per welded position
+	vector<unsigned int> wedgeOffset(positionCount + 1, 0);
+	vector<unsigned int> wedges;
+	{
+		vector<unsigned int> wedgeCount(positionCount, 0);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			if (weld[v] != UNUSED) {
+				++wedgeCount[weld[v]];
+			}
+		}
+		for (size_t p = 0; p < positionCount; ++p) {
+			wedgeOffset[p + 1] = wedgeOffset[p] + wedgeCount[p];
+		}
+		wedges.resize(wedgeOffset[positionCount]);
+		vector<unsigned int> cursor(wedgeOffset.begin(), wedgeOffset.end() - 1);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			if (weld[v] != UNUSED) {
+				wedges[cursor[weld[v]]++] = (unsigned int)v;
+			}
+		}
+	}
+
+	// Edge use counts decide borders (1 triangle) and locked vertices (>2)
+	vector<unsigned char> kind(positionCount, KIND_MANIFOLD);
+	unordered_map<uint64_t, unsigned int> edgeUse;
+	auto classify = [&](const vector<unsigned int>& triangles) {
+		edgeUse.clear();
+		edgeUse.reserve(triangles.size());
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			for (int e = 0; e < 3; ++e) {
+				unsigned int a = weld[triangles[t + e]];
+				unsigned int b = weld[triangles[t + (e + 1) % 3]];
+				if (a != b) {
+					++edgeUse[edgeKey(a, b)];
+				}
+			}
+		}
+		fill(kind.begin(), kind.end(), (unsigned char)KIND_MANIFOLD);
+		for (const auto& edge : edgeUse) {
+			unsigned int a = (unsigned int)(edge.first >> 32);
+			unsigned int b = (unsigned int)(edge.first & 0xFFFFFFFF);
+			unsigned char edgeKind = edge.second == 1 ? KIND_BORDER : (edge.second > 2 ? KIND_LOCKED : KIND_MANIFOLD);
+			kind[a] = max(kind[a], edgeKind);
+			kind[b] = max(kind[b], edgeKind);
+		}
+	};
+	classify(output);
+
+	// Plane quadrics, area weighted, plus constraint planes along the borders
+	vector<Quadric> quadrics(positionCount);
+	for (Quadric& quadric : quadrics) {
+		quadric.clear();
+	}
+	for (size_t t = 0; t < indexCount; t += 3) {
+		unsigned int corner[3] = { weld[indices[t]], weld[indices[t + 1]], weld[indices[t + 2]] };
+		glm::dvec3 p0 = positions[corner[0]], p1 = positions[corner[1]], p2 = positions[corner[2]];
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		if (length <= 0.0) {
+			continue;
+		}
+		normal /= length;
+		double area = length * 0.5;
+
+		for (int i = 0; i < 3; ++i) {
+			quadrics[corner[i]].addPlane(normal, -glm::dot(normal, p0), area);
+		}
+
+		for (int e = 0; e < 3; ++e) {
+			unsigned int a = corner[e], b = corner[(e + 1) % 3];
+			if (a == b || edgeUse[edgeKey(a, b)] != 1) {
+				continue;
+			}
+			glm::dvec3 edge = positions[b] - positions[a];
+			double edgeLength = glm::length(edge);
+			if (edgeLength <= 0.0) {
+				continue;
+			}
+			glm::dvec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+			double w = BORDER_WEIGHT * edgeLength * edgeLength;
+			quadrics[a].addPlane(borderNormal, -glm::dot(borderNormal, positions[a]), w);
+			quadrics[b].addPlane(borderNormal, -glm::dot(borderNormal, positions[a]), w);
+		}
+	}
+
+	auto collapseError = [&](unsigned int from, unsigned int to) {
+		Quadric merged = quadrics[from];
+		merged.add(quadrics[to]);
+		return merged.weight > 0.0 ? merged.evaluate(positions[to]) / merged.weight : 0.0;
+	};
+
+	double errorLimit = (double)targetError * targetError;
+	double maxError = 0.0;
+	vector<unsigned int> remap(positionCount);
+	vector<bool> touched(positionCount);
+	vector<unsigned int> adjacencyOffset(positionCount + 1);
+	vector<unsigned int> adjacency;
+	vector<Collapse> collapses;
+	vector<unsigned int> next;
+
+	for (unsigned int pass = 0; pass < MAX_PASSES && output.size() > targetIndexCount; ++pass) {
+		if (pass > 0) {
+			classify(output);
+		}
+		size_t triangleCount = output.size() / 3;
+
+		// Welded position -> triangles
+		fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (unsigned int index : output) {
+			++adjacencyOffset[weld[index] + 1];
+		}
+		for (size_t p = 0; p < positionCount; ++p) {
+			adjacencyOffset[p + 1] += adjacencyOffset[p];
+		}
+		adjacency.resize(output.size());
+		{
+			vector<unsigned int> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (size_t i = 0; i < output.size(); ++i) {
+				adjacency[cursor[weld[output[i]]]++] = (unsigned int)(i / 3);
+			}
+		}
+
+		// Cheapest allowed direction for every edge
+		collapses.clear();
+		for (const auto& edge : edgeUse) {
+			unsigned int a = (unsigned int)(edge.first >> 32);
+			unsigned int b = (unsigned int)(edge.first & 0xFFFFFFFF);
+			bool borderEdge = edge.second == 1;
+			auto allowed = [&](unsigned int from) {
+				return kind[from] == KIND_MANIFOLD || (kind[from] == KIND_BORDER && borderEdge);
+			};
+
+			Collapse best = { 0, 0, -1.0 };
+			if (allowed(a)) {
+				best = { a, b, collapseError(a, b) };
+			}
+			if (allowed(b)) {
+				double error = collapseError(b, a);
+				if (best.error < 0.0 || error < best.error) {
+					best = { b, a, error };
+				}
+			}
+			if (best.error >= 0.0 && best.error <= errorLimit) {
+				collapses.push_back(best);
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+		// Ties broken by id so the result does not depend on hash order
+		sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+			if (x.error != y.error) {
+				return x.error < y.error;
+			}
+			return x.from != y.from ? x.from < y.from : x.to < y.to;
+		});
+
+		for (size_t p = 0; p < positionCount; ++p) {
+			remap[p] = (unsigned int)p;
+		}
+		fill(touched.begin(), touched.end(), false);
+
+		size_t trianglesToRemove = triangleCount - targetIndexCount / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+
+		for (const Collapse& collapse : collapses) {
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			// Reject collapses that flip or sharply turn a remaining triangle;
+			// turns add up over passes, so a plain sign test is not enough
+			bool flips = false;
+			for (unsigned int j = adjacencyOffset[collapse.from]; j < adjacencyOffset[collapse.from + 1] && !flips; ++j) {
+				const unsigned int* triangle = &output[(size_t)adjacency[j] * 3];
+				unsigned int corner[3] = { weld[triangle[0]], weld[triangle[1]], weld[triangle[2]] };
+				if (corner[0] == collapse.to || corner[1] == collapse.to || corner[2] == collapse.to) {
+					continue;
+				}
+				glm::dvec3 before[3], after[3];
+				for (int i = 0; i < 3; ++i) {
+					before[i] = positions[corner[i]];
+					after[i] = corner[i] == collapse.from ? positions[collapse.to] : before[i];
+				}
+				glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(n0, n1) <= MAX_NORMAL_TURN_COS * glm::length(n0) * glm::length(n1);
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+
+			// The flip test above assumed the one-ring stays put for this pass
+			for (unsigned int j = adjacencyOffset[collapse.from]; j < adjacencyOffset[collapse.from + 1]; ++j) {
+				const unsigned int* triangle = &output[(size_t)adjacency[j] * 3];
+				for (int i = 0; i < 3; ++i) {
+					touched[weld[triangle[i]]] = true;
+				}
+			}
+			maxError = max(maxError, collapse.error);
+			++applied;
+
+			removed += kind[collapse.from] == KIND_BORDER ? 1 : 2;
+			if (removed >= trianglesToRemove) {
+				break;
+			}
+		}
+		if (applied == 0) {
+			break;
+		}
+
+		// Move collapsed corners to the wedge at the target whose normal is closest
+		next.clear();
+		next.reserve(output.size());
+		for (size_t t = 0; t < output.size(); t += 3) {
+			unsigned int triangle[3];
+			for (int i = 0; i < 3; ++i) {
+				unsigned int vertex = output[t + i];
+				unsigned int target = remap[weld[vertex]];
+				if (target != weld[vertex]) {
+					glm::vec3 normal = normalOf(vertex);
+					unsigned int best = wedges[wedgeOffset[target]];
+					float bestDot = -2.0f;
+					for (unsigned int w = wedgeOffset[target]; w < wedgeOffset[target + 1]; ++w) {
+						float d = glm::dot(normal, normalOf(wedges[w]));
+						if (d > bestDot) {
+							bestDot = d;
+							best = wedges[w];
+						}
+					}
+					vertex = best;
+				}
+				triangle[i] = vertex;
+			}
+
+			if (weld[triangle[0]] != weld[triangle[1]] && weld[triangle[1]] != weld[triangle[2]] &&
+				weld[triangle[0]] != weld[triangle[2]]) {
+				next.insert(next.end(), triangle, triangle + 3);
+			}
+		}
+		output.swap(next);
+	}
+
+	return (float)sqrt(maxError);
+}
+
+void MeshSimplifier::generateLods(const vector<float>& vertexData, size_t floatsPerVertex,
+	vector<unsigned int>& indices, vector<SubMesh>& subMeshes, vector<MeshLod>& lods,
+	unsigned int levelCount) {
+	lods.clear();
+	size_t vertexCount = vertexData.size() / floatsPerVertex;
+
+	MeshLod base;
+	base.firstSubMesh = 0;
+	base.subMeshCount = (unsigned int)subMeshes.size();
+	base.indexCount = (unsigned int)indices.size();
+	base.error = 0.0f;
+	lods.push_back(base);
+
+	if (levelCount <= 1 || vertexCount == 0 || subMeshes.empty()) {
+		return;
+	}
+
+	// Errors are relative to the diagonal of the whole mesh so that a
+	// level's error means the same thing for every submesh
+	glm::vec3 boundsMin(vertexData[0], vertexData[1], vertexData[2]);
+	glm::vec3 boundsMax = boundsMin;
+	for (size_t i = 0; i < vertexData.size(); i += floatsPerVertex) {
+		glm::vec3 p(vertexData[i], vertexData[i + 1], vertexData[i + 2]);
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+	float extent = glm::length(boundsMax - boundsMin);
+
+	vector<unsigned int> simplified;
+	for (unsigned int level = 1; level < levelCount; ++level) {
+		const MeshLod previous = lods.back();
+		float targetError = LOD_TARGET_ERRORS[min<size_t>(level - 1, LOD_TARGET_ERROR_COUNT - 1)];
+
+		MeshLod lod;
+		lod.firstSubMesh = (unsigned int)subMeshes.size();
+		lod.subMeshCount = previous.subMeshCount;
+		lod.indexCount = 0;
+		float levelError = 0.0f;
+
+		for (unsigned int s = 0; s < previous.subMeshCount; ++s) {
+			SubMesh subMesh = subMeshes[previous.firstSubMesh + s];
+			const unsigned int* source = indices.data() + subMesh.indexOffset;
+
+			if (subMesh.indexCount / 3 <= LOD_MIN_TRIANGLES) {
+				simplified.assign(source, source + subMesh.indexCount);
+			}
+			else {
+				size_t target = (size_t)(subMesh.indexCount / 3 * LOD_TRIANGLE_RATIO) * 3;
+				float error = simplify(vertexData.data(), floatsPerVertex, vertexCount, source,
+					subMesh.indexCount, target, targetError, extent, simplified);
+				levelError = max(levelError, error);
+				MeshOptimizer::optimizeVertexCache(simplified.data(), simplified.size(), vertexCount);
+			}
+
+			subMesh.indexOffset = (unsigned int)indices.size();
+			subMesh.indexCount = (unsigned int)simplified.size();
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			subMeshes.push_back(subMesh);
+			lod.indexCount += subMesh.indexCount;
+		}
+
+		// Not worth a level: roll it back and stop
+		if (lod.indexCount > previous.indexCount * (1.0f - LOD_MIN_REDUCTION)) {
+			indices.resize(indices.size() - lod.indexCount);
+			subMeshes.resize(lod.firstSubMesh);
+			break;
+		}
+
+		// Levels are built from each other, so errors add up
+		lod.error = previous.error + levelError;
+		lods.push_back(lod);
+	}
+}
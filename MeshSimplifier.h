@@ -0,0 +1,40 @@
+#pragma once
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+#include "MeshData.h"
+
+using namespace std;
+
+// Quadric error edge collapse (Garland & Heckbert) restricted to existing
+// vertices: only the index buffer changes, so every level of detail shares
+// the mesh's vertex buffer and a LOD is just more index ranges.
+//
+// Vertices are welded by position before collapsing so normal and UV seams
+// do not block simplification; a collapsed corner picks the wedge at the
+// target position whose normal matches best. Borders and non-manifold
+// edges are kept in place.
+class MeshSimplifier {
+public:
+	// LOD 0 (the source mesh) plus three simplified levels
+	static const unsigned int DEFAULT_LOD_LEVELS = 4;
+
+	// Simplifies triangles towards targetIndexCount without exceeding
+	// targetError (a distance, in units of extent). Writes the result to
+	// output and returns the error actually introduced, relative to extent.
+	static float simplify(const float* vertices, size_t floatsPerVertex, size_t vertexCount,
+		const unsigned int* indices, size_t indexCount, size_t targetIndexCount, float targetError,
+		float extent, vector<unsigned int>& output);
+
+	// Appends levels 1..levelCount-1 to indices and subMeshes, each level
+	// simplifying every submesh of the previous one, and fills lods with one
+	// entry per level (level 0 covers the existing submeshes). Stops early
+	// when a level would no longer remove a meaningful number of triangles.
+	static void generateLods(const vector<float>& vertexData, size_t floatsPerVertex,
+		vector<unsigned int>& indices, vector<SubMesh>& subMeshes, vector<MeshLod>& lods,
+		unsigned int levelCount);
+};
+
+#endif // !MESHSIMPLIFIER_H
@@ -0,0 +1,99 @@
+#include "OBJBenchmark.h"
+#include "OBJLoader.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+struct ParseResult {
+	double bestSeconds;
+	vector<float> vertexData;
+	size_t vertexCount;
+};
+
+template <typename LoadFn>
+bool timeParser(const string& path, int iterations, LoadFn load, ParseResult& result) {
+	result.bestSeconds = 1e30;
+
+	for (int i = 0; i < iterations; ++i) {
+		OBJLoader loader;
+
+		auto start = chrono::steady_clock::now();
+		bool ok = load(loader, path);
+		auto stop = chrono::steady_clock::now();
+
+		if (!ok) {
+			return false;
+		}
+
+		double seconds = chrono::duration<double>(stop - start).count();
+		result.bestSeconds = std::min(result.bestSeconds, seconds);
+
+		if (i == iterations - 1) {
+			result.vertexData = loader.getVertexData();
+			result.vertexCount = loader.getVertexCount();
+		}
+	}
+	return true;
+}
+
+void printResult(const char* name, const ParseResult& result, double megabytes, size_t lines) {
+	cout << "  " << left << setw(10) << name << right << fixed << setprecision(3)
+		<< setw(10) << result.bestSeconds * 1000.0 << " ms"
+		<< setw(12) << setprecision(1) << megabytes / result.bestSeconds << " MB/s"
+		<< setw(14) << setprecision(0) << lines / result.bestSeconds << " lines/s" << endl;
+}
+
+}
+
+int OBJBenchmark::run(const string& path, int iterations) {
+	iterations = std::max(1, iterations);
+
+	size_t bytes = 0;
+	size_t lines = 0;
+	{
+		MappedFile file;
+		if (!file.open(path)) {
+			cerr << "Failed to open OBJ file: " << path << endl;
+			return 1;
+		}
+		bytes = file.getSize();
+		lines = std::count(file.getData(), file.getData() + bytes, '\n');
+		if (bytes > 0 && file.getData()[bytes - 1] != '\n') {
+			++lines;
+		}
+	}
+	double megabytes = bytes / (1024.0 * 1024.0);
+
+	cout << "OBJ parse benchmark: " << path << endl;
+	cout << "  " << fixed << setprecision(2) << megabytes << " MB, " << lines << " lines, best of "
+		<< iterations << " run(s)" << endl;
+
+	ParseResult streamResult, mappedResult;
+	bool streamOk = timeParser(path, iterations,
+		[](OBJLoader& loader, const string& file) { return loader.loadOBJStream(file); }, streamResult);
+	bool mappedOk = timeParser(path, iterations,
+		[](OBJLoader& loader, const string& file) { return loader.loadOBJ(file); }, mappedResult);
+
+	if (!streamOk || !mappedOk) {
+		cerr << "OBJ benchmark failed to load " << path << endl;
+		return 1;
+	}
+
+	printResult("stream", streamResult, megabytes, lines);
+	printResult("mapped", mappedResult, megabytes, lines);
+	cout << "  speedup: " << setprecision(2) << streamResult.bestSeconds / mappedResult.bestSeconds
+		<< "x" << endl;
+
+	bool identical = streamResult.vertexData.size() == mappedResult.vertexData.size() &&
+		memcmp(streamResult.vertexData.data(), mappedResult.vertexData.data(),
+			streamResult.vertexData.size() * sizeof(float)) == 0;
+	cout << "  vertex data: " << (identical ? "identical" : "MISMATCH") << " ("
+		<< mappedResult.vertexCount << " vertices)" << endl;
+
+	return identical ? 0 : 2;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#ifndef OBJBENCHMARK_H
+#define OBJBENCHMARK_H
+
+#include <string>
+
+using namespace std;
+
+// Compares the parse throughput of OBJLoader::loadOBJ (memory-mapped) against
+// OBJLoader::loadOBJStream and checks both produce identical vertex data.
+// Run with: CityBuilder --bench-obj <file.obj> [iterations]
+class OBJBenchmark {
+public:
+	static int run(const string& path, int iterations);
+};
+
+#endif // !OBJBENCHMARK_H
@@ -1,9 +1,697 @@
 #include "OBJLoader.h"
+#include "MappedFile.h"
+#include "MeshFile.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp>
+
+namespace {
+
+// Files smaller than this are parsed on the calling thread
+const size_t PARALLEL_PARSE_THRESHOLD = 4 * 1024 * 1024;
+const size_t PARALLEL_CHUNK_MIN_SIZE = 1024 * 1024;
+
+const char* const DEFAULT_GROUP_NAME = "default";
+
+struct CornerKey {
+    int v, t, n;
+
+    bool operator==(const CornerKey& other) const {
+        return v == other.v && t == other.t && n == other.n;
+    }
+};
+
+struct CornerKeyHash {
+    size_t operator()(const CornerKey& key) const {
+        size_t h = (size_t)(unsigned int)key.v * 0x9E3779B1u;
+        h ^= (size_t)(unsigned int)key.t * 0x85EBCA77u + (h << 6) + (h >> 2);
+        h ^= (size_t)(unsigned int)key.n * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* skipBlanks(const char* cursor, const char* end) {
+    while (cursor < end && isBlank(*cursor)) {
+        ++cursor;
+    }
+    return cursor;
+}
+
+inline const char* skipLine(const char* cursor, const char* end) {
+    while (cursor < end && *cursor != '\n') {
+        ++cursor;
+    }
+    return cursor < end ? cursor + 1 : end;
+}
+
+// from_chars does not accept a leading '+', which is valid in OBJ exports
+inline const char* parseFloat(const char* cursor, const char* end, float& value) {
+    cursor = skipBlanks(cursor, end);
+    if (cursor < end && *cursor == '+') {
+        ++cursor;
+    }
+    std::from_chars_result result = std::from_chars(cursor, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// Rest of the statement with surrounding blanks removed ("g", "usemtl", ...)
+inline std::string readName(const char* cursor, const char* end) {
+    cursor = skipBlanks(cursor, end);
+    const char* last = cursor;
+    while (last < end && *last != '\n') {
+        ++last;
+    }
+    while (last > cursor && isBlank(last[-1])) {
+        --last;
+    }
+    return std::string(cursor, last);
+}
+
+inline std::string getDirectory(const std::string& filename) {
+    size_t slash = filename.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : filename.substr(0, slash + 1);
+}
+
+inline std::string trimName(const std::string& name) {
+    size_t first = name.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    size_t last = name.find_last_not_of(" \t\r");
+    return name.substr(first, last - first + 1);
+}
+
+inline const char* parseInt(const char* cursor, const char* end, int& value) {
+    if (cursor < end && *cursor == '+') {
+        ++cursor;
+    }
+    std::from_chars_result result = std::from_chars(cursor, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+}
+
+OBJLoader::OBJLoader()
+    : indexedOutput(false), optimizeOutput(false), vertexFormat(VertexFormat::FLOAT), lodLevels(1), currentGroup(DEFAULT_GROUP_NAME), groupSet(false),
+    materialSet(false), currentFaceGroup(-1) {
+}
+
+
 
 bool OBJLoader::loadOBJ(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Failed to open OBJ file: " << filename << std::endl;
+        return false;
+    }
+
+    sourceDirectory = getDirectory(filename);
+    const char* begin = file.getData();
+    const char* end = begin + file.getSize();
+
+    ThreadPool& pool = ThreadPool::getShared();
+    if (file.getSize() >= PARALLEL_PARSE_THRESHOLD && pool.getThreadCount() > 1) {
+        parseBufferParallel(begin, end, pool);
+    }
+    else {
+        parseBuffer(begin, end);
+    }
+    relativeCorners.clear();
+
+    file.close();
+    loadMaterialLibraries();
+    generateVertexData();
+    return true;
+}
+
+void OBJLoader::parseBufferParallel(const char* begin, const char* end, ThreadPool& pool) {
+    size_t size = end - begin;
+    size_t chunkCount = std::min(pool.getThreadCount() * 2, size / PARALLEL_CHUNK_MIN_SIZE);
+    chunkCount = std::max<size_t>(1, chunkCount);
+
+    // Split at line boundaries so no statement straddles two chunks
+    std::vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = begin;
+    bounds[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        const char* split = std::max(bounds[i - 1], begin + size * i / chunkCount);
+        bounds[i] = skipLine(split, end);
+    }
+
+    std::vector<std::unique_ptr<OBJLoader>> chunks(chunkCount);
+    std::vector<std::future<void>> pending;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        chunks[i] = std::make_unique<OBJLoader>();
+        OBJLoader* chunk = chunks[i].get();
+        const char* chunkBegin = bounds[i];
+        const char* chunkEnd = bounds[i + 1];
+        pending.push_back(pool.submit([chunk, chunkBegin, chunkEnd]() {
+            chunk->parseBuffer(chunkBegin, chunkEnd);
+        }));
+    }
+    for (std::future<void>& job : pending) {
+        job.get();
+    }
+
+    size_t totalVertices = vertices.size(), totalNormals = normals.size();
+    size_t totalTexCoords = texCoords.size(), totalFaces = faces.size();
+    for (const auto& chunk : chunks) {
+        totalVertices += chunk->vertices.size();
+        totalNormals += chunk->normals.size();
+        totalTexCoords += chunk->texCoords.size();
+        totalFaces += chunk->faces.size();
+    }
+    vertices.reserve(totalVertices);
+    normals.reserve(totalNormals);
+    texCoords.reserve(totalTexCoords);
+    faces.reserve(totalFaces);
+
+    faceGroupIds.reserve(totalFaces);
+
+    // Positive indices are already global. Relative (negative) ones were
+    // resolved against the chunk's own counts and need the chunk's offset.
+    // Group and material names a chunk inherited come from the chunks before it.
+    for (const auto& chunk : chunks) {
+        std::vector<unsigned int> groupRemap(chunk->faceGroups.size());
+        for (size_t i = 0; i < chunk->faceGroups.size(); ++i) {
+            const FaceGroup& local = chunk->faceGroups[i];
+            FaceGroup key;
+            key.group = local.groupInherited ? currentGroup : local.group;
+            key.material = local.materialInherited ? currentMaterial : local.material;
+            key.groupInherited = !groupSet && local.groupInherited;
+            key.materialInherited = !materialSet && local.materialInherited;
+            groupRemap[i] = findFaceGroup(key);
+        }
+        for (unsigned int id : chunk->faceGroupIds) {
+            faceGroupIds.push_back(groupRemap[id]);
+        }
+        if (chunk->groupSet) {
+            setGroup(chunk->currentGroup);
+        }
+        if (chunk->materialSet) {
+            setMaterial(chunk->currentMaterial);
+        }
+        for (const std::string& library : chunk->materialLibraries) {
+            addMaterialLibrary(library);
+        }
+
+        int vertexOffset = (int)vertices.size();
+        int normalOffset = (int)normals.size();
+        int texCoordOffset = (int)texCoords.size();
+        size_t faceOffset = faces.size();
+
+        vertices.insert(vertices.end(), chunk->vertices.begin(), chunk->vertices.end());
+        normals.insert(normals.end(), chunk->normals.begin(), chunk->normals.end());
+        texCoords.insert(texCoords.end(), chunk->texCoords.begin(), chunk->texCoords.end());
+        faces.insert(faces.end(), chunk->faces.begin(), chunk->faces.end());
+
+        for (size_t corner : chunk->relativeCorners) {
+            Face& face = faces[faceOffset + corner / FACE_INDEX_FIELDS];
+            size_t field = corner % FACE_INDEX_FIELDS;
+            int offset = field < 3 ? vertexOffset : (field < 6 ? normalOffset : texCoordOffset);
+            getFaceField(face, field) += offset;
+        }
+    }
+}
+
+void OBJLoader::parseBuffer(const char* begin, const char* end) {
+    const char* cursor = begin;
+
+    while (cursor < end) {
+        cursor = skipBlanks(cursor, end);
+        if (cursor >= end) {
+            break;
+        }
+
+        const char* token = cursor;
+        while (cursor < end && !isBlank(*cursor) && *cursor != '\n') {
+            ++cursor;
+        }
+        size_t tokenLength = cursor - token;
+
+        if (tokenLength == 1 && token[0] == 'v') {
+            Vertex v = { 0.0f, 0.0f, 0.0f };
+            const char* p = parseFloat(cursor, end, v.x);
+            if (p) p = parseFloat(p, end, v.y);
+            if (p) p = parseFloat(p, end, v.z);
+            vertices.push_back(v);
+        }
+        else if (tokenLength == 2 && token[0] == 'v' && token[1] == 'n') {
+            Normal n = { 0.0f, 0.0f, 0.0f };
+            const char* p = parseFloat(cursor, end, n.x);
+            if (p) p = parseFloat(p, end, n.y);
+            if (p) p = parseFloat(p, end, n.z);
+            normals.push_back(n);
+        }
+        else if (tokenLength == 2 && token[0] == 'v' && token[1] == 't') {
+            TexCoord t = { 0.0f, 0.0f };
+            const char* p = parseFloat(cursor, end, t.u);
+            if (p) p = parseFloat(p, end, t.v);
+            texCoords.push_back(t);
+        }
+        else if (tokenLength == 1 && token[0] == 'f') {
+            // Triangulate as a fan around the first corner, like parseFace
+            int v0, t0, n0, v1, t1, n1, v2, t2, n2;
+            const char* p = cursor;
+            if (!parseFaceCorner(p, end, v0, t0, n0) || !parseFaceCorner(p, end, v1, t1, n1) ||
+                !parseFaceCorner(p, end, v2, t2, n2)) {
+                std::cerr << "Invalid face with less than 3 vertices" << std::endl;
+            }
+            else {
+                do {
+                    Face face;
+                    face.v1 = v0; face.t1 = t0; face.n1 = n0;
+                    face.v2 = v1; face.t2 = t1; face.n2 = n1;
+                    face.v3 = v2; face.t3 = t2; face.n3 = n2;
+                    addFace(face);
+
+                    v1 = v2; t1 = t2; n1 = n2;
+                } while (parseFaceCorner(p, end, v2, t2, n2));
+            }
+        }
+        else if ((tokenLength == 1 && (token[0] == 'g' || token[0] == 'o'))) {
+            setGroup(readName(cursor, end));
+        }
+        else if (tokenLength == 6 && memcmp(token, "usemtl", 6) == 0) {
+            setMaterial(readName(cursor, end));
+        }
+        else if (tokenLength == 6 && memcmp(token, "mtllib", 6) == 0) {
+            addMaterialLibrary(readName(cursor, end));
+        }
+
+        cursor = skipLine(cursor, end);
+    }
+}
+
+// Parses one "v", "v/t", "v//n" or "v/t/n" corner, advancing the cursor.
+// Indices are returned raw (1-based, negative = relative, 0 = absent).
+// Returns false at the end of the line.
+bool OBJLoader::parseFaceCorner(const char*& cursor, const char* end, int& v, int& t, int& n) {
+    v = t = n = 0;
+
+    const char* p = skipBlanks(cursor, end);
+    if (p >= end || *p == '\n') {
+        cursor = p;
+        return false;
+    }
+
+    p = parseInt(p, end, v);
+    if (!p) {
+        return false;
+    }
+
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') {
+            const char* next = parseInt(p, end, t);
+            if (next) {
+                p = next;
+            }
+        }
+        if (p < end && *p == '/') {
+            ++p;
+            const char* next = parseInt(p, end, n);
+            if (next) {
+                p = next;
+            }
+        }
+    }
+
+    // Skip anything left in this corner token
+    while (p < end && !isBlank(*p) && *p != '\n') {
+        ++p;
+    }
+
+    cursor = p;
+    return true;
+}
+
+// Converts a raw OBJ index to a 0-based one. Relative indices count back from
+// the elements parsed so far; their corner is remembered so a chunked parse
+// can rebase them once the preceding chunks are known.
+int OBJLoader::resolveIndex(int raw, size_t count, size_t corner) {
+    if (raw > 0) {
+        return raw - 1;
+    }
+    if (raw < 0) {
+        relativeCorners.push_back(corner);
+        return (int)count + raw;
+    }
+    return -1;
+}
+
+int& OBJLoader::getFaceField(Face& face, size_t field) {
+    switch (field) {
+    case 0: return face.v1;
+    case 1: return face.v2;
+    case 2: return face.v3;
+    case 3: return face.n1;
+    case 4: return face.n2;
+    case 5: return face.n3;
+    case 6: return face.t1;
+    case 7: return face.t2;
+    default: return face.t3;
+    }
+}
+
+void OBJLoader::addFace(const Face& rawFace) {
+    Face face = rawFace;
+    size_t corner = faces.size() * FACE_INDEX_FIELDS;
+
+    for (size_t field = 0; field < FACE_INDEX_FIELDS; ++field) {
+        size_t count = field < 3 ? vertices.size() : (field < 6 ? normals.size() : texCoords.size());
+        int& index = getFaceField(face, field);
+        index = resolveIndex(index, count, corner + field);
+    }
+
+    if (currentFaceGroup < 0) {
+        FaceGroup key = { currentGroup, currentMaterial, !groupSet, !materialSet };
+        currentFaceGroup = (int)findFaceGroup(key);
+    }
+
+    faces.push_back(face);
+    faceGroupIds.push_back((unsigned int)currentFaceGroup);
+}
+
+void OBJLoader::setGroup(const std::string& name) {
+    currentGroup = name.empty() ? DEFAULT_GROUP_NAME : name;
+    groupSet = true;
+    currentFaceGroup = -1;
+}
+
+void OBJLoader::setMaterial(const std::string& name) {
+    currentMaterial = name;
+    materialSet = true;
+    currentFaceGroup = -1;
+}
+
+void OBJLoader::addMaterialLibrary(const std::string& name) {
+    if (!name.empty() &&
+        std::find(materialLibraries.begin(), materialLibraries.end(), name) == materialLibraries.end()) {
+        materialLibraries.push_back(name);
+    }
+}
+
+unsigned int OBJLoader::findFaceGroup(const FaceGroup& key) {
+    for (size_t i = 0; i < faceGroups.size(); ++i) {
+        const FaceGroup& group = faceGroups[i];
+        if (group.group == key.group && group.material == key.material &&
+            group.groupInherited == key.groupInherited && group.materialInherited == key.materialInherited) {
+            return (unsigned int)i;
+        }
+    }
+    faceGroups.push_back(key);
+    return (unsigned int)(faceGroups.size() - 1);
+}
+
+void OBJLoader::loadMaterialLibraries() {
+    for (const std::string& library : materialLibraries) {
+        if (!loadMaterialLibrary(sourceDirectory + library)) {
+            std::cerr << "Failed to open material library: " << sourceDirectory + library << std::endl;
+        }
+    }
+}
+
+// Reads newmtl blocks from a .mtl file. Material files are tiny, so the
+// simple stream parser is fine here.
+bool OBJLoader::loadMaterialLibrary(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    Material* material = nullptr;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string prefix;
+        iss >> prefix;
+
+        if (prefix == "newmtl") {
+            std::string name;
+            std::getline(iss, name);
+            materials.push_back(Material());
+            material = &materials.back();
+            material->name = trimName(name);
+        }
+        else if (!material) {
+            continue;
+        }
+        else if (prefix == "Ka") {
+            iss >> material->ambient.r >> material->ambient.g >> material->ambient.b;
+        }
+        else if (prefix == "Kd") {
+            iss >> material->diffuse.r >> material->diffuse.g >> material->diffuse.b;
+        }
+        else if (prefix == "Ks") {
+            iss >> material->specular.r >> material->specular.g >> material->specular.b;
+        }
+        else if (prefix == "Ns") {
+            iss >> material->shininess;
+        }
+        else if (prefix == "d") {
+            iss >> material->opacity;
+        }
+        else if (prefix == "Tr") {
+            float transparency = 0.0f;
+            iss >> transparency;
+            material->opacity = 1.0f - transparency;
+        }
+        else if (prefix == "map_Kd") {
+            std::string map;
+            std::getline(iss, map);
+            material->diffuseMap = trimName(map);
+        }
+    }
+    return true;
+}
+
+unsigned int OBJLoader::findMaterial(const std::string& name) {
+    if (name.empty()) {
+        return NO_MATERIAL;
+    }
+    for (size_t i = 0; i < materials.size(); ++i) {
+        if (materials[i].name == name) {
+            return (unsigned int)i;
+        }
+    }
+
+    // Referenced but never defined: keep the name, use default parameters
+    std::cerr << "Material not found in any library: " << name << std::endl;
+    Material placeholder;
+    placeholder.name = name;
+    materials.push_back(placeholder);
+    return (unsigned int)(materials.size() - 1);
+}
+
+// Orders faces so that every (material, group) pair is one contiguous range,
+// sorted by material, and records those ranges with their bounds.
+void OBJLoader::buildSubMeshes(std::vector<size_t>& faceOrder) {
+    subMeshes.clear();
+    faceOrder.clear();
+
+    struct RangeKey {
+        unsigned int material;
+        std::string name;
+    };
+    std::vector<RangeKey> groupKeys(faceGroups.size());
+    std::vector<unsigned int> groupOrder(faceGroups.size());
+    for (size_t i = 0; i < faceGroups.size(); ++i) {
+        groupKeys[i].material = findMaterial(faceGroups[i].material);
+        groupKeys[i].name = faceGroups[i].group;
+        groupOrder[i] = (unsigned int)i;
+    }
+    std::stable_sort(groupOrder.begin(), groupOrder.end(), [&](unsigned int a, unsigned int b) {
+        if (groupKeys[a].material != groupKeys[b].material) {
+            return groupKeys[a].material < groupKeys[b].material;
+        }
+        return groupKeys[a].name < groupKeys[b].name;
+    });
+
+    // Groups that only differ in how their names were set share one range
+    std::vector<unsigned int> groupRange(faceGroups.size());
+    for (size_t i = 0; i < groupOrder.size(); ++i) {
+        const RangeKey& key = groupKeys[groupOrder[i]];
+        if (subMeshes.empty() || subMeshes.back().materialIndex != key.material ||
+            subMeshes.back().name != key.name) {
+            SubMesh subMesh;
+            subMesh.name = key.name;
+            subMesh.materialIndex = key.material;
+            subMeshes.push_back(subMesh);
+        }
+        groupRange[groupOrder[i]] = (unsigned int)(subMeshes.size() - 1);
+    }
+
+    // Counting sort of the faces by range
+    std::vector<size_t> rangeStart(subMeshes.size() + 1, 0);
+    for (unsigned int id : faceGroupIds) {
+        ++rangeStart[groupRange[id] + 1];
+    }
+    for (size_t i = 1; i < rangeStart.size(); ++i) {
+        rangeStart[i] += rangeStart[i - 1];
+    }
+
+    faceOrder.resize(faces.size());
+    std::vector<size_t> cursor(rangeStart.begin(), rangeStart.end() - 1);
+    for (size_t face = 0; face < faces.size(); ++face) {
+        faceOrder[cursor[groupRange[faceGroupIds[face]]]++] = face;
+    }
+
+    auto positionOf = [&](int vIdx) {
+        if (vIdx >= 0 && vIdx < (int)vertices.size()) {
+            return glm::vec3(vertices[vIdx].x, vertices[vIdx].y, vertices[vIdx].z);
+        }
+        return glm::vec3(0.0f);
+    };
+
+    for (size_t i = 0; i < subMeshes.size(); ++i) {
+        SubMesh& subMesh = subMeshes[i];
+        subMesh.indexOffset = (unsigned int)(rangeStart[i] * 3);
+        subMesh.indexCount = (unsigned int)((rangeStart[i + 1] - rangeStart[i]) * 3);
+
+        for (size_t f = rangeStart[i]; f < rangeStart[i + 1]; ++f) {
+            const Face& face = faces[faceOrder[f]];
+            glm::vec3 corners[3] = { positionOf(face.v1), positionOf(face.v2), positionOf(face.v3) };
+            for (int c = 0; c < 3; ++c) {
+                if (f == rangeStart[i] && c == 0) {
+                    subMesh.boundsMin = subMesh.boundsMax = corners[c];
+                }
+                subMesh.boundsMin = glm::min(subMesh.boundsMin, corners[c]);
+                subMesh.boundsMax = glm::max(subMesh.boundsMax, corners[c]);
+            }
+        }
+    }
+
+    // Ranges without faces (e.g. a usemtl followed by another usemtl)
+    subMeshes.erase(std::remove_if(subMeshes.begin(), subMeshes.end(),
+        [](const SubMesh& subMesh) { return subMesh.indexCount == 0; }), subMeshes.end());
+}
+
+bool OBJLoader::loadMeshData(const std::string& filename, MeshData& data) {
+    MeshSourceStamp stamp;
+    bool hasStamp = MeshFile::computeSourceStamp(filename, stamp);
+    std::string cachePath = MeshFile::getCachePath(filename);
+
+    if (hasStamp && MeshFile::read(cachePath, stamp, data)) {
+        if (data.optimized == optimizeOutput && data.vertexFormat == vertexFormat &&
+            data.requestedLodLevels == lodLevels) {
+            return true;
+        }
+        data = MeshData();
+    }
+
+    setIndexedOutput(true);
+    if (!loadOBJ(filename)) {
+        return false;
+    }
+
+    buildMeshData(data);
+
+    if (hasStamp && !data.isEmpty() && !MeshFile::write(cachePath, stamp, data)) {
+        std::cerr << "Failed to write mesh cache: " << cachePath << std::endl;
+    }
+    return true;
+}
+
+void OBJLoader::buildMeshData(MeshData& data) const {
+    data.layout = VertexLayout::positionNormalTexCoord();
+    data.mapping.reset();
+    data.subMeshes = subMeshes;
+    data.materials = materials;
+    data.optimized = indexedOutput && optimizeOutput;
+    data.vertexFormat = vertexFormat;
+    data.lods = lods;
+    data.requestedLodLevels = indexedOutput ? lodLevels : 1;
+
+    data.indexCount = indices.size();
+    if (needsWideIndices()) {
+        data.indexType = GL_UNSIGNED_INT;
+        data.indexStorage.resize(indices.size() * sizeof(unsigned int));
+        if (!indices.empty()) {
+            memcpy(data.indexStorage.data(), indices.data(), data.indexStorage.size());
+        }
+    }
+    else {
+        data.indexType = GL_UNSIGNED_SHORT;
+        data.indexStorage.resize(indices.size() * sizeof(unsigned short));
+        unsigned short* shortIndices = (unsigned short*)data.indexStorage.data();
+        for (size_t i = 0; i < indices.size(); ++i) {
+            shortIndices[i] = (unsigned short)indices[i];
+        }
+    }
+    data.indices = data.indexStorage.data();
+
+    // Axis-aligned bounds of the mesh in model space
+    data.boundsMin = glm::vec3(0.0f);
+    data.boundsMax = glm::vec3(0.0f);
+    for (size_t i = 0; i < vertexData.size(); i += FLOATS_PER_VERTEX) {
+        glm::vec3 position(vertexData[i], vertexData[i + 1], vertexData[i + 2]);
+        if (i == 0) {
+            data.boundsMin = data.boundsMax = position;
+        }
+        else {
+            data.boundsMin = glm::min(data.boundsMin, position);
+            data.boundsMax = glm::max(data.boundsMax, position);
+        }
+    }
+
+    data.vertexCount = getVertexCount();
+    if (vertexFormat == VertexFormat::QUANTIZED) {
+        packQuantizedVertices(data);
+    }
+    else {
+        data.vertexStorage.resize(vertexData.size() * sizeof(float));
+        if (!vertexData.empty()) {
+            memcpy(data.vertexStorage.data(), vertexData.data(), data.vertexStorage.size());
+        }
+    }
+    data.vertices = data.vertexStorage.data();
+}
+
+void OBJLoader::packQuantizedVertices(MeshData& data) const {
+    data.layout = VertexLayout::quantized(!texCoords.empty());
+    data.vertexStorage.assign(data.vertexCount * data.layout.stride, 0);
+
+    // Flat axes have no extent; everything on them quantizes to 0
+    glm::vec3 extent = data.boundsMax - data.boundsMin;
+    glm::vec3 inverseExtent;
+    for (int axis = 0; axis < 3; ++axis) {
+        inverseExtent[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+    }
+
+    for (size_t v = 0; v < data.vertexCount; ++v) {
+        const float* source = &vertexData[v * FLOATS_PER_VERTEX];
+        unsigned char* target = data.vertexStorage.data() + v * data.layout.stride;
+
+        unsigned short position[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            float unit = glm::clamp((source[axis] - data.boundsMin[axis]) * inverseExtent[axis], 0.0f, 1.0f);
+            position[axis] = (unsigned short)(unit * 65535.0f + 0.5f);
+        }
+        memcpy(target, position, sizeof(position));
+
+        uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(source[3], source[4], source[5], 0.0f));
+        memcpy(target + 8, &normal, sizeof(normal));
+
+        if (!texCoords.empty()) {
+            unsigned short uv[2] = { glm::packHalf1x16(source[6]), glm::packHalf1x16(source[7]) };
+            memcpy(target + 12, uv, sizeof(uv));
+        }
+    }
+}
+
+bool OBJLoader::loadOBJStream(const std::string& filename) {
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Failed to open OBJ file: " << filename << std::endl;
@@ -34,9 +722,25 @@ bool OBJLoader::loadOBJ(const std::string& filename) {
         else if (prefix == "f") {
             parseFace(line.substr(2));
         }
+        else if (prefix == "g" || prefix == "o" || prefix == "usemtl" || prefix == "mtllib") {
+            std::string name;
+            std::getline(iss, name);
+            name = trimName(name);
+            if (prefix == "usemtl") {
+                setMaterial(name);
+            }
+            else if (prefix == "mtllib") {
+                addMaterialLibrary(name);
+            }
+            else {
+                setGroup(name);
+            }
+        }
     }
 
     file.close();
+    relativeCorners.clear();
+    loadMaterialLibraries();
     generateVertexData();
     return true;
 }
@@ -71,34 +775,35 @@ void OBJLoader::parseFace(const std::string& faceData) {
         // Next vertex
         parseVertexData(vertices[i + 1], face.v3, face.t3, face.n3);
 
-        faces.push_back(face);
+        addFace(face);
     }
 }
 
+// Raw indices, resolved by addFace
 void OBJLoader::parseVertexData(const std::string& vertexStr, int& v, int& t, int& n) {
-    v = t = n = -1;
+    v = t = n = 0;
 
     size_t pos1 = vertexStr.find('/');
     if (pos1 == std::string::npos) {
-        v = std::stoi(vertexStr) - 1;
+        v = std::stoi(vertexStr);
     } else {
-        v = std::stoi(vertexStr.substr(0, pos1)) - 1;
+        v = std::stoi(vertexStr.substr(0, pos1));
 
         size_t pos2 = vertexStr.find('/', pos1 + 1);
         if (pos2 == std::string::npos) {
             std::string texStr = vertexStr.substr(pos1 + 1);
             if (!texStr.empty()) {
-                t = std::stoi(texStr) - 1;
+                t = std::stoi(texStr);
             }
         } else {
             std::string texStr = vertexStr.substr(pos1 + 1, pos2 - pos1 - 1);
             if (!texStr.empty()) {
-                t = std::stoi(texStr) - 1;
+                t = std::stoi(texStr);
             }
 
             std::string normalStr = vertexStr.substr(pos2 + 1);
             if (!normalStr.empty()) {
-                n = std::stoi(normalStr) - 1;
+                n = std::stoi(normalStr);
             }
         }
     }
@@ -106,14 +811,54 @@ void OBJLoader::parseVertexData(const std::string& vertexStr, int& v, int& t, in
 
 void OBJLoader::generateVertexData() {
     vertexData.clear();
+    indices.clear();
+    lods.clear();
+
+    std::vector<size_t> faceOrder;
+    buildSubMeshes(faceOrder);
+
+    if (indexedOutput) {
+        generateIndexedVertexData(faceOrder);
+        optimizerReport.clear();
+        if (optimizeOutput) {
+            MeshOptimizer::optimize(vertexData, FLOATS_PER_VERTEX, indices, subMeshes, &optimizerReport);
+        }
+        // After the optimizer, so the levels index the final vertex order
+        MeshSimplifier::generateLods(vertexData, FLOATS_PER_VERTEX, indices, subMeshes, lods, lodLevels);
+        return;
+    }
 
-    for (const Face& face : faces) {
+    vertexData.reserve(faces.size() * 3 * FLOATS_PER_VERTEX);
+    for (size_t faceIndex : faceOrder) {
+        const Face& face = faces[faceIndex];
         addVertexToData(face.v1, face.t1, face.n1);
         addVertexToData(face.v2, face.t2, face.n2);
         addVertexToData(face.v3, face.t3, face.n3);
     }
 }
 
+void OBJLoader::generateIndexedVertexData(const std::vector<size_t>& faceOrder) {
+    std::unordered_map<CornerKey, unsigned int, CornerKeyHash> uniqueCorners;
+    uniqueCorners.reserve(faces.size() * 2);
+    indices.reserve(faces.size() * 3);
+
+    auto addCorner = [&](int v, int t, int n) {
+        CornerKey key = { v, t, n };
+        auto inserted = uniqueCorners.emplace(key, (unsigned int)uniqueCorners.size());
+        if (inserted.second) {
+            addVertexToData(v, t, n);
+        }
+        indices.push_back(inserted.first->second);
+    };
+
+    for (size_t faceIndex : faceOrder) {
+        const Face& face = faces[faceIndex];
+        addCorner(face.v1, face.t1, face.n1);
+        addCorner(face.v2, face.t2, face.n2);
+        addCorner(face.v3, face.t3, face.n3);
+    }
+}
+
 void OBJLoader::addVertexToData(int vIdx, int tIdx, int nIdx) {
     // Position
     if (vIdx >= 0 && vIdx < vertices.size()) {
@@ -136,6 +881,15 @@ void OBJLoader::addVertexToData(int vIdx, int tIdx, int nIdx) {
         vertexData.push_back(0.0f);
         vertexData.push_back(1.0f);
     }
+
+    // Texture coordinate
+    if (tIdx >= 0 && tIdx < texCoords.size()) {
+        vertexData.push_back(texCoords[tIdx].u);
+        vertexData.push_back(texCoords[tIdx].v);
+    } else {
+        vertexData.push_back(0.0f);
+        vertexData.push_back(0.0f);
+    }
 }
 
 const std::vector<float>& OBJLoader::getVertexData() const {
@@ -143,7 +897,27 @@ const std::vector<float>& OBJLoader::getVertexData() const {
 }
 
 size_t OBJLoader::getVertexCount() const {
-    return vertexData.size() / 6;
+    return vertexData.size() / FLOATS_PER_VERTEX;
+}
+
+const std::vector<unsigned int>& OBJLoader::getIndices() const {
+    return indices;
+}
+
+size_t OBJLoader::getIndexCount() const {
+    return indices.size();
+}
+
+bool OBJLoader::needsWideIndices() const {
+    return getVertexCount() > 0xFFFF;
+}
+
+const std::vector<SubMesh>& OBJLoader::getSubMeshes() const {
+    return subMeshes;
+}
+
+const std::vector<Material>& OBJLoader::getMaterials() const {
+    return materials;
 }
 
 void OBJLoader::printInfo() const {
@@ -152,5 +926,18 @@ void OBJLoader::printInfo() const {
     std::cout << "Normals: " << normals.size() << std::endl;
     std::cout << "Texture Coords: " << texCoords.size() << std::endl;
     std::cout << "Faces: " << faces.size() << std::endl;
+    std::cout << "Submeshes: " << subMeshes.size() << " (" << materials.size() << " materials)" << std::endl;
     std::cout << "Final vertex count: " << getVertexCount() << std::endl;
+    if (indexedOutput) {
+        std::cout << "Index count: " << getIndexCount()
+            << (needsWideIndices() ? " (32-bit)" : " (16-bit)") << std::endl;
+    }
+    for (size_t i = 1; i < lods.size(); ++i) {
+        std::cout << "LOD " << i << ": " << lods[i].indexCount / 3 << " triangles, error "
+            << lods[i].error << std::endl;
+    }
+    if (!optimizerReport.empty()) {
+        std::cout << "Mesh optimization:" << std::endl;
+        MeshOptimizer::printReport(optimizerReport);
+    }
 }
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include "MeshData.h"
+#include "MeshOptimizer.h"
 
 // Vertex structure
 struct Vertex {
@@ -26,23 +28,113 @@ struct Face {
     int t1, t2, t3;
 };
 
+// Group and material that faces are emitted under. A parallel chunk that
+// starts before its first g/o/usemtl statement inherits the missing names
+// from the previous chunk when the chunks are merged.
+struct FaceGroup {
+    std::string group;
+    std::string material;
+    bool groupInherited;
+    bool materialInherited;
+};
+
+class ThreadPool;
+
 class OBJLoader {
 private:
+    static const size_t FACE_INDEX_FIELDS = 9;
+    static const size_t FLOATS_PER_VERTEX = 8;
+
     std::vector<Vertex> vertices;
     std::vector<Normal> normals;
     std::vector<TexCoord> texCoords;
     std::vector<Face> faces;
     std::vector<float> vertexData;
+    std::vector<unsigned int> indices;
+    std::vector<size_t> relativeCorners;
+    bool indexedOutput;
+    bool optimizeOutput;
+    VertexFormat vertexFormat;
+    unsigned int lodLevels;
+    std::vector<MeshLod> lods;
+    MeshOptimizerReport optimizerReport;
+
+    // Group / material state
+    std::vector<FaceGroup> faceGroups;
+    std::vector<unsigned int> faceGroupIds;
+    std::vector<std::string> materialLibraries;
+    std::vector<Material> materials;
+    std::vector<SubMesh> subMeshes;
+    std::string sourceDirectory;
+    std::string currentGroup, currentMaterial;
+    bool groupSet, materialSet;
+    int currentFaceGroup;
 
     void parseFace(const std::string& faceData);
     void parseVertexData(const std::string& vertexStr, int& v, int& t, int& n);
+    void parseBuffer(const char* begin, const char* end);
+    void parseBufferParallel(const char* begin, const char* end, ThreadPool& pool);
+    void addFace(const Face& rawFace);
+    int resolveIndex(int raw, size_t count, size_t corner);
+    static int& getFaceField(Face& face, size_t field);
+    bool parseFaceCorner(const char*& cursor, const char* end, int& v, int& t, int& n);
+    void setGroup(const std::string& name);
+    void setMaterial(const std::string& name);
+    void addMaterialLibrary(const std::string& name);
+    unsigned int findFaceGroup(const FaceGroup& key);
+    void loadMaterialLibraries();
+    bool loadMaterialLibrary(const std::string& path);
+    unsigned int findMaterial(const std::string& name);
+    void buildSubMeshes(std::vector<size_t>& faceOrder);
     void generateVertexData();
+    void generateIndexedVertexData(const std::vector<size_t>& faceOrder);
     void addVertexToData(int vIdx, int tIdx, int nIdx);
+    void packQuantizedVertices(MeshData& data) const;
 
 public:
+    OBJLoader();
+
+    // When enabled, each unique (v, vt, vn) corner is emitted once into the
+    // vertex data and triangles are described by getIndices() instead
+    void setIndexedOutput(bool indexed) { indexedOutput = indexed; }
+    bool isIndexed() const { return indexedOutput; }
+
+    // Reorders indexed output for vertex cache, overdraw and fetch locality
+    // (see MeshOptimizer). Off by default so the output keeps file order.
+    void setOptimizeOutput(bool optimize) { optimizeOutput = optimize; }
+    bool isOptimized() const { return optimizeOutput; }
+    const MeshOptimizerReport& getOptimizerReport() const { return optimizerReport; }
+
+    // Number of detail levels generated for indexed output (1 = source only,
+    // see MeshSimplifier). Levels are appended as extra submesh ranges.
+    void setLodLevels(unsigned int levels) { lodLevels = levels; }
+    unsigned int getLodLevels() const { return lodLevels; }
+    const std::vector<MeshLod>& getLods() const { return lods; }
+
+    // Vertex format buildMeshData() packs into; getVertexData() stays float
+    void setVertexFormat(VertexFormat format) { vertexFormat = format; }
+    VertexFormat getVertexFormat() const { return vertexFormat; }
+
+    // Memory-maps the file and tokenizes it in place (no per-line strings)
     bool loadOBJ(const std::string& filename);
+    // Original std::istream based parser, kept as the reference implementation
+    bool loadOBJStream(const std::string& filename);
+    // Loads indexed GPU-ready data, from the .cbmesh sidecar when it is up to
+    // date, otherwise by parsing the OBJ and writing a fresh sidecar
+    bool loadMeshData(const std::string& filename, MeshData& data);
+    // Packs the current indexed output into data in the selected vertex format
+    void buildMeshData(MeshData& data) const;
+    // Vertex data is 8 floats per vertex: position, normal, texture coordinate
+    static size_t getFloatsPerVertex() { return FLOATS_PER_VERTEX; }
     const std::vector<float>& getVertexData() const;
     size_t getVertexCount() const;
+    const std::vector<unsigned int>& getIndices() const;
+    size_t getIndexCount() const;
+    // True when the indices do not fit in GL_UNSIGNED_SHORT
+    bool needsWideIndices() const;
+    // Draw ranges (in corners / indices), sorted by material within each LOD
+    const std::vector<SubMesh>& getSubMeshes() const;
+    const std::vector<Material>& getMaterials() const;
     void printInfo() const;
 };
 
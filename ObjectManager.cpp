@@ -1,63 +1,29 @@
 #include "ObjectManager.h"
-#include <iostream>
 
 using namespace std;
 
-void ObjectManager::setupShaderProgram() {
-	shaderProgram = shaderProgramCreator.createShaderProgram("shaders/vertex/BuildingVertexShader.glsl", 
-		"shaders/fragment/BuildingFragmentShader.glsl");
-}
-
-ObjectManager::ObjectManager() {}
-
-void ObjectManager::init() {
-	setupShaderProgram();
-}
+ObjectManager::ObjectManager()
+	: SceneManager<Building>(PICK_LAYER, "buildings",
+		"shaders/vertex/BuildingVertexShader.glsl", "shaders/fragment/BuildingFragmentShader.glsl") {}
 
 ObjectManager::~ObjectManager() {}
 
 Building *ObjectManager::selectBuilding(const vec3& rayStart, const vec3& rayDir) {
-	selectedBuilding = nullptr;
-	for (auto& building : buildings) {
-		building->selected = false;
-		if (building->intersects(rayStart, rayDir)) {
-			selectedBuilding = building.get();
-			building->selected = true;
-			break;
-		}
-	}
-	return selectedBuilding;
-}
-
-Building* ObjectManager::getSelectedBuilding() {
-	return selectedBuilding;
+	selectBuilding(checkBuildingSelection(rayStart, rayDir));
+	return selected;
 }
 
 Building* ObjectManager::checkBuildingSelection(const glm::vec3& rayStart, const glm::vec3& rayDir) {
-	// Check each building for intersection with the ray
-	for (auto& building : buildings) {
-		if (building && building->intersects(rayStart, rayDir)) {
-			return building.get();
-		}
-	}
-	return nullptr;
-}
-
-void ObjectManager::clearSelection() {
-	if (selectedBuilding) {
-		selectedBuilding->selected = false;
-		selectedBuilding = nullptr;
-	}
-}
-
-void ObjectManager::addBuilding(unique_ptr<Building> building) {
-	buildings.push_back(move(building));
+	BuildingHit hit;
+	return raycast(rayStart, rayDir, hit) ? hit.building : nullptr;
 }
 
-void ObjectManager::renderObjects(const mat4 &view, const mat4 &projection, const vec3& lightPos, const vec3& cameraPos) {
-	for (auto& building : buildings) {
-		if (building) {
-			building->render(shaderProgram, view, projection, lightPos, cameraPos);
-		}
-	}
+bool ObjectManager::raycast(const vec3& rayStart, const vec3& rayDir, BuildingHit& hit) {
+	Hit found = {};
+	bool hitAny = raycastObjects(rayStart, rayDir, found);
+	hit.building = found.object;
+	hit.point = found.point;
+	hit.distance = found.distance;
+	hit.triangle = found.triangle;
+	return hitAny;
 }
\ No newline at end of file
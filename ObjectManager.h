@@ -9,37 +9,48 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "Building.h"
-#include "ShaderProgramCreator.h"
+#include "SceneManager.h"
 
 using namespace std;
 
-class ObjectManager {
-protected:
-	vector<unique_ptr<Building>> buildings;
-	ShaderProgramCreator shaderProgramCreator;
-	GLuint shaderProgram;
-	Building *selectedBuilding = nullptr;
-
-	void setupShaderProgram();
+// Nearest building along a picking ray
+struct BuildingHit {
+	Building* building;
+	vec3 point;
+	float distance;
+	unsigned int triangle;   // TriangleBvh::NO_TRIANGLE when the placeholder box was hit
+};
 
+// The city's buildings; drawing, culling and the spatial index are shared
+// with RoadManager through SceneManager
+class ObjectManager : public SceneManager<Building> {
 public:
 	ObjectManager();
 
-	void init();
-
 	virtual ~ObjectManager();
 
 	Building *selectBuilding(const vec3 &rayStart, const vec3 &rayDir);
 
-	Building* getSelectedBuilding();
+	Building* getSelectedBuilding() { return selected; }
+
+	// Selects a building found by other means, e.g. GPU picking; null clears
+	void selectBuilding(Building* building) { select(building); }
+
+	// PickBuffer ids of the buildings drawn by renderObjects
+	static const unsigned int PICK_LAYER = 1;
+	Building* getBuildingByPickId(unsigned int pickId) const { return getByPickId(pickId); }
+
+	// Drawn with a light highlight; null for none
+	void setHoveredBuilding(Building* building) { hovered = building; }
+	Building* getHoveredBuilding() const { return hovered; }
 
 	Building* checkBuildingSelection(const glm::vec3& rayStart, const glm::vec3& rayDir);
-	
-	void clearSelection();
 
-	void addBuilding(unique_ptr<Building> building);
+	// Closest building whose triangles the ray hits, with the hit point and
+	// triangle; false when nothing is hit
+	bool raycast(const vec3& rayStart, const vec3& rayDir, BuildingHit& hit);
 
-	virtual void renderObjects(const mat4 &view, const mat4 &projection, const vec3& lightPos, const vec3& cameraPos);
+	void addBuilding(unique_ptr<Building> building) { add(move(building)); }
 };
 
 #endif 
@@ -0,0 +1,198 @@
+#include "PickBuffer.h"
+#include "FrameUniforms.h"
+#include <iostream>
+
+PickBuffer::PickBuffer()
+	: fbo(0), idBuffer(0), depthBuffer(0), pickTransformUniform(INVALID_UNIFORM),
+	firstPending(0), pendingCount(0), previousFramebuffer(0), regionX(0), regionY(0),
+	passActive(false) {
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		readbacks[i] = { 0, nullptr, 0, 0, 0 };
+	}
+	for (int i = 0; i < 4; ++i) {
+		previousViewport[i] = 0;
+	}
+}
+
+PickBuffer::~PickBuffer() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool PickBuffer::init() {
+	if (!shader.load("shaders/vertex/PickVertexShader.glsl", "shaders/fragment/PickFragmentShader.glsl")) {
+		return false;
+	}
+	FrameUniforms::attach(shader);
+	pickTransformUniform = shader.getUniform("pickTransform");
+	shader.use();
+	TransformBuffer::attach(shader);
+	InstanceRenderer::attach(shader);
+
+	glGenRenderbuffers(1, &idBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, idBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, REGION_SIZE, REGION_SIZE);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, REGION_SIZE, REGION_SIZE);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLint framebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, idBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Pick framebuffer incomplete: 0x" << hex << status << dec << endl;
+		cleanup();
+		return false;
+	}
+
+	// Streamed back every pick, read once by the CPU
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		glGenBuffers(1, &readbacks[i].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, REGION_SIZE * REGION_SIZE * sizeof(GLuint), nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+void PickBuffer::cleanup() {
+	for (unsigned int i = 0; i < READBACK_SLOTS; ++i) {
+		if (readbacks[i].fence) {
+			glDeleteSync(readbacks[i].fence);
+			readbacks[i].fence = nullptr;
+		}
+		if (readbacks[i].pbo != 0) {
+			glDeleteBuffers(1, &readbacks[i].pbo);
+			readbacks[i].pbo = 0;
+		}
+	}
+	firstPending = 0;
+	pendingCount = 0;
+
+	if (fbo != 0) {
+		glDeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+	if (idBuffer != 0) {
+		glDeleteRenderbuffers(1, &idBuffer);
+		idBuffer = 0;
+	}
+	if (depthBuffer != 0) {
+		glDeleteRenderbuffers(1, &depthBuffer);
+		depthBuffer = 0;
+	}
+	shader.cleanup();
+}
+
+bool PickBuffer::begin(int width, int height, int x, int y) {
+	if (fbo == 0 || pendingCount == READBACK_SLOTS || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, REGION_SIZE, REGION_SIZE);
+
+	GLuint clearId[4] = { NO_OBJECT, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clearId);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// Scale and shift clip space so the region around (x, y) covers the
+	// buffer, like gluPickMatrix
+	glm::mat4 pickTransform(1.0f);
+	pickTransform[0][0] = (float)width / REGION_SIZE;
+	pickTransform[1][1] = (float)height / REGION_SIZE;
+	pickTransform[3][0] = (float)(width - 2 * x - 1) / REGION_SIZE;
+	pickTransform[3][1] = (float)(height - 2 * y - 1) / REGION_SIZE;
+
+	shader.use();
+	shader.set(pickTransformUniform, pickTransform);
+
+	regionX = x;
+	regionY = y;
+	passActive = true;
+	return true;
+}
+
+void PickBuffer::draw(const InstanceRenderer& renderer) {
+	if (passActive) {
+		renderer.redraw();
+	}
+}
+
+void PickBuffer::draw(const GpuCuller& culler) {
+	if (passActive) {
+		culler.redraw();
+	}
+}
+
+void PickBuffer::end(unsigned int tag) {
+	if (!passActive) {
+		return;
+	}
+	passActive = false;
+
+	// The copy into the PBO is queued; the fence says when it has landed
+	Readback& readback = readbacks[(firstPending + pendingCount) % READBACK_SLOTS];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, REGION_SIZE, REGION_SIZE, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.tag = tag;
+	readback.x = regionX;
+	readback.y = regionY;
+	++pendingCount;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+bool PickBuffer::poll(Result& result) {
+	if (pendingCount == 0) {
+		return false;
+	}
+
+	Readback& readback = readbacks[firstPending];
+	GLenum state = glClientWaitSync(readback.fence, 0, 0);
+	if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+		return false;
+	}
+	glDeleteSync(readback.fence);
+	readback.fence = nullptr;
+	firstPending = (firstPending + 1) % READBACK_SLOTS;
+	--pendingCount;
+
+	result.tag = readback.tag;
+	result.x = readback.x;
+	result.y = readback.y;
+	result.centerId = NO_OBJECT;
+	result.nearestId = NO_OBJECT;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	const GLuint* ids = (const GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		REGION_SIZE * REGION_SIZE * sizeof(GLuint), GL_MAP_READ_BIT);
+	if (ids) {
+		result.centerId = ids[REGION_RADIUS * REGION_SIZE + REGION_RADIUS];
+		int nearestDistance = REGION_SIZE * REGION_SIZE;
+		for (int row = 0; row < REGION_SIZE; ++row) {
+			for (int column = 0; column < REGION_SIZE; ++column) {
+				GLuint id = ids[row * REGION_SIZE + column];
+				int dx = column - REGION_RADIUS, dy = row - REGION_RADIUS;
+				if (id != NO_OBJECT && dx * dx + dy * dy < nearestDistance) {
+					nearestDistance = dx * dx + dy * dy;
+					result.nearestId = id;
+				}
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
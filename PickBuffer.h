@@ -0,0 +1,91 @@
+#pragma once
+#ifndef PICKBUFFER_H
+#define PICKBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GpuCuller.h"
+#include "InstanceRenderer.h"
+#include "ShaderProgram.h"
+
+using namespace std;
+
+// GPU picking: object ids are rendered into a small integer framebuffer and
+// read back through pixel buffer objects a frame or two later, so picking
+// never waits on the GPU and costs the same however crowded the city is.
+//
+// Only the square of REGION_SIZE pixels around the cursor is rendered: the
+// pick transform stretches it over the whole buffer. One readback serves
+// both clicks (the center pixel) and hover (the id nearest the center).
+//
+// Usage per frame, after the managers have drawn: begin(), draw() for each
+// InstanceRenderer and GpuCuller, end(); then poll() until it returns false. Ids are
+// PickBuffer::makeId(layer, index) with layer 1..255; 0 means nothing.
+class PickBuffer {
+public:
+	static const unsigned int NO_OBJECT = 0;
+	static const unsigned int INDEX_BITS = 24;
+	static const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+	static const int REGION_RADIUS = 4;
+	static const int REGION_SIZE = 2 * REGION_RADIUS + 1;
+	// Readbacks in flight; begin() fails while all of them are
+	static const unsigned int READBACK_SLOTS = 3;
+
+	static unsigned int makeId(unsigned int layer, unsigned int index) { return (layer << INDEX_BITS) | (index & INDEX_MASK); }
+	static unsigned int getLayer(unsigned int id) { return id >> INDEX_BITS; }
+	static unsigned int getIndex(unsigned int id) { return id & INDEX_MASK; }
+
+	struct Result {
+		unsigned int tag;       // As given to end()
+		int x, y;               // Pixel the region was centered on
+		unsigned int centerId;  // Id under that pixel
+		unsigned int nearestId; // Id closest to it within the region
+	};
+
+private:
+	struct Readback {
+		GLuint pbo;
+		GLsync fence;
+		unsigned int tag;
+		int x, y;
+	};
+
+	GLuint fbo, idBuffer, depthBuffer;
+	ShaderProgram shader;
+	UniformHandle pickTransformUniform;
+
+	Readback readbacks[READBACK_SLOTS];
+	unsigned int firstPending;   // Oldest readback in flight
+	unsigned int pendingCount;
+
+	GLint previousFramebuffer;
+	GLint previousViewport[4];
+	int regionX, regionY;
+	bool passActive;
+
+public:
+	PickBuffer();
+	~PickBuffer();
+
+	PickBuffer(const PickBuffer&) = delete;
+	PickBuffer& operator=(const PickBuffer&) = delete;
+
+	bool init();
+	void cleanup();
+
+	// Starts an id pass centered on pixel (x, y) of a width x height window,
+	// bottom-left origin. False when every readback slot is still in flight.
+	bool begin(int width, int height, int x, int y);
+	void draw(const InstanceRenderer& renderer);
+	void draw(const GpuCuller& culler);
+	// Queues the readback and restores the previous framebuffer and viewport
+	void end(unsigned int tag);
+
+	// Oldest finished readback, if any; never waits
+	bool poll(Result& result);
+
+	unsigned int getPendingCount() const { return pendingCount; }
+};
+
+#endif // !PICKBUFFER_H
@@ -0,0 +1,95 @@
+#include "ProxyBox.h"
+
+unsigned int ProxyBox::VAO = 0;
+unsigned int ProxyBox::VBO = 0;
+unsigned int ProxyBox::EBO = 0;
+
+const glm::vec3 ProxyBox::BOUNDS_MIN(-0.5f, 0.0f, -0.5f);
+const glm::vec3 ProxyBox::BOUNDS_MAX(0.5f, 1.0f, 0.5f);
+
+void ProxyBox::setupMesh() {
+	// Four vertices per face so every face gets its own flat normal
+	const glm::vec3 normals[6] = {
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+		glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+		glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+	};
+
+	float vertices[6 * 4 * 6];
+	unsigned short indices[INDEX_COUNT];
+	for (int face = 0; face < 6; ++face) {
+		glm::vec3 n = normals[face];
+		glm::vec3 u = glm::vec3(n.y, n.z, n.x);
+		glm::vec3 v = glm::cross(n, u);
+		const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+		for (int corner = 0; corner < 4; ++corner) {
+			glm::vec3 p = (n + u * corners[corner][0] + v * corners[corner][1]) * 0.5f;
+			p.y += 0.5f;
+
+			float* target = vertices + (face * 4 + corner) * 6;
+			target[0] = p.x;
+			target[1] = p.y;
+			target[2] = p.z;
+			target[3] = n.x;
+			target[4] = n.y;
+			target[5] = n.z;
+		}
+
+		unsigned short base = (unsigned short)(face * 4);
+		const unsigned short quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; ++i) {
+			indices[face * 6 + i] = base + quad[i];
+		}
+	}
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	glBindVertexArray(0);
+}
+
+void ProxyBox::draw() {
+	if (VAO == 0) {
+		setupMesh();
+	}
+
+	glBindVertexArray(VAO);
+	glDrawElements(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_SHORT, 0);
+	glBindVertexArray(0);
+}
+
+void ProxyBox::drawInstanced(GLsizei instanceCount) {
+	glBindVertexArray(getVAO());
+	glDrawElementsInstanced(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_SHORT, 0, instanceCount);
+}
+
+unsigned int ProxyBox::getVAO() {
+	if (VAO == 0) {
+		setupMesh();
+	}
+	return VAO;
+}
+
+void ProxyBox::cleanup() {
+	if (VAO != 0) {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+}
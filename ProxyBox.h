@@ -0,0 +1,33 @@
+#pragma once
+#ifndef PROXYBOX_H
+#define PROXYBOX_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+using namespace std;
+
+// Placeholder drawn while an object's mesh is still loading. A unit box from
+// (-0.5, 0, -0.5) to (0.5, 1, 0.5) with float position (0) and normal (1)
+// attributes, so it works with the building and road shaders as they are.
+class ProxyBox {
+private:
+	static unsigned int VAO, VBO, EBO;
+
+	static void setupMesh();
+
+public:
+	static const glm::vec3 BOUNDS_MIN;
+	static const glm::vec3 BOUNDS_MAX;
+	// GL_UNSIGNED_SHORT indices in the element buffer of getVAO()
+	static const unsigned int INDEX_COUNT = 36;
+
+	static void draw();
+	// Instanced draw for InstanceRenderer; instance attributes must already
+	// be set up on getVAO(), which is left bound
+	static void drawInstanced(GLsizei instanceCount);
+	static unsigned int getVAO();
+	static void cleanup();
+};
+
+#endif // !PROXYBOX_H
@@ -0,0 +1,152 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+namespace {
+
+const unsigned int NAME_BITS = 12;
+const uint64_t NAME_MASK = (1u << NAME_BITS) - 1;
+const unsigned int DEPTH_BITS = 24;
+const uint64_t DEPTH_MASK = (1u << DEPTH_BITS) - 1;
+
+const unsigned int RADIX_BITS = 8;
+const unsigned int RADIX_BUCKETS = 1u << RADIX_BITS;
+
+}
+
+uint64_t RenderQueue::makeKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth) {
+	float normalized = min(max(depth / SORT_DEPTH_RANGE, 0.0f), 1.0f);
+	uint64_t quantizedDepth = (uint64_t)(normalized * DEPTH_MASK);
+	return ((uint64_t)pass << 60)
+		| ((program & NAME_MASK) << 48)
+		| ((texture & NAME_MASK) << 36)
+		| ((vao & NAME_MASK) << 24)
+		| quantizedDepth;
+}
+
+RenderQueue::RenderQueue() {
+	stats = {};
+}
+
+void RenderQueue::begin() {
+	packets.clear();
+}
+
+void RenderQueue::submit(const DrawPacket& packet) {
+	if (packet.drawer && packet.program) {
+		packets.push_back(packet);
+	}
+}
+
+void RenderQueue::sortPackets() {
+	order.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); ++i) {
+		order[i] = { packets[i].key, (unsigned int)i };
+	}
+	scratch.resize(order.size());
+
+	// LSD radix sort, 8 bits per pass. It is stable, so packets with equal
+	// keys keep their submission order. Digits every key shares (most of
+	// them: few programs, textures and VAOs) skip their pass.
+	for (unsigned int shift = 0; shift < 64; shift += RADIX_BITS) {
+		size_t counts[RADIX_BUCKETS] = {};
+		for (const SortEntry& entry : order) {
+			++counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)];
+		}
+		if (counts[(order[0].key >> shift) & (RADIX_BUCKETS - 1)] == order.size()) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (unsigned int bucket = 0; bucket < RADIX_BUCKETS; ++bucket) {
+			size_t count = counts[bucket];
+			counts[bucket] = offset;
+			offset += count;
+		}
+		for (const SortEntry& entry : order) {
+			scratch[counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+		}
+		order.swap(scratch);
+	}
+}
+
+void RenderQueue::execute() {
+	stats = {};
+	stats.packets = (unsigned int)packets.size();
+	if (packets.empty()) {
+		return;
+	}
+	sortPackets();
+
+	// Nothing is assumed about the state left by code outside the queue
+	const ShaderProgram* boundProgram = nullptr;
+	GLuint boundVAO = 0, boundTexture = 0;
+	bool vaoKnown = false, textureKnown = false, depthKnown = false;
+	GLenum depthFunc = GL_LESS;
+	bool depthWrite = true;
+
+	for (const SortEntry& entry : order) {
+		const DrawPacket& packet = packets[entry.packet];
+
+		if (packet.program != boundProgram) {
+			packet.program->use();
+			boundProgram = packet.program;
+			++stats.programBinds;
+		}
+		else {
+			++stats.skippedBinds;
+		}
+
+		if (packet.texture != 0) {
+			if (!textureKnown || packet.texture != boundTexture) {
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, packet.texture);
+				boundTexture = packet.texture;
+				textureKnown = true;
+				++stats.textureBinds;
+			}
+			else {
+				++stats.skippedBinds;
+			}
+		}
+
+		if (packet.vao != 0) {
+			if (!vaoKnown || packet.vao != boundVAO) {
+				glBindVertexArray(packet.vao);
+				boundVAO = packet.vao;
+				vaoKnown = true;
+				++stats.vaoBinds;
+			}
+			else {
+				++stats.skippedBinds;
+			}
+		}
+
+		if (!depthKnown || packet.depthFunc != depthFunc || packet.depthWrite != depthWrite) {
+			if (!depthKnown || packet.depthFunc != depthFunc) {
+				glDepthFunc(packet.depthFunc);
+			}
+			if (!depthKnown || packet.depthWrite != depthWrite) {
+				glDepthMask(packet.depthWrite ? GL_TRUE : GL_FALSE);
+			}
+			depthFunc = packet.depthFunc;
+			depthWrite = packet.depthWrite;
+			depthKnown = true;
+			++stats.depthStateChanges;
+		}
+
+		packet.drawer->drawPacket(packet.payload);
+
+		// Drawers without a packet VAO bind their own
+		if (packet.vao == 0) {
+			vaoKnown = false;
+		}
+	}
+
+	glBindVertexArray(0);
+	if (!depthKnown || depthFunc != GL_LESS) {
+		glDepthFunc(GL_LESS);
+	}
+	if (!depthKnown || !depthWrite) {
+		glDepthMask(GL_TRUE);
+	}
+}
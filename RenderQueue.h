@@ -0,0 +1,95 @@
+#pragma once
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include "ShaderProgram.h"
+
+using namespace std;
+
+// Passes run in this order; everything inside a pass is sorted by state
+enum class RenderPass : unsigned int {
+	WORLD = 0,     // Ground, buildings and roads
+	SKY = 1,       // At the far plane, only where the world left depth clear
+	DEPTH_PYRAMID = 2,   // HiZBuffer, from the world's depth alone
+	OVERLAY = 3    // Gizmo
+};
+
+// Implemented by everything that submits packets. drawPacket() is called
+// with the packet's program, VAO, texture and depth state already bound and
+// issues the draw itself, setting per-draw uniforms on the bound program.
+class PacketDrawer {
+public:
+	virtual ~PacketDrawer() {}
+	virtual void drawPacket(unsigned int payload) = 0;
+};
+
+struct DrawPacket {
+	uint64_t key;              // RenderQueue::makeKey()
+	ShaderProgram* program;
+	GLuint vao;                // 0 when the drawer binds its own
+	GLuint texture;            // GL_TEXTURE_2D on unit 0, 0 for none
+	GLenum depthFunc;
+	bool depthWrite;
+	PacketDrawer* drawer;
+	unsigned int payload;      // Passed back to drawPacket()
+};
+
+// Collects the frame's draws from every subsystem and executes them sorted
+// by a packed 64-bit key, so packets sharing a program, texture or VAO run
+// back to back. Bindings equal to the previous packet's are skipped.
+//
+// Key layout, most significant first:
+//   63-60 pass | 59-48 program | 47-36 texture | 35-24 VAO | 23-0 depth
+// GL names are truncated to 12 bits. A collision only costs a rebind, since
+// the executor compares the real names.
+//
+// Usage per frame: begin(), submit() from each subsystem, execute().
+class RenderQueue {
+public:
+	struct Stats {
+		unsigned int packets;
+		unsigned int programBinds;
+		unsigned int textureBinds;
+		unsigned int vaoBinds;
+		unsigned int depthStateChanges;
+		unsigned int skippedBinds;       // Redundant binds filtered out
+	};
+
+	// View distance mapped onto the depth bits; farther saturates
+	static constexpr float SORT_DEPTH_RANGE = 8000.0f;
+
+	static uint64_t makeKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth);
+
+private:
+	struct SortEntry {
+		uint64_t key;
+		unsigned int packet;
+	};
+
+	vector<DrawPacket> packets;
+	vector<SortEntry> order;
+	vector<SortEntry> scratch;
+	Stats stats;
+
+	void sortPackets();
+
+public:
+	RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	void begin();
+	void submit(const DrawPacket& packet);
+	// Sorts and draws everything submitted since begin(). Leaves depth at
+	// GL_LESS with writes on and no VAO bound.
+	void execute();
+
+	// Of the last execute()
+	const Stats& getStats() const { return stats; }
+};
+
+#endif // !RENDERQUEUE_H
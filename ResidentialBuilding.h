@@ -3,7 +3,7 @@
 #define RESIDENTIAL_BUILDING_H
 
 #include "Building.h"
-#include "OBJLoader.h"
+#include "MeshCache.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -11,23 +11,18 @@
 
 class ResidentialBuilding : public Building {
 private:
-    OBJLoader objModel;
-    unsigned int VAO, VBO;
     bool isInitialized;
     
-    void setupMesh();
     void cleanup();
 
 public:
     ResidentialBuilding(const glm::vec3& pos);
     ~ResidentialBuilding();
     
-    bool initialize();
+    bool initialize() override;
 
-    bool intersects(const glm::vec3& rayStart, const glm::vec3& rayDir) override;
-
-    void render(unsigned int shaderProgram, const glm::mat4& view, 
-               const glm::mat4& projection, const vec3& lightPos, const vec3& cameraPos) override;
+    glm::vec3 getColor() const override;
+    glm::vec3 getProxySize() const override;
 };
 
 #endif
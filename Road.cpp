@@ -1,10 +1,22 @@
 #include "Road.h"
+#include "ProxyBox.h"
+#include <algorithm>
+#include <cfloat>
 
 Road::Road(RoadType roadType, const string& objPath)
-	: type(roadType), modelPath(objPath), position(0.0f),
-	rotation(0.0f), scale(0.0f), selected(false) { }
+	: type(roadType), modelPath(objPath), lodLevel(0), spatialIndex(nullptr),
+	spatialId(SpatialGrid::INVALID_ITEM), indexedWithMesh(false), placementMatrix(1.0f),
+	modelMatrix(1.0f), inverseModelMatrix(1.0f), normalMatrix(1.0f), transformDirty(true),
+	dirtyList(nullptr), inDirtyList(false), position(0.0f), rotation(0.0f), scale(0.0f), selected(false) { }
 
-Road::~Road() {}
+Road::~Road() {
+	if (inDirtyList) {
+		dirtyList->erase(remove(dirtyList->begin(), dirtyList->end(), this), dirtyList->end());
+	}
+	if (spatialIndex) {
+		spatialIndex->remove(spatialId);
+	}
+}
 
 RoadType Road::getType() const {
 	return type;
@@ -12,4 +24,123 @@ RoadType Road::getType() const {
 
 const string& Road::getModelPath() const {
 	return modelPath;
-}
\ No newline at end of file
+}
+
+void Road::updateTransform() const {
+	placementMatrix = glm::translate(mat4(1.0f), position);
+	placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.x), vec3(1.0f, 0.0f, 0.0f));
+	placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.y), vec3(0.0f, 1.0f, 0.0f));
+	placementMatrix = glm::rotate(placementMatrix, glm::radians(rotation.z), vec3(0.0f, 0.0f, 1.0f));
+	modelMatrix = glm::scale(placementMatrix, scale);
+	inverseModelMatrix = glm::inverse(modelMatrix);
+	// Inverse transpose of the 3x3 part is the transposed 3x3 of the inverse
+	normalMatrix = glm::transpose(mat3(inverseModelMatrix));
+	transformDirty = false;
+}
+
+const mat4& Road::getPlacementMatrix() const {
+	if (transformDirty) {
+		updateTransform();
+	}
+	return placementMatrix;
+}
+
+const mat4& Road::getModelMatrix() const {
+	if (transformDirty) {
+		updateTransform();
+	}
+	return modelMatrix;
+}
+
+const mat4& Road::getInverseModelMatrix() const {
+	if (transformDirty) {
+		updateTransform();
+	}
+	return inverseModelMatrix;
+}
+
+const mat3& Road::getNormalMatrix() const {
+	if (transformDirty) {
+		updateTransform();
+	}
+	return normalMatrix;
+}
+
+BoundingBox Road::getWorldBounds() const {
+	// The placeholder box is always included: it is drawn and picked
+	// until the mesh is in
+	BoundingBox bounds = BoundingBox::fromAABB(ProxyBox::BOUNDS_MIN, ProxyBox::BOUNDS_MAX,
+		glm::scale(getPlacementMatrix(), getProxySize()));
+	if (mesh && mesh->isLoaded()) {
+		BoundingBox meshBounds = BoundingBox::fromAABB(mesh->getBoundsMin(), mesh->getBoundsMax(), getModelMatrix());
+		bounds.boundsMin = glm::min(bounds.boundsMin, meshBounds.boundsMin);
+		bounds.boundsMax = glm::max(bounds.boundsMax, meshBounds.boundsMax);
+	}
+	return bounds;
+}
+
+void Road::attachSpatialIndex(SpatialGrid* index) {
+	if (spatialIndex) {
+		spatialIndex->remove(spatialId);
+	}
+
+	spatialIndex = index;
+	spatialId = SpatialGrid::INVALID_ITEM;
+	if (spatialIndex) {
+		BoundingBox bounds = getWorldBounds();
+		spatialId = spatialIndex->insert(bounds.boundsMin, bounds.boundsMax, this);
+		indexedWithMesh = mesh && mesh->isLoaded();
+	}
+}
+
+void Road::transformChanged() {
+	transformDirty = true;
+	if (dirtyList && !inDirtyList) {
+		dirtyList->push_back(this);
+		inDirtyList = true;
+	}
+	updateSpatialIndex();
+}
+
+void Road::setDirtyList(vector<Road*>* list) {
+	if (inDirtyList) {
+		dirtyList->erase(remove(dirtyList->begin(), dirtyList->end(), this), dirtyList->end());
+		inDirtyList = false;
+	}
+	dirtyList = list;
+}
+
+void Road::updateSpatialIndex() {
+	if (spatialIndex) {
+		BoundingBox bounds = getWorldBounds();
+		spatialIndex->update(spatialId, bounds.boundsMin, bounds.boundsMax);
+		indexedWithMesh = mesh && mesh->isLoaded();
+	}
+}
+
+bool Road::raycast(const vec3& origin, const vec3& direction, float maxDistance, TriangleHit& hit) const {
+	// Test in model space; the ray parameter carries over unchanged
+	if (mesh && mesh->isLoaded() && mesh->getBvh()) {
+		const mat4& inverseModel = getInverseModelMatrix();
+		return mesh->getBvh()->intersect(vec3(inverseModel * vec4(origin, 1.0f)),
+			vec3(inverseModel * vec4(direction, 0.0f)), maxDistance, hit);
+	}
+
+	mat4 inverseProxy = glm::inverse(glm::scale(getPlacementMatrix(), getProxySize()));
+	float distance;
+	if (!SpatialGrid::rayIntersectsAABB(vec3(inverseProxy * vec4(origin, 1.0f)),
+		vec3(inverseProxy * vec4(direction, 0.0f)), ProxyBox::BOUNDS_MIN, ProxyBox::BOUNDS_MAX,
+		maxDistance, distance)) {
+		return false;
+	}
+	hit.distance = distance;
+	hit.triangle = TriangleBvh::NO_TRIANGLE;
+	hit.u = 0.0f;
+	hit.v = 0.0f;
+	return true;
+}
+
+bool Road::intersects(const vec3& rayStart, const vec3& rayDir) const {
+	TriangleHit hit;
+	return raycast(rayStart, glm::normalize(rayDir), FLT_MAX, hit);
+}
@@ -7,6 +7,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
 #include "BuildingTypes.h"
+#include "Mesh.h"
+#include "SpatialGrid.h"
 
 using namespace glm;
 using namespace std;
@@ -15,6 +17,20 @@ class Road {
 protected:
 	RoadType type;
 	string modelPath;
+	MeshHandle mesh;
+	unsigned int lodLevel;
+	SpatialGrid* spatialIndex;
+	SpatialGrid::ItemId spatialId;
+	bool indexedWithMesh;
+	// World transform, rebuilt on first use after a change
+	mutable mat4 placementMatrix, modelMatrix, inverseModelMatrix;
+	mutable mat3 normalMatrix;
+	mutable bool transformDirty;
+	// RoadManager's list of moved roads, see setDirtyList()
+	vector<Road*>* dirtyList;
+	bool inDirtyList;
+
+	void updateTransform() const;
 
 public:
 	vec3 position, rotation, scale;
@@ -26,18 +42,61 @@ public:
 
 	RoadType getType() const;
 	const string& getModelPath() const;
+	const MeshHandle& getMesh() const { return mesh; }
+
+	// Translation * rotation (X, Y, Z) * scale. The matrices are cached and
+	// only rebuilt after transformChanged().
+	const mat4& getModelMatrix() const;
+	const mat4& getInverseModelMatrix() const;
+	// Inverse transpose of the model matrix's 3x3 part, for normals
+	const mat3& getNormalMatrix() const;
+	// Translation * rotation, for geometry that brings its own size
+	const mat4& getPlacementMatrix() const;
+
+	// Level of detail chosen by RoadManager for the next draw
+	unsigned int getLodLevel() const { return lodLevel; }
+	void setLodLevel(unsigned int lod) { lodLevel = lod; }
+
+	// World-space AABB of the placeholder box and, once loaded, the mesh
+	BoundingBox getWorldBounds() const;
+
+	// Entry in RoadManager's spatial index. The setters keep it current; direct
+	// writes to position/rotation/scale must be followed by transformChanged().
+	void attachSpatialIndex(SpatialGrid* index);
+	void updateSpatialIndex();
+	// Invalidates the cached matrices, moves the index entry and queues the
+	// road on its dirty list; the setters call it
+	void transformChanged();
+
+	// transformChanged() appends the road to list once, until the owner
+	// takes it off with dequeueDirty()
+	void setDirtyList(vector<Road*>* list);
+	void dequeueDirty() { inDirtyList = false; }
+	SpatialGrid::ItemId getSpatialId() const { return spatialId; }
+	// False while the index still holds the placeholder box
+	bool isIndexedWithMesh() const { return indexedWithMesh; }
+
+	// Nearest hit on the mesh triangles, or on the placeholder box (with
+	// triangle NO_TRIANGLE) until the mesh is in. direction must be
+	// normalized; hit.distance is then in world units.
+	bool raycast(const vec3& origin, const vec3& direction, float maxDistance, TriangleHit& hit) const;
+	bool intersects(const vec3& rayStart, const vec3& rayDir) const;
+
+	// Acquires the shared mesh; RoadManager calls it before drawing
+	virtual bool initialize() = 0;
 
-	bool virtual intersects(const vec3& rayStart, const vec3& rayDir) = 0;
+	// Tint passed to the shader with each instance
+	virtual vec3 getColor() const = 0;
 
-	virtual void render(unsigned int shaderProgram, const mat4& view,
-		const mat4& projection, const vec3& lightPos, const vec3& cameraPos) = 0;
+	// Size of the box drawn while the mesh is still loading
+	virtual vec3 getProxySize() const = 0;
 
 	virtual vec3 getPosition() { return position; }
-	virtual void setPosition(const vec3 &pos) { position = pos; }
+	virtual void setPosition(const vec3 &pos) { position = pos; transformChanged(); }
 	virtual vec3 getRotation() { return rotation; }
-	virtual void setRotation(const vec3 &rot) { rotation = rot; }
+	virtual void setRotation(const vec3 &rot) { rotation = rot; transformChanged(); }
 	virtual vec3 getScale() { return scale; }
-	virtual void setScale(const vec3& scl) { scale = scl; }
+	virtual void setScale(const vec3& scl) { scale = scl; transformChanged(); }
 
 };
 
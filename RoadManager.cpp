@@ -1,62 +1,29 @@
 #include "RoadManager.h"
-#include <iostream>
 
 using namespace std;
 
-void RoadManager::setupShaderProgram() {
-	shaderProgram = shaderProgramCreator.createShaderProgram("shaders/vertex/RoadVertexShader.glsl",
-		"shaders/fragment/RoadFragmentShader.glsl");
-}
-
-RoadManager::RoadManager() {}
-
-void RoadManager::init() {
-	setupShaderProgram();
-}
+RoadManager::RoadManager()
+	: SceneManager<Road>(PICK_LAYER, "roads",
+		"shaders/vertex/RoadVertexShader.glsl", "shaders/fragment/RoadFragmentShader.glsl") {}
 
 RoadManager::~RoadManager() {}
 
-Road* RoadManager::selectRoad(const vec3& rayStart, const vec3& rayDir) {
-	selectedRoad = nullptr;
-	for (auto& road : roads) {
-		road->selected = false;
-		if (road->intersects(rayStart, rayDir)) {
-			selectedRoad = road.get();
-			road->selected = true;
-			break;
-		}
-	}
-	return selectedRoad;
-}
-
-Road* RoadManager::getSelectedRoad() {
-	return selectedRoad;
-}
-
-Road* RoadManager::checkRoadSelection(const vec3& rayStart, const vec3& rayDir) {
-	for (auto& road : roads) {
-		if (road && road->intersects(rayStart, rayDir)) {
-			return road.get();
-		}
-	}
-	return nullptr;
-}
-
-void RoadManager::clearSelection() {
-	if (selectedRoad) {
-		selectedRoad->selected = false;
-		selectedRoad = nullptr;
-	}
+Road *RoadManager::selectRoad(const vec3& rayStart, const vec3& rayDir) {
+	selectRoad(checkRoadSelection(rayStart, rayDir));
+	return selected;
 }
 
-void RoadManager::addRoad(unique_ptr<Road> road) {
-	roads.push_back(move(road));
+Road* RoadManager::checkRoadSelection(const glm::vec3& rayStart, const glm::vec3& rayDir) {
+	RoadHit hit;
+	return raycast(rayStart, rayDir, hit) ? hit.road : nullptr;
 }
 
-void RoadManager::renderObjects(const mat4& view, const mat4& projection, const vec3& lightPos, const vec3& cameraPos) {
-	for (auto& road : roads) {
-		if (road) {
-			road->render(shaderProgram, view, projection, lightPos, cameraPos);
-		}
-	}
+bool RoadManager::raycast(const vec3& rayStart, const vec3& rayDir, RoadHit& hit) {
+	Hit found = {};
+	bool hitAny = raycastObjects(rayStart, rayDir, found);
+	hit.road = found.object;
+	hit.point = found.point;
+	hit.distance = found.distance;
+	hit.triangle = found.triangle;
+	return hitAny;
 }
\ No newline at end of file
@@ -9,38 +9,48 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "Road.h"
-#include "ShaderProgramCreator.h"
+#include "SceneManager.h"
 
 using namespace std;
 
-class RoadManager {
-protected:
-	vector<unique_ptr<Road>> roads;
-	ShaderProgramCreator shaderProgramCreator;
-	GLuint shaderProgram;
-	Road* selectedRoad = nullptr;
-
-	void setupShaderProgram();
+// Nearest road along a picking ray
+struct RoadHit {
+	Road* road;
+	vec3 point;
+	float distance;
+	unsigned int triangle;   // TriangleBvh::NO_TRIANGLE when the placeholder box was hit
+};
 
+// The city's roads; drawing, culling and the spatial index are shared
+// with ObjectManager through SceneManager
+class RoadManager : public SceneManager<Road> {
 public:
 	RoadManager();
 
-	void init();
-	
 	virtual ~RoadManager();
 
-	Road *selectRoad(const vec3& rayStart, const vec3& rayDir);
+	Road *selectRoad(const vec3 &rayStart, const vec3 &rayDir);
+
+	Road* getSelectedRoad() { return selected; }
 
-	Road *getSelectedRoad();
+	// Selects a road found by other means, e.g. GPU picking; null clears
+	void selectRoad(Road* road) { select(road); }
 
-	Road* checkRoadSelection(const vec3& rayStart, const vec3& rayDir);
+	// PickBuffer ids of the roads drawn by renderObjects
+	static const unsigned int PICK_LAYER = 2;
+	Road* getRoadByPickId(unsigned int pickId) const { return getByPickId(pickId); }
 
-	void clearSelection();
+	// Drawn with a light highlight; null for none
+	void setHoveredRoad(Road* road) { hovered = road; }
+	Road* getHoveredRoad() const { return hovered; }
 
-	void addRoad(unique_ptr<Road> road);
+	Road* checkRoadSelection(const glm::vec3& rayStart, const glm::vec3& rayDir);
 
-	virtual void renderObjects(const mat4 &view, const mat4 &projection, const vec3& lightPos, const vec3& cameraPos);
+	// Closest road whose triangles the ray hits, with the hit point and
+	// triangle; false when nothing is hit
+	bool raycast(const vec3& rayStart, const vec3& rayDir, RoadHit& hit);
 
+	void addRoad(unique_ptr<Road> road) { add(move(road)); }
 };
 
 #endif // !ROADMANAGER_H
@@ -0,0 +1,374 @@
+#include "SceneManager.h"
+#include "Building.h"
+#include "Road.h"
+#include "FrameUniforms.h"
+#include "LodSelector.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+	// Picking rays stop at the far plane
+	const float PICK_DISTANCE = 8000.0f;
+}
+
+template <typename Object>
+void SceneManager<Object>::setupShaderProgram() {
+	shader.load(vertexShaderPath, fragmentShaderPath);
+	FrameUniforms::attach(shader);
+	shader.use();
+	TransformBuffer::attach(shader);
+}
+
+template <typename Object>
+SceneManager<Object>::SceneManager(unsigned int pickLayer, const char* objectName,
+	const char* vertexShaderPath, const char* fragmentShaderPath)
+	: visibleCount(0), occludedCount(0), pickLayer(pickLayer), objectName(objectName),
+	vertexShaderPath(vertexShaderPath), fragmentShaderPath(fragmentShaderPath), cpuCulledDirty(true) {}
+
+template <typename Object>
+void SceneManager<Object>::init() {
+	setupShaderProgram();
+	transforms.init();
+	instanceRenderer.init(shader, transforms);
+}
+
+template <typename Object>
+void SceneManager<Object>::cleanup() {
+	gpuCuller.cleanup();
+	instanceRenderer.cleanup();
+	transforms.cleanup();
+	shader.cleanup();
+}
+
+template <typename Object>
+SceneManager<Object>::~SceneManager() {}
+
+template <typename Object>
+void SceneManager<Object>::select(Object* object) {
+	clearSelection();
+	selected = object;
+	if (selected) {
+		selected->selected = true;
+	}
+}
+
+template <typename Object>
+Object* SceneManager<Object>::getByPickId(unsigned int pickId) const {
+	// The object may have gone away since the id was drawn
+	if (PickBuffer::getLayer(pickId) != pickLayer || !grid.contains(PickBuffer::getIndex(pickId))) {
+		return nullptr;
+	}
+	return static_cast<Object*>(grid.getUserData(PickBuffer::getIndex(pickId)));
+}
+
+template <typename Object>
+bool SceneManager<Object>::raycastObjects(const vec3& rayStart, const vec3& rayDir, Hit& hit) {
+	vec3 direction = glm::normalize(rayDir);
+	hit.object = nullptr;
+	hit.distance = PICK_DISTANCE;
+	hit.triangle = TriangleBvh::NO_TRIANGLE;
+
+	// Candidate boxes come nearest first, so once a box starts beyond the
+	// best hit so far nothing after it can be closer
+	rayHits.clear();
+	grid.queryRay(rayStart, direction, PICK_DISTANCE, rayHits);
+	for (const SpatialGrid::RayHit& boxHit : rayHits) {
+		if (boxHit.distance > hit.distance) {
+			break;
+		}
+
+		Object* candidate = static_cast<Object*>(grid.getUserData(boxHit.item));
+		TriangleHit triangleHit;
+		if (candidate->raycast(rayStart, direction, hit.distance, triangleHit)) {
+			hit.object = candidate;
+			hit.distance = triangleHit.distance;
+			hit.triangle = triangleHit.triangle;
+		}
+	}
+
+	if (!hit.object) {
+		return false;
+	}
+	hit.point = rayStart + direction * hit.distance;
+	return true;
+}
+
+template <typename Object>
+void SceneManager<Object>::clearSelection() {
+	if (selected) {
+		selected->selected = false;
+		selected = nullptr;
+	}
+}
+
+template <typename Object>
+void SceneManager<Object>::add(unique_ptr<Object> object) {
+	if (!object) {
+		return;
+	}
+
+	// The mesh is requested now so its bounds can replace the placeholder
+	// box as soon as it is in
+	object->initialize();
+	object->setDirtyList(&dirtyObjects);
+	object->attachSpatialIndex(&grid);
+	object->transformChanged();
+	if (!object->isIndexedWithMesh()) {
+		pendingBounds.push_back(object.get());
+	}
+	objects.push_back(move(object));
+}
+
+template <typename Object>
+void SceneManager<Object>::setOcclusionBuffer(const HiZBuffer* buffer) {
+	occlusion = buffer;
+	gpuCuller.setOcclusionBuffer(buffer);
+}
+
+template <typename Object>
+void SceneManager<Object>::setStreamBuffer(StreamBuffer* buffer) {
+	transforms.setStreamBuffer(buffer);
+	instanceRenderer.setStreamBuffer(buffer);
+	gpuCuller.setStreamBuffer(buffer);
+}
+
+template <typename Object>
+bool SceneManager<Object>::enableGpuCulling() {
+	if (!gpuCuller.init(shader, transforms)) {
+		return false;
+	}
+	for (auto& object : objects) {
+		updateCullRecord(object.get());
+	}
+	culledSelected = selected;
+	culledHovered = hovered;
+	cpuCulledDirty = true;
+	return true;
+}
+
+template <typename Object>
+void SceneManager<Object>::updateCullRecord(Object* object) {
+	SpatialGrid::ItemId item = object->getSpatialId();
+	bool wasCulled = gpuCuller.contains(item);
+
+	const MeshHandle& mesh = object->getMesh();
+	if (mesh && mesh->isLoaded() && mesh->isPooled()) {
+		BoundingSphere sphere = BoundingSphere::fromAABB(mesh->getBoundsMin(), mesh->getBoundsMax(), object->getModelMatrix());
+		gpuCuller.set(item, mesh.get(), object->getWorldBounds(), sphere, object->getColor(),
+			object->selected, object == hovered, PickBuffer::makeId(pickLayer, item));
+	}
+	else {
+		gpuCuller.remove(item);
+	}
+
+	if (gpuCuller.contains(item) != wasCulled) {
+		cpuCulledDirty = true;
+	}
+}
+
+template <typename Object>
+bool SceneManager<Object>::addInstance(Object* object, const mat4& view, const mat4& projection, float viewportHeight) {
+	const MeshHandle& mesh = object->getMesh();
+	if (!mesh || mesh->isFailed()) {
+		return false; // Reported by the loader
+	}
+	SpatialGrid::ItemId item = object->getSpatialId();
+	unsigned int pickId = PickBuffer::makeId(pickLayer, item);
+
+	if (!mesh->isLoaded()) {
+		// The slot holds the stand-in box until the mesh is uploaded
+		instanceRenderer.add(nullptr, 0, item, object->getColor(), object->selected,
+			object == hovered, pickId);
+		return true;
+	}
+
+	// Level of detail from the projected size
+	float screenSize = LodSelector::getScreenSize(*mesh, object->getModelMatrix(), view, projection, viewportHeight);
+	object->setLodLevel(LodSelector::select(*mesh, screenSize, object->getLodLevel()));
+	instanceRenderer.add(mesh.get(), object->getLodLevel(), item, object->getColor(),
+		object->selected, object == hovered, pickId);
+	return true;
+}
+
+template <typename Object>
+void SceneManager<Object>::renderObjects(const mat4& view, const mat4& projection, RenderQueue& queue) {
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Swap placeholder boxes for mesh bounds as meshes come in
+	size_t pending = 0;
+	for (Object* object : pendingBounds) {
+		if (!object->initialize()) {
+			continue; // Reported by initialize()
+		}
+
+		const MeshHandle& mesh = object->getMesh();
+		if (mesh->isLoaded()) {
+			// Bounds and the drawn matrix both switch from the box to the mesh
+			object->transformChanged();
+		}
+		else if (!mesh->isFailed()) {
+			pendingBounds[pending++] = object;
+		}
+	}
+	pendingBounds.resize(pending);
+
+	// Only objects that moved (or got their mesh) since the last frame
+	// rewrite their slot
+	for (Object* object : dirtyObjects) {
+		object->dequeueDirty();
+		if (!object->getMesh()) {
+			continue;
+		}
+		if (object->getMesh()->isLoaded()) {
+			transforms.set(object->getSpatialId(), object->getModelMatrix(), object->getNormalMatrix());
+		}
+		else {
+			// Stand-in box of roughly the model's footprint until the mesh is uploaded
+			mat4 proxyModel = glm::scale(object->getPlacementMatrix(), object->getProxySize());
+			transforms.set(object->getSpatialId(), proxyModel, TransformBuffer::computeNormalMatrix(proxyModel));
+		}
+		if (gpuCuller.isValid()) {
+			updateCullRecord(object);
+		}
+	}
+	dirtyObjects.clear();
+	transforms.upload();
+
+	if (gpuCuller.isValid()) {
+		renderGpuCulled(view, projection, (float)viewport[3], queue);
+		return;
+	}
+
+	visibleItems.clear();
+	grid.queryFrustum(Frustum(projection * view), visibleItems);
+
+	instanceRenderer.begin();
+	visibleCount = 0;
+	occludedCount = 0;
+	for (SpatialGrid::ItemId item : visibleItems) {
+		Object* object = static_cast<Object*>(grid.getUserData(item));
+		if (occlusion && occlusion->isOccluded(object->getWorldBounds())) {
+			++occludedCount;
+			continue;
+		}
+		if (addInstance(object, view, projection, (float)viewport[3])) {
+			++visibleCount;
+		}
+	}
+	instanceRenderer.flush(queue);
+}
+
+template <typename Object>
+void SceneManager<Object>::renderGpuCulled(const mat4& view, const mat4& projection, float viewportHeight, RenderQueue& queue) {
+	// Highlight changes rewrite the records of the objects involved
+	if (selected != culledSelected || hovered != culledHovered) {
+		for (Object* object : { culledSelected, culledHovered, selected, hovered }) {
+			if (object) {
+				updateCullRecord(object);
+			}
+		}
+		culledSelected = selected;
+		culledHovered = hovered;
+	}
+
+	if (cpuCulledDirty) {
+		cpuCulledDirty = false;
+		cpuCulled.clear();
+		for (auto& object : objects) {
+			if (!gpuCuller.contains(object->getSpatialId())) {
+				cpuCulled.push_back(object.get());
+			}
+		}
+	}
+
+	// The few the GPU can't draw go through the instance renderer as before
+	cpuCuller.begin();
+	for (Object* object : cpuCulled) {
+		BoundingBox bounds = object->getWorldBounds();
+		cpuCuller.add(bounds.boundsMin, bounds.boundsMax);
+	}
+	cpuCuller.cull(Frustum(projection * view));
+
+	instanceRenderer.begin();
+	visibleCount = 0;
+	occludedCount = 0;
+	for (size_t i = 0; i < cpuCulled.size(); ++i) {
+		if (!cpuCuller.isVisible(i)) {
+			continue;
+		}
+		Object* object = cpuCulled[i];
+		BoundingBox bounds = object->getWorldBounds();
+		if (occlusion && occlusion->isOccluded(bounds)) {
+			++occludedCount;
+			continue;
+		}
+		if (addInstance(object, view, projection, viewportHeight)) {
+			++visibleCount;
+		}
+	}
+	instanceRenderer.flush(queue);
+
+	gpuCuller.cull(view, projection, viewportHeight, queue);
+	visibleCount += gpuCuller.getVisibleCount();
+	occludedCount += gpuCuller.getOccludedCount();
+}
+
+template <typename Object>
+size_t SceneManager<Object>::checkGpuCulling(const mat4& view, const mat4& projection) {
+	if (!gpuCuller.isValid()) {
+		return 0;
+	}
+	gpuCuller.readVisibleSlots(gpuVisibleSlots);
+
+	// Every object the GPU has a record for, boxes tested whole as the
+	// compute shader does; the grid's query would also drop boxes whose
+	// cells all fail the test
+	cpuCuller.begin();
+	visibleItems.clear();
+	for (auto& object : objects) {
+		if (gpuCuller.contains(object->getSpatialId())) {
+			BoundingBox bounds = object->getWorldBounds();
+			cpuCuller.add(bounds.boundsMin, bounds.boundsMax);
+			visibleItems.push_back(object->getSpatialId());
+		}
+	}
+	cpuCuller.cull(Frustum(projection * view));
+	size_t expected = 0;
+	for (size_t i = 0; i < visibleItems.size(); ++i) {
+		if (cpuCuller.isVisible(i)) {
+			visibleItems[expected++] = visibleItems[i];
+		}
+	}
+	visibleItems.resize(expected);
+
+	sort(visibleItems.begin(), visibleItems.end());
+	sort(gpuVisibleSlots.begin(), gpuVisibleSlots.end());
+	size_t matching = 0;
+	size_t i = 0, j = 0;
+	while (i < visibleItems.size() && j < gpuVisibleSlots.size()) {
+		if (visibleItems[i] < gpuVisibleSlots[j]) {
+			++i;
+		}
+		else if (gpuVisibleSlots[j] < visibleItems[i]) {
+			++j;
+		}
+		else {
+			++matching;
+			++i;
+			++j;
+		}
+	}
+
+	size_t mismatches = visibleItems.size() + gpuVisibleSlots.size() - 2 * matching;
+	if (mismatches > 0) {
+		cerr << "GPU culling: " << objectName << " visible on the CPU " << visibleItems.size() << ", on the GPU "
+			<< gpuVisibleSlots.size() << ", " << mismatches << " differ" << endl;
+	}
+	return mismatches;
+}
+
+template class SceneManager<Building>;
+template class SceneManager<Road>;
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef SCENEMANAGER_H
+#define SCENEMANAGER_H
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ShaderProgram.h"
+#include "InstanceRenderer.h"
+#include "RenderQueue.h"
+#include "TransformBuffer.h"
+#include "GpuCuller.h"
+#include "HiZBuffer.h"
+#include "StreamBuffer.h"
+#include "Frustum.h"
+#include "SpatialGrid.h"
+#include "PickBuffer.h"
+
+using namespace std;
+using namespace glm;
+
+// Placed objects of one kind (Building for ObjectManager, Road for
+// RoadManager): spatial index, transform slots, culling, level of detail,
+// instanced and GPU-culled drawing, picking and selection. Object must have
+// the interface the two share (getMesh(), getSpatialId(), getWorldBounds(),
+// raycast(), setDirtyList(), ...).
+//
+// Explicitly instantiated in SceneManager.cpp for Building and Road.
+template <typename Object>
+class SceneManager {
+public:
+	// Nearest object along a picking ray
+	struct Hit {
+		Object* object;
+		vec3 point;
+		float distance;
+		unsigned int triangle;   // TriangleBvh::NO_TRIANGLE when the placeholder box was hit
+	};
+
+protected:
+	// Declared first so they outlive the objects that unlink from them
+	SpatialGrid grid;
+	vector<Object*> dirtyObjects;
+	vector<unique_ptr<Object>> objects;
+	ShaderProgram shader;
+	// World transforms by grid item id
+	TransformBuffer transforms;
+	InstanceRenderer instanceRenderer;
+	// Objects whose index entry is still the placeholder box
+	vector<Object*> pendingBounds;
+	// Per-frame scratch
+	vector<SpatialGrid::ItemId> visibleItems;
+	vector<SpatialGrid::RayHit> rayHits;
+	size_t visibleCount;
+	size_t occludedCount;
+	// Depth pyramid of an earlier frame, see setOcclusionBuffer()
+	const HiZBuffer* occlusion = nullptr;
+	Object* selected = nullptr;
+	Object* hovered = nullptr;
+
+	// Set by the derived manager: PickBuffer layer of the ids drawn, the
+	// plural noun for messages and the shader the objects are drawn with
+	unsigned int pickLayer;
+	const char* objectName;
+	const char* vertexShaderPath;
+	const char* fragmentShaderPath;
+
+	// Optional culling on the GPU, see enableGpuCulling()
+	GpuCuller gpuCuller;
+	// Objects the GpuCuller has no record for (stand-in boxes, meshes
+	// outside the pool); rebuilt when one gains or loses its record
+	vector<Object*> cpuCulled;
+	bool cpuCulledDirty;
+	FrustumCuller cpuCuller;
+	// Highlights the GpuCuller's records were last written with
+	Object* culledSelected = nullptr;
+	Object* culledHovered = nullptr;
+	vector<unsigned int> gpuVisibleSlots;
+
+	void setupShaderProgram();
+	// Queues one object on the instance renderer; false when it has nothing to draw
+	bool addInstance(Object* object, const mat4& view, const mat4& projection, float viewportHeight);
+	void updateCullRecord(Object* object);
+	void renderGpuCulled(const mat4& view, const mat4& projection, float viewportHeight, RenderQueue& queue);
+
+	SceneManager(unsigned int pickLayer, const char* objectName, const char* vertexShaderPath, const char* fragmentShaderPath);
+
+	// Takes ownership and indexes the object
+	void add(unique_ptr<Object> object);
+
+	// Selects an object found by other means, e.g. GPU picking; null clears
+	void select(Object* object);
+	// Null when pickId is of another layer or the object has gone away
+	Object* getByPickId(unsigned int pickId) const;
+
+	// Closest object whose triangles the ray hits, with the hit point and
+	// triangle; false when nothing is hit
+	bool raycastObjects(const vec3& rayStart, const vec3& rayDir, Hit& hit);
+
+public:
+	SceneManager(const SceneManager&) = delete;
+	SceneManager& operator=(const SceneManager&) = delete;
+
+	void init();
+
+	// Releases GL resources; call before the context is destroyed
+	void cleanup();
+
+	virtual ~SceneManager();
+
+	void clearSelection();
+
+	// Moves frustum culling and level of detail selection of pooled meshes
+	// to a compute shader (GpuCuller). False, leaving everything on the
+	// CPU, without GL 4.3 or a MeshPool. Call after init().
+	bool enableGpuCulling();
+	bool isGpuCulling() const { return gpuCuller.isValid(); }
+
+	// Objects the buffer shows hidden behind what was drawn are skipped,
+	// on the CPU and GPU paths alike; null turns occlusion culling off
+	void setOcclusionBuffer(const HiZBuffer* buffer);
+
+	// Transform updates, instances and culling uniforms stream through
+	// buffer, which must outlive the manager; null uploads them directly
+	void setStreamBuffer(StreamBuffer* buffer);
+
+	// Queues the visible objects on queue; they are drawn when it executes.
+	// Camera and lighting come from the FrameUniforms block; view and
+	// projection are only used to cull and pick levels of detail.
+	virtual void renderObjects(const mat4& view, const mat4& projection, RenderQueue& queue);
+
+	// Draw statistics of the last renderObjects call
+	const InstanceRenderer& getInstanceRenderer() const { return instanceRenderer; }
+	const GpuCuller& getGpuCuller() const { return gpuCuller; }
+	const TransformBuffer& getTransformBuffer() const { return transforms; }
+	// With GPU culling the GPU's share of the count is a few frames old
+	size_t getVisibleCount() const { return visibleCount; }
+	// Inside the frustum but occluded; also part of the culled count
+	size_t getOccludedCount() const { return occludedCount; }
+	size_t getCulledCount() const { return visibleCount < objects.size() ? objects.size() - visibleCount : 0; }
+	unsigned int getDrawCallCount() const { return instanceRenderer.getDrawCallCount() + gpuCuller.getDrawCallCount(); }
+
+	// Reads back the GpuCuller's visible set of the last renderObjects call
+	// and compares it with a CPU frustum test of every object it has a
+	// record for, same view; mismatches are reported on cerr and counted.
+	// Stalls on the GPU and tests every object, so it is a debugging aid
+	// (--check-gpu-culling).
+	size_t checkGpuCulling(const mat4& view, const mat4& projection);
+
+	// Shared with anything that needs to find objects by location
+	const SpatialGrid& getSpatialIndex() const { return grid; }
+};
+
+#endif // !SCENEMANAGER_H
@@ -0,0 +1,202 @@
+#include "ShaderProgram.h"
+#include "ShaderProgramCreator.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/type_ptr.hpp>
+
+ShaderProgram::ShaderProgram()
+	: program(0), uploads(0), skippedUploads(0) {}
+
+ShaderProgram::~ShaderProgram() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool ShaderProgram::load(const char* vertPath, const char* fragPath) {
+	ShaderProgramCreator creator;
+	GLuint linked = creator.createShaderProgram(vertPath, fragPath);
+	if (!attach(linked)) {
+		cerr << "Failed to create shader program from " << vertPath << " and " << fragPath << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ShaderProgram::loadCompute(const char* compPath) {
+	ShaderProgramCreator creator;
+	GLuint linked = creator.createComputeProgram(compPath);
+	if (!attach(linked)) {
+		cerr << "Failed to create compute program from " << compPath << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ShaderProgram::attach(GLuint linkedProgram) {
+	cleanup();
+	if (linkedProgram == 0) {
+		return false;
+	}
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(linkedProgram, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetProgramiv(linkedProgram, GL_INFO_LOG_LENGTH, &length);
+		string log(max(length, 1), '\0');
+		glGetProgramInfoLog(linkedProgram, length, nullptr, &log[0]);
+		cerr << "Shader program linking failed: " << log.c_str() << endl;
+		glDeleteProgram(linkedProgram);
+		return false;
+	}
+
+	program = linkedProgram;
+	reflect();
+	return true;
+}
+
+void ShaderProgram::cleanup() {
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+	uniforms.clear();
+	attributes.clear();
+	uploads = 0;
+	skippedUploads = 0;
+}
+
+void ShaderProgram::reflect() {
+	GLint count = 0, maxLength = 0;
+	vector<char> name;
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	name.resize(max(maxLength, 1));
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		Uniform uniform;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &uniform.arraySize, &uniform.type, name.data());
+		uniform.name.assign(name.data(), length);
+		uniform.location = glGetUniformLocation(program, uniform.name.c_str());
+		if (uniform.location < 0) {
+			continue; // Uniform block member, set through its buffer
+		}
+
+		// Arrays are reported as "name[0]"
+		if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0) {
+			uniform.name.erase(uniform.name.size() - 3);
+		}
+		uniform.hasValue = false;
+		uniforms.push_back(uniform);
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	name.resize(max(maxLength, 1));
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		Attribute attribute;
+		glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), &length, &attribute.arraySize, &attribute.type, name.data());
+		attribute.name.assign(name.data(), length);
+		attribute.location = glGetAttribLocation(program, attribute.name.c_str());
+		attributes.push_back(attribute);
+	}
+
+	sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) { return a.name < b.name; });
+	sort(attributes.begin(), attributes.end(), [](const Attribute& a, const Attribute& b) { return a.name < b.name; });
+}
+
+void ShaderProgram::use() const {
+	glUseProgram(program);
+}
+
+UniformHandle ShaderProgram::getUniform(const string& name) const {
+	auto it = lower_bound(uniforms.begin(), uniforms.end(), name,
+		[](const Uniform& uniform, const string& key) { return uniform.name < key; });
+	if (it == uniforms.end() || it->name != name) {
+		return INVALID_UNIFORM;
+	}
+	return (UniformHandle)(it - uniforms.begin());
+}
+
+GLint ShaderProgram::getAttributeLocation(const string& name) const {
+	auto it = lower_bound(attributes.begin(), attributes.end(), name,
+		[](const Attribute& attribute, const string& key) { return attribute.name < key; });
+	if (it == attributes.end() || it->name != name) {
+		return -1;
+	}
+	return it->location;
+}
+
+bool ShaderProgram::bindUniformBlock(const string& name, GLuint binding) {
+	if (program == 0) {
+		return false;
+	}
+
+	GLuint index = glGetUniformBlockIndex(program, name.c_str());
+	if (index == GL_INVALID_INDEX) {
+		return false;
+	}
+	glUniformBlockBinding(program, index, binding);
+	return true;
+}
+
+bool ShaderProgram::changed(UniformHandle handle, const void* value, size_t bytes) {
+	if (handle < 0 || (size_t)handle >= uniforms.size()) {
+		return false;
+	}
+
+	Uniform& uniform = uniforms[handle];
+	if (uniform.hasValue && memcmp(uniform.value, value, bytes) == 0) {
+		++skippedUploads;
+		return false;
+	}
+
+	memcpy(uniform.value, value, bytes);
+	uniform.hasValue = true;
+	++uploads;
+	return true;
+}
+
+void ShaderProgram::set(UniformHandle handle, int value) {
+	if (changed(handle, &value, sizeof(value))) {
+		glUniform1i(uniforms[handle].location, value);
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, float value) {
+	if (changed(handle, &value, sizeof(value))) {
+		glUniform1f(uniforms[handle].location, value);
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec2& value) {
+	if (changed(handle, glm::value_ptr(value), sizeof(value))) {
+		glUniform2fv(uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec3& value) {
+	if (changed(handle, glm::value_ptr(value), sizeof(value))) {
+		glUniform3fv(uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::vec4& value) {
+	if (changed(handle, glm::value_ptr(value), sizeof(value))) {
+		glUniform4fv(uniforms[handle].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat3& value) {
+	if (changed(handle, glm::value_ptr(value), sizeof(value))) {
+		glUniformMatrix3fv(uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(UniformHandle handle, const glm::mat4& value) {
+	if (changed(handle, glm::value_ptr(value), sizeof(value))) {
+		glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Index into a program's uniform table. INVALID_UNIFORM stands for a name
+// that is not an active uniform (the linker drops unused ones); setting it
+// is a no-op, like glUniform* with location -1.
+typedef int UniformHandle;
+const UniformHandle INVALID_UNIFORM = -1;
+
+// Linked GL program with its active uniforms and attributes reflected at
+// link time. Renderers resolve UniformHandles once during setup, so setting
+// a uniform per frame is an array index instead of a glGetUniformLocation
+// string lookup. Each uniform remembers the last value uploaded and set()
+// skips the GL call when it has not changed.
+//
+// The program must be bound with use() before calling set(). Uniforms must
+// only be changed through this class, otherwise the cached values go stale.
+class ShaderProgram {
+public:
+	struct Uniform {
+		string name;         // Without the "[0]" suffix of arrays
+		GLint location;
+		GLenum type;         // GL_FLOAT_VEC3, GL_SAMPLER_2D, ...
+		GLint arraySize;
+		bool hasValue;       // value holds what was last uploaded
+		unsigned char value[sizeof(glm::mat4)];
+	};
+
+	struct Attribute {
+		string name;
+		GLint location;
+		GLenum type;
+		GLint arraySize;
+	};
+
+private:
+	GLuint program;
+	vector<Uniform> uniforms;       // Sorted by name
+	vector<Attribute> attributes;   // Sorted by name
+	size_t uploads;
+	size_t skippedUploads;
+
+	void reflect();
+	bool changed(UniformHandle handle, const void* value, size_t bytes);
+
+public:
+	ShaderProgram();
+	~ShaderProgram();
+
+	ShaderProgram(const ShaderProgram&) = delete;
+	ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+	// Compiles and links the two files; reports errors and returns false
+	bool load(const char* vertPath, const char* fragPath);
+	// Same for a compute shader; needs GL 4.3
+	bool loadCompute(const char* compPath);
+
+	// Takes ownership of an already linked program
+	bool attach(GLuint linkedProgram);
+
+	void cleanup();
+
+	void use() const;
+	GLuint getId() const { return program; }
+	bool isValid() const { return program != 0; }
+
+	// Setup-time lookups; keep the results
+	UniformHandle getUniform(const string& name) const;
+	GLint getAttributeLocation(const string& name) const;
+
+	// Assigns a uniform block to a buffer binding point; false when the
+	// program has no active block of that name
+	bool bindUniformBlock(const string& name, GLuint binding);
+
+	const vector<Uniform>& getUniforms() const { return uniforms; }
+	const vector<Attribute>& getAttributes() const { return attributes; }
+
+	void set(UniformHandle handle, int value);
+	void set(UniformHandle handle, bool value) { set(handle, value ? 1 : 0); }
+	void set(UniformHandle handle, float value);
+	void set(UniformHandle handle, const glm::vec2& value);
+	void set(UniformHandle handle, const glm::vec3& value);
+	void set(UniformHandle handle, const glm::vec4& value);
+	void set(UniformHandle handle, const glm::mat3& value);
+	void set(UniformHandle handle, const glm::mat4& value);
+
+	// Calls that reached the GL and calls skipped as redundant
+	size_t getUploadCount() const { return uploads; }
+	size_t getSkippedUploadCount() const { return skippedUploads; }
+};
+
+#endif // !SHADERPROGRAM_H
@@ -1,4 +1,5 @@
 #include "ShaderProgramCreator.h"
+#include "GLExtensions.h"
 #include <iostream>
 
 using namespace std;
@@ -32,4 +33,20 @@ GLuint ShaderProgramCreator::createShaderProgram(const char *vertPath, const cha
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
     return shaderProgram;
+}
+
+GLuint ShaderProgramCreator::createComputeProgram(const char *compPath) {
+    std::string compCode = loadShaderSource(compPath);
+
+    GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    const char* cShaderCode = compCode.c_str();
+    glShaderSource(computeShader, 1, &cShaderCode, NULL);
+    glCompileShader(computeShader);
+
+    GLuint shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, computeShader);
+    glLinkProgram(shaderProgram);
+
+    glDeleteShader(computeShader);
+    return shaderProgram;
 }
\ No newline at end of file
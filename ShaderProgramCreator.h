@@ -16,6 +16,8 @@ protected:
 
 public:
 	GLuint createShaderProgram(const char *verPath, const char *fragPath);
+	// GL 4.3 only; see GLExtensions::hasComputeShaders()
+	GLuint createComputeProgram(const char *compPath);
 };
 
 
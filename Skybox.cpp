@@ -1,39 +1,49 @@
 #include "Skybox.h"
+#include "FrameUniforms.h"
 #include <iostream>
-#include <vector>
-#include <cmath>
-
-#define M_PI 3.14159265359
+#include <algorithm>
 
 using namespace std;
 using namespace glm;
 
+namespace {
+
+// Panorama the sky is made from, any 2:1 equirectangular image
+const char* SKY_TEXTURE_PATH = "textures/piste.jpg";
+
+// A face covers a quarter of the panorama's width; larger adds no detail
+const int MAX_FACE_SIZE = 2048;
+
+// Direction of face coordinate (s, t) is basis * vec3(s, t, 1), from the
+// cube map face table of the GL spec, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+const mat3 FACE_BASES[6] = {
+    mat3(vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, -1.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f)),    // +X
+    mat3(vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, -1.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f)),    // -X
+    mat3(vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 1.0f, 0.0f)),      // +Y
+    mat3(vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, -1.0f, 0.0f)),    // -Y
+    mat3(vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f)),     // +Z
+    mat3(vec3(-1.0f, 0.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, -1.0f))    // -Z
+};
+
+}
+
 Skybox::Skybox()
-    : sphereVBO(0), sphereVAO(0), sphereIndexCount(0),
-    shaderProgram(0), textureID(0),
+    : vao(0), textureUniform(INVALID_UNIFORM), cubemapID(0), faceSize(0),
     dragging(false), dragStart(0.0f), transformStart(0.0f),
     initialized(false) {
 }
 
 Skybox::~Skybox() {
-    if (sphereVAO != 0) {
-        glDeleteVertexArrays(1, &sphereVAO);
-        sphereVAO = 0;
-    }
-
-    if (sphereVBO != 0) {
-        glDeleteBuffers(1, &sphereVBO);
-        sphereVBO = 0;
+    if (vao != 0) {
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
     }
 
-    if (shaderProgram != 0) {
-        glDeleteProgram(shaderProgram);
-        shaderProgram = 0;
-    }
+    shader.cleanup();
 
-    if (textureID != 0) {
-        glDeleteTextures(1, &textureID);
-        textureID = 0;
+    if (cubemapID != 0) {
+        glDeleteTextures(1, &cubemapID);
+        cubemapID = 0;
     }
 
     initialized = false;
@@ -46,108 +56,125 @@ void Skybox::init() {
 
     setupShaderProgram();
 
-    textureID = textureloader.loadTexture("textures/piste.jpg"); 
-    if (textureID == 0) {
+    if (!createCubemap(SKY_TEXTURE_PATH)) {
         cerr << "Failed to load skybox texture" << endl;
         return;
     }
 
-    createSkyboxSphere();
+    glGenVertexArrays(1, &vao);
 
     initialized = true;
     cout << "Skybox initialized successfully" << endl;
 }
 
-void Skybox::createSkyboxSphere() {
-    vector<float> vertices;
-    vector<unsigned int> indices;
-
-    const int rings = 30;
-    const int sectors = 30;
-    const float radius = 100.0f; 
-
-    for (int r = 0; r <= rings; ++r) {
-        float phi = M_PI * r / rings; // 0 to PI
-        float y = radius * cos(phi);
-        float ringRadius = radius * sin(phi);
-
-        for (int s = 0; s <= sectors; ++s) {
-            float theta = 2.0f * M_PI * s / sectors; // 0 to 2*PI
-            float x = ringRadius * cos(theta);
-            float z = ringRadius * sin(theta);
-
-            // Position
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-
-            // Texture coordinates (UV mapping)
-            float u = (float)s / sectors;
-            float v = 1.0f - (float)r / rings; // Flip V coordinate if texture appears upside down
-            vertices.push_back(u);
-            vertices.push_back(v);
-        }
+bool Skybox::createCubemap(const char* path) {
+    GLuint equirectID = textureloader.loadTexture(path);
+    if (equirectID == 0) {
+        return false;
     }
 
-    for (int r = 0; r < rings; ++r) {
-        for (int s = 0; s < sectors; ++s) {
-            int current = r * (sectors + 1) + s;
-            int next = current + sectors + 1;
-
-            // First triangle
-            indices.push_back(current);
-            indices.push_back(next);
-            indices.push_back(current + 1);
+    GLint width = 0;
+    GLint maxCubeSize = 0;
+    glBindTexture(GL_TEXTURE_2D, equirectID);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &maxCubeSize);
+    faceSize = std::max(1, std::min({ (int)width / 4, MAX_FACE_SIZE, (int)maxCubeSize }));
+
+    ShaderProgram converter;
+    if (!converter.load("shaders/vertex/SkyboxCubemapVertexShader.glsl", "shaders/fragment/SkyboxCubemapFragmentShader.glsl")) {
+        cerr << "Failed to create skybox cube map shader program" << endl;
+        glDeleteTextures(1, &equirectID);
+        return false;
+    }
 
-            // Second triangle
-            indices.push_back(current + 1);
-            indices.push_back(next);
-            indices.push_back(next + 1);
+    glGenTextures(1, &cubemapID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapID);
+    for (int face = 0; face < 6; ++face) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, faceSize, faceSize, 0,
+            GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Render state the conversion changes, put back afterwards
+    GLint previousFbo = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+    GLuint fbo = 0;
+    GLuint emptyVao = 0;
+    glGenFramebuffers(1, &fbo);
+    glGenVertexArrays(1, &emptyVao);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glBindVertexArray(emptyVao);
+    glViewport(0, 0, faceSize, faceSize);
+    glDisable(GL_DEPTH_TEST);
+
+    converter.use();
+    converter.set(converter.getUniform("equirectTexture"), 0);
+    UniformHandle basisUniform = converter.getUniform("faceBasis");
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, equirectID);
+
+    bool complete = true;
+    for (int face = 0; face < 6 && complete; ++face) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubemapID, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            cerr << "Skybox cube map framebuffer is incomplete" << endl;
+            complete = false;
+            break;
         }
+        converter.set(basisUniform, FACE_BASES[face]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
     }
 
-    sphereIndexCount = indices.size();
-
-    glGenVertexArrays(1, &sphereVAO);
-    glGenBuffers(1, &sphereVBO);
-
-    unsigned int sphereEBO;
-    glGenBuffers(1, &sphereEBO);
-
-    glBindVertexArray(sphereVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
-        vertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-        indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteVertexArrays(1, &emptyVao);
+    glDeleteTextures(1, &equirectID);
+    converter.cleanup();
+
+    if (!complete) {
+        glDeleteTextures(1, &cubemapID);
+        cubemapID = 0;
+        return false;
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapID);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
-        (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // Filter across face edges, or the seams show at lower mips
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    glBindVertexArray(0);
+    cout << "Skybox cube map created, " << faceSize << "x" << faceSize << " per face" << endl;
+    return true;
 }
 
 void Skybox::setupShaderProgram() {
-    
-    shaderProgram = shaderCreator.createShaderProgram("shaders/vertex/SkyboxVertexShader.glsl", 
-        "shaders/fragment/SkyboxFragmentShader.glsl");
 
-    if (shaderProgram == 0) {
+    if (!shader.load("shaders/vertex/SkyboxVertexShader.glsl", "shaders/fragment/SkyboxFragmentShader.glsl")) {
         cerr << "Failed to create skybox shader program" << endl;
         return;
     }
 
+    FrameUniforms::attach(shader);
+    textureUniform = shader.getUniform("skyboxTexture");
+
     cout << "Skybox shader program created successfully" << endl;
 }
 
-void Skybox::render(const mat4& view, const mat4& projection) {
+void Skybox::submit(RenderQueue& queue) {
     if (!initialized) {
         init();
         if (!initialized) {
@@ -155,30 +182,30 @@ void Skybox::render(const mat4& view, const mat4& projection) {
         }
     }
 
-    if (sphereVAO == 0 || shaderProgram == 0) {
+    if (vao == 0 || !shader.isValid()) {
         cerr << "Skybox not properly initialized" << endl;
         return;
     }
 
-    glDepthFunc(GL_LEQUAL); 
-    glDepthMask(GL_FALSE);   
-
-    glUseProgram(shaderProgram);
-
-    mat4 model = mat4(1.0f);
-
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, value_ptr(projection));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, value_ptr(model));
+    // After the world at the far plane, without writing depth: GL_LEQUAL
+    // passes only where depth is still cleared. The cube map is bound in
+    // drawPacket(), the queue binds 2D textures only.
+    DrawPacket packet;
+    packet.program = &shader;
+    packet.vao = vao;
+    packet.texture = 0;
+    packet.depthFunc = GL_LEQUAL;
+    packet.depthWrite = false;
+    packet.drawer = this;
+    packet.payload = 0;
+    packet.key = RenderQueue::makeKey(RenderPass::SKY, shader.getId(), cubemapID, vao, 0.0f);
+    queue.submit(packet);
+}
 
+void Skybox::drawPacket(unsigned int) {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glUniform1i(glGetUniformLocation(shaderProgram, "skyboxTexture"), 0);
-
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapID);
+    shader.set(textureUniform, 0);
 
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 }
\ No newline at end of file
@@ -6,18 +6,24 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include "ShaderProgramCreator.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
 #include "TextureLoader.h"
 
 using namespace glm;
 using namespace std;
 
-class Skybox {
+// Sky from an equirectangular panorama, converted once at init() into a
+// mipmapped cube map by rendering each face on the GPU. Drawn as one
+// fullscreen triangle on the far plane after the world, so with GL_LEQUAL
+// the depth test rejects every pixel the world covers before shading it.
+class Skybox : public PacketDrawer {
 private:
-    unsigned int sphereVBO, sphereVAO, sphereIndexCount;
-    unsigned int shaderProgram;
-    GLuint textureID;
-    ShaderProgramCreator shaderCreator;
+    GLuint vao;   // Empty, the triangle comes from gl_VertexID
+    ShaderProgram shader;
+    UniformHandle textureUniform;
+    GLuint cubemapID;
+    int faceSize;
     TextureLoader textureloader;
 
     bool dragging;
@@ -25,7 +31,7 @@ private:
     glm::vec3 transformStart;
     bool initialized;
 
-    void createSkyboxSphere();
+    bool createCubemap(const char* path);
     void setupShaderProgram();
 
 public:
@@ -34,7 +40,10 @@ public:
 
     void init();
 
-    void render(const mat4& view, const mat4& projection);
+    // Queues the sky in the SKY pass, after the world; camera comes from the
+    // FrameUniforms block
+    void submit(RenderQueue& queue);
+    void drawPacket(unsigned int payload) override;
 };
 
 #endif // !SKYBOX_H
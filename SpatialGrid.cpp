@@ -0,0 +1,398 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+namespace {
+
+// Bounds a ray walk in case of a degenerate direction
+const int MAX_RAY_STEPS = 1 << 20;
+
+bool overlaps(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax) {
+	return aMin.x <= bMax.x && aMax.x >= bMin.x &&
+		aMin.y <= bMax.y && aMax.y >= bMin.y &&
+		aMin.z <= bMax.z && aMax.z >= bMin.z;
+}
+
+}
+
+SpatialGrid::SpatialGrid(float cellSize)
+	: cellSize(cellSize), activeCount(0), worldMin(FLT_MAX), worldMax(-FLT_MAX), currentStamp(0) {}
+
+int SpatialGrid::cellCoord(float value) const {
+	float cell = floor(value / cellSize);
+	cell = max(cell, (float)(INT_MIN / 2));
+	cell = min(cell, (float)(INT_MAX / 2));
+	return (int)cell;
+}
+
+SpatialGrid::CellRange SpatialGrid::getCellRange(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+	CellRange range;
+	range.minX = cellCoord(boundsMin.x);
+	range.minZ = cellCoord(boundsMin.z);
+	range.maxX = cellCoord(boundsMax.x);
+	range.maxZ = cellCoord(boundsMax.z);
+	return range;
+}
+
+bool SpatialGrid::isOversized(const CellRange& range) const {
+	int64_t width = (int64_t)range.maxX - range.minX + 1;
+	int64_t depth = (int64_t)range.maxZ - range.minZ + 1;
+	return width * depth > MAX_CELLS_PER_ITEM;
+}
+
+SpatialGrid::ItemId SpatialGrid::insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, void* userData) {
+	ItemId id;
+	if (!freeItems.empty()) {
+		id = freeItems.back();
+		freeItems.pop_back();
+	}
+	else {
+		id = (ItemId)items.size();
+		items.push_back(Item());
+		itemStamps.push_back(0);
+	}
+
+	Item& item = items[id];
+	item.boundsMin = boundsMin;
+	item.boundsMax = boundsMax;
+	item.userData = userData;
+	item.active = true;
+	link(id);
+	++activeCount;
+	return id;
+}
+
+void SpatialGrid::update(ItemId id, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	if (id >= items.size() || !items[id].active) {
+		return;
+	}
+
+	Item& item = items[id];
+	CellRange range = getCellRange(boundsMin, boundsMax);
+	if (range == item.cells && isOversized(range) == item.oversized) {
+		// Same cells: only the box and the cells' vertical extent change
+		item.boundsMin = boundsMin;
+		item.boundsMax = boundsMax;
+		worldMin = glm::min(worldMin, boundsMin);
+		worldMax = glm::max(worldMax, boundsMax);
+		if (!item.oversized) {
+			for (int x = range.minX; x <= range.maxX; ++x) {
+				for (int z = range.minZ; z <= range.maxZ; ++z) {
+					Cell& cell = cells[cellKey(x, z)];
+					cell.minY = min(cell.minY, boundsMin.y);
+					cell.maxY = max(cell.maxY, boundsMax.y);
+				}
+			}
+		}
+		return;
+	}
+
+	unlink(id);
+	item.boundsMin = boundsMin;
+	item.boundsMax = boundsMax;
+	link(id);
+}
+
+void SpatialGrid::remove(ItemId id) {
+	if (id >= items.size() || !items[id].active) {
+		return;
+	}
+
+	unlink(id);
+	items[id].active = false;
+	items[id].userData = nullptr;
+	freeItems.push_back(id);
+	--activeCount;
+}
+
+void SpatialGrid::clear() {
+	cells.clear();
+	items.clear();
+	freeItems.clear();
+	oversizedItems.clear();
+	itemStamps.clear();
+	activeCount = 0;
+	worldMin = glm::vec3(FLT_MAX);
+	worldMax = glm::vec3(-FLT_MAX);
+}
+
+void SpatialGrid::link(ItemId id) {
+	Item& item = items[id];
+	item.cells = getCellRange(item.boundsMin, item.boundsMax);
+	item.oversized = isOversized(item.cells);
+	worldMin = glm::min(worldMin, item.boundsMin);
+	worldMax = glm::max(worldMax, item.boundsMax);
+
+	if (item.oversized) {
+		oversizedItems.push_back(id);
+		return;
+	}
+
+	for (int x = item.cells.minX; x <= item.cells.maxX; ++x) {
+		for (int z = item.cells.minZ; z <= item.cells.maxZ; ++z) {
+			Cell& cell = cells[cellKey(x, z)];
+			if (cell.items.empty()) {
+				cell.minY = item.boundsMin.y;
+				cell.maxY = item.boundsMax.y;
+			}
+			else {
+				cell.minY = min(cell.minY, item.boundsMin.y);
+				cell.maxY = max(cell.maxY, item.boundsMax.y);
+			}
+			cell.items.push_back(id);
+		}
+	}
+}
+
+void SpatialGrid::unlink(ItemId id) {
+	const Item& item = items[id];
+	if (item.oversized) {
+		oversizedItems.erase(find(oversizedItems.begin(), oversizedItems.end(), id));
+		return;
+	}
+
+	for (int x = item.cells.minX; x <= item.cells.maxX; ++x) {
+		for (int z = item.cells.minZ; z <= item.cells.maxZ; ++z) {
+			auto it = cells.find(cellKey(x, z));
+			if (it == cells.end()) {
+				continue;
+			}
+
+			vector<ItemId>& list = it->second.items;
+			auto entry = find(list.begin(), list.end(), id);
+			if (entry != list.end()) {
+				*entry = list.back();
+				list.pop_back();
+			}
+			// Drop empty cells so frustum queries only walk occupied ones
+			if (list.empty()) {
+				cells.erase(it);
+			}
+		}
+	}
+}
+
+void SpatialGrid::nextStamp() const {
+	if (++currentStamp == 0) {
+		// Wrapped around: old stamps could collide
+		fill(itemStamps.begin(), itemStamps.end(), 0u);
+		currentStamp = 1;
+	}
+}
+
+bool SpatialGrid::visit(ItemId id) const {
+	if (itemStamps[id] == currentStamp) {
+		return false;
+	}
+	itemStamps[id] = currentStamp;
+	return true;
+}
+
+template <typename Visitor>
+void SpatialGrid::forEachInRange(const CellRange& range, Visitor visitor) const {
+	nextStamp();
+
+	int64_t rangeCells = ((int64_t)range.maxX - range.minX + 1) * ((int64_t)range.maxZ - range.minZ + 1);
+	if (rangeCells <= (int64_t)cells.size()) {
+		for (int x = range.minX; x <= range.maxX; ++x) {
+			for (int z = range.minZ; z <= range.maxZ; ++z) {
+				auto it = cells.find(cellKey(x, z));
+				if (it == cells.end()) {
+					continue;
+				}
+				for (ItemId id : it->second.items) {
+					if (visit(id)) {
+						visitor(id);
+					}
+				}
+			}
+		}
+	}
+	else {
+		// Query wider than the occupied area: walk the occupied cells instead
+		for (const auto& entry : cells) {
+			int x = cellKeyX(entry.first);
+			int z = cellKeyZ(entry.first);
+			if (x < range.minX || x > range.maxX || z < range.minZ || z > range.maxZ) {
+				continue;
+			}
+			for (ItemId id : entry.second.items) {
+				if (visit(id)) {
+					visitor(id);
+				}
+			}
+		}
+	}
+
+	for (ItemId id : oversizedItems) {
+		visitor(id);
+	}
+}
+
+void SpatialGrid::queryAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, vector<ItemId>& result) const {
+	forEachInRange(getCellRange(boundsMin, boundsMax), [&](ItemId id) {
+		const Item& item = items[id];
+		if (overlaps(item.boundsMin, item.boundsMax, boundsMin, boundsMax)) {
+			result.push_back(id);
+		}
+	});
+}
+
+void SpatialGrid::queryRadius(const glm::vec3& center, float radius, vector<ItemId>& result) const {
+	glm::vec3 extent(radius);
+	float radiusSquared = radius * radius;
+	forEachInRange(getCellRange(center - extent, center + extent), [&](ItemId id) {
+		const Item& item = items[id];
+		glm::vec3 closest = glm::clamp(center, item.boundsMin, item.boundsMax);
+		glm::vec3 offset = closest - center;
+		if (glm::dot(offset, offset) <= radiusSquared) {
+			result.push_back(id);
+		}
+	});
+}
+
+void SpatialGrid::queryFrustum(const Frustum& frustum, vector<ItemId>& result) const {
+	nextStamp();
+	frustumCandidates.clear();
+
+	// The frustum reaches far beyond the city, so test the occupied cells
+	// rather than walking its footprint
+	for (const auto& entry : cells) {
+		int x = cellKeyX(entry.first);
+		int z = cellKeyZ(entry.first);
+		const Cell& cell = entry.second;
+		glm::vec3 cellMin(x * cellSize, cell.minY, z * cellSize);
+		glm::vec3 cellMax((x + 1) * cellSize, cell.maxY, (z + 1) * cellSize);
+		if (!frustum.intersectsAABB(cellMin, cellMax)) {
+			continue;
+		}
+
+		for (ItemId id : cell.items) {
+			if (visit(id)) {
+				frustumCandidates.push_back(id);
+			}
+		}
+	}
+	frustumCandidates.insert(frustumCandidates.end(), oversizedItems.begin(), oversizedItems.end());
+
+	frustumCuller.begin();
+	for (ItemId id : frustumCandidates) {
+		frustumCuller.add(items[id].boundsMin, items[id].boundsMax);
+	}
+	frustumCuller.cull(frustum);
+	for (size_t i = 0; i < frustumCandidates.size(); ++i) {
+		if (frustumCuller.isVisible(i)) {
+			result.push_back(frustumCandidates[i]);
+		}
+	}
+}
+
+bool SpatialGrid::rayIntersectsAABB(const glm::vec3& origin, const glm::vec3& direction,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxDistance, float& distance) {
+	float tNear = 0.0f;
+	float tFar = maxDistance;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (fabs(direction[axis]) < 1e-12f) {
+			if (origin[axis] < boundsMin[axis] || origin[axis] > boundsMax[axis]) {
+				return false;
+			}
+			continue;
+		}
+
+		float inverse = 1.0f / direction[axis];
+		float t0 = (boundsMin[axis] - origin[axis]) * inverse;
+		float t1 = (boundsMax[axis] - origin[axis]) * inverse;
+		if (t0 > t1) {
+			swap(t0, t1);
+		}
+		tNear = max(tNear, t0);
+		tFar = min(tFar, t1);
+		if (tNear > tFar) {
+			return false;
+		}
+	}
+
+	distance = tNear;
+	return true;
+}
+
+void SpatialGrid::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	vector<RayHit>& result) const {
+	size_t firstHit = result.size();
+	nextStamp();
+
+	auto testItem = [&](ItemId id) {
+		float distance;
+		const Item& item = items[id];
+		if (rayIntersectsAABB(origin, direction, item.boundsMin, item.boundsMax, maxDistance, distance)) {
+			RayHit hit;
+			hit.item = id;
+			hit.distance = distance;
+			result.push_back(hit);
+		}
+	};
+
+	// Only walk the part of the ray inside the occupied area
+	float tStart, tEnd;
+	if (!cells.empty() && rayIntersectsAABB(origin, direction, worldMin, worldMax, maxDistance, tStart)) {
+		tEnd = maxDistance;
+		float exitDistance;
+		// Exit point: enter the box from the far end of the clipped ray
+		glm::vec3 farPoint = origin + direction * maxDistance;
+		if (rayIntersectsAABB(farPoint, -direction, worldMin, worldMax, maxDistance, exitDistance)) {
+			tEnd = maxDistance - exitDistance;
+		}
+
+		glm::vec3 start = origin + direction * tStart;
+		int x = cellCoord(start.x);
+		int z = cellCoord(start.z);
+		int stepX = direction.x > 0.0f ? 1 : -1;
+		int stepZ = direction.z > 0.0f ? 1 : -1;
+
+		// Ray distance to the next cell boundary on each axis, and per cell
+		float tMaxX = FLT_MAX, tMaxZ = FLT_MAX, tDeltaX = FLT_MAX, tDeltaZ = FLT_MAX;
+		if (fabs(direction.x) > 1e-12f) {
+			float boundary = (x + (stepX > 0 ? 1 : 0)) * cellSize;
+			tMaxX = tStart + (boundary - start.x) / direction.x;
+			tDeltaX = cellSize / fabs(direction.x);
+		}
+		if (fabs(direction.z) > 1e-12f) {
+			float boundary = (z + (stepZ > 0 ? 1 : 0)) * cellSize;
+			tMaxZ = tStart + (boundary - start.z) / direction.z;
+			tDeltaZ = cellSize / fabs(direction.z);
+		}
+
+		for (int step = 0; step < MAX_RAY_STEPS; ++step) {
+			auto it = cells.find(cellKey(x, z));
+			if (it != cells.end()) {
+				for (ItemId id : it->second.items) {
+					if (visit(id)) {
+						testItem(id);
+					}
+				}
+			}
+
+			if (min(tMaxX, tMaxZ) > tEnd) {
+				break;
+			}
+			if (tMaxX < tMaxZ) {
+				x += stepX;
+				tMaxX += tDeltaX;
+			}
+			else {
+				z += stepZ;
+				tMaxZ += tDeltaZ;
+			}
+		}
+	}
+
+	for (ItemId id : oversizedItems) {
+		testItem(id);
+	}
+
+	sort(result.begin() + firstHit, result.end(), [](const RayHit& a, const RayHit& b) {
+		return a.distance < b.distance;
+	});
+}
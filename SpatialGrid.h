@@ -0,0 +1,121 @@
+#pragma once
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Frustum.h"
+
+using namespace std;
+
+// Uniform grid over the ground (XZ) plane holding world-space AABBs. Cells
+// are hashed, so the city can grow in any direction without resizing, and
+// an item is listed in every cell its box overlaps. Moving an item only
+// touches the grid when the range of cells it covers changes.
+//
+// Queries append item ids and report each item once. They share scratch
+// state, so one grid must not be queried from several threads at a time.
+class SpatialGrid {
+public:
+	typedef unsigned int ItemId;
+	static const ItemId INVALID_ITEM = 0xFFFFFFFF;
+
+	// Buildings are a few units across; roads tile at about the same size
+	static constexpr float DEFAULT_CELL_SIZE = 4.0f;
+	// Items covering more cells than this go to a list every query scans
+	static const int MAX_CELLS_PER_ITEM = 64;
+
+	struct RayHit {
+		ItemId item;
+		float distance;   // Along the ray to where it enters the item's box
+	};
+
+private:
+	struct CellRange {
+		int minX, minZ, maxX, maxZ;
+		bool operator==(const CellRange& other) const {
+			return minX == other.minX && minZ == other.minZ && maxX == other.maxX && maxZ == other.maxZ;
+		}
+	};
+
+	struct Cell {
+		vector<ItemId> items;
+		float minY, maxY;   // Vertical extent of the items, for frustum tests
+	};
+
+	struct Item {
+		glm::vec3 boundsMin, boundsMax;
+		CellRange cells;
+		void* userData;
+		bool active;
+		bool oversized;
+	};
+
+	float cellSize;
+	unordered_map<uint64_t, Cell> cells;
+	vector<Item> items;
+	vector<ItemId> freeItems;
+	vector<ItemId> oversizedItems;
+	size_t activeCount;
+	// Union of every box ever linked; only used to clip rays
+	glm::vec3 worldMin, worldMax;
+
+	// Dedup for items spanning several cells
+	mutable vector<unsigned int> itemStamps;
+	mutable unsigned int currentStamp;
+	// queryFrustum's items in visible cells and their batched box test
+	mutable vector<ItemId> frustumCandidates;
+	mutable FrustumCuller frustumCuller;
+
+	static uint64_t cellKey(int x, int z) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z; }
+	static int cellKeyX(uint64_t key) { return (int)(int32_t)(uint32_t)(key >> 32); }
+	static int cellKeyZ(uint64_t key) { return (int)(int32_t)(uint32_t)key; }
+	int cellCoord(float value) const;
+	CellRange getCellRange(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	bool isOversized(const CellRange& range) const;
+
+	void link(ItemId id);
+	void unlink(ItemId id);
+	void nextStamp() const;
+	bool visit(ItemId id) const;
+
+	// Calls visitor(id) once for every item in the cells of range and for
+	// every oversized item
+	template <typename Visitor>
+	void forEachInRange(const CellRange& range, Visitor visitor) const;
+
+public:
+	explicit SpatialGrid(float cellSize = DEFAULT_CELL_SIZE);
+
+	ItemId insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, void* userData);
+	void update(ItemId id, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void remove(ItemId id);
+	void clear();
+
+	// False for ids that were removed (or never handed out)
+	bool contains(ItemId id) const { return id < items.size() && items[id].active; }
+	void* getUserData(ItemId id) const { return items[id].userData; }
+	const glm::vec3& getBoundsMin(ItemId id) const { return items[id].boundsMin; }
+	const glm::vec3& getBoundsMax(ItemId id) const { return items[id].boundsMax; }
+	size_t getItemCount() const { return activeCount; }
+	size_t getCellCount() const { return cells.size(); }
+
+	// Items whose box overlaps / touches the sphere / intersects the frustum.
+	// The frustum query tests cells first, then the boxes of the items in
+	// the cells it reaches four at a time (FrustumCuller).
+	void queryAABB(const glm::vec3& boundsMin, const glm::vec3& boundsMax, vector<ItemId>& result) const;
+	void queryRadius(const glm::vec3& center, float radius, vector<ItemId>& result) const;
+	void queryFrustum(const Frustum& frustum, vector<ItemId>& result) const;
+
+	// Items whose box the ray enters within maxDistance, nearest first.
+	// Cells are walked front to back (2D DDA) over the XZ plane.
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, vector<RayHit>& result) const;
+
+	// Slab test; entry distance in distance (0 when origin is inside)
+	static bool rayIntersectsAABB(const glm::vec3& origin, const glm::vec3& direction,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxDistance, float& distance);
+};
+
+#endif // !SPATIALGRID_H
@@ -0,0 +1,159 @@
+#include "StreamBuffer.h"
+#include "GLExtensions.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Region size granularity, and the uniform buffer alignment if GL gives none
+const size_t REGION_ALIGNMENT = 256;
+
+// A wait on a region only happens when the GPU is frames behind, so give
+// it plenty of time before checking again
+const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+}
+
+StreamBuffer::StreamBuffer()
+	: buffer(0), mapped(nullptr), regionBytes(0), uniformAlignment(REGION_ALIGNMENT), region(0), head(0), frameActive(false),
+	frameBytes(0), waits(0) {
+	for (unsigned int i = 0; i < FRAME_COUNT; ++i) {
+		fences[i] = nullptr;
+	}
+}
+
+StreamBuffer::~StreamBuffer() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+bool StreamBuffer::init(size_t bytesPerFrame) {
+	if (buffer != 0) {
+		return true;
+	}
+	regionBytes = (bytesPerFrame + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+	if (regionBytes == 0) {
+		return false;
+	}
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	uniformAlignment = alignment > 0 ? (size_t)alignment : REGION_ALIGNMENT;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (GLExtensions::hasBufferStorage()) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr bytes = (GLsizeiptr)(regionBytes * FRAME_COUNT);
+		GLExtensions::bufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+		if (!mapped) {
+			// Immutable storage can't be orphaned either, so start over
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		}
+	}
+	if (!mapped) {
+		glBufferData(GL_COPY_WRITE_BUFFER, regionBytes, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	cout << (mapped ? "Streaming per-frame data through a persistently mapped buffer"
+		: "Buffer storage not available, streaming per-frame data by orphaning") << endl;
+	region = 0;
+	head = 0;
+	frameActive = false;
+	return true;
+}
+
+void StreamBuffer::cleanup() {
+	for (unsigned int i = 0; i < FRAME_COUNT; ++i) {
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+	}
+	if (buffer != 0) {
+		if (mapped) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	regionBytes = 0;
+	frameActive = false;
+}
+
+void StreamBuffer::beginFrame() {
+	if (buffer == 0 || frameActive) {
+		return;
+	}
+	frameActive = true;
+	head = 0;
+	frameBytes = 0;
+
+	if (!mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, regionBytes, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	region = (region + 1) % FRAME_COUNT;
+	GLsync fence = fences[region];
+	if (!fence) {
+		return;
+	}
+	GLenum state = glClientWaitSync(fence, 0, 0);
+	if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+		++waits;
+		do {
+			state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+		} while (state == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(fence);
+	fences[region] = nullptr;
+}
+
+GLintptr StreamBuffer::write(const void* data, size_t bytes, size_t alignment) {
+	if (!frameActive || bytes == 0) {
+		return NO_OFFSET;
+	}
+
+	// Aligned in the buffer, not the region, so any alignment works, e.g.
+	// a struct's size to address the data by element
+	size_t regionStart = mapped ? region * regionBytes : 0;
+	size_t offset = regionStart + head;
+	if (alignment > 1) {
+		offset = (offset + alignment - 1) / alignment * alignment;
+	}
+	if (offset + bytes > regionStart + regionBytes) {
+		return NO_OFFSET;
+	}
+
+	if (mapped) {
+		memcpy(mapped + offset, data, bytes);
+	}
+	else {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	head = offset + bytes - regionStart;
+	frameBytes = head;
+	return (GLintptr)offset;
+}
+
+void StreamBuffer::endFrame() {
+	if (!frameActive) {
+		return;
+	}
+	frameActive = false;
+	if (mapped) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
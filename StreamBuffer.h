@@ -0,0 +1,78 @@
+#pragma once
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <cstddef>
+#include <glad/glad.h>
+
+using namespace std;
+
+// Ring buffer for data rewritten every frame: per-frame uniform blocks,
+// instance attributes, indirect commands, transform updates on their way to
+// the TransformBuffer and the gizmo's lines. One buffer object serves every
+// target; write() copies the data in and returns its offset for
+// glBindBufferRange, attribute pointers or glCopyBufferSubData.
+//
+// With GLExtensions::hasBufferStorage() the buffer holds FRAME_COUNT regions
+// and stays mapped (persistent and coherent) for its whole life, so a write
+// is a memcpy with no GL call at all. The region of frame N is fenced when
+// the frame ends and only reused FRAME_COUNT frames later, by which time
+// the GPU is normally done with it; beginFrame() waits on the fence only
+// when it isn't. Without buffer storage the buffer is one region, orphaned
+// with glBufferData(nullptr) every frame so the driver hands out fresh
+// storage instead of waiting for last frame's draws, and written with
+// glBufferSubData.
+//
+// Usage per frame: beginFrame() before anything is written, write() while
+// the frame is built, endFrame() once the last draw reading the frame's
+// data (e.g. the pick pass) is issued. A write that doesn't fit returns
+// NO_OFFSET and the caller uploads the old way.
+class StreamBuffer {
+public:
+	static const unsigned int FRAME_COUNT = 3;
+	static const GLintptr NO_OFFSET = -1;
+
+private:
+	GLuint buffer;
+	unsigned char* mapped;   // All regions; null when orphaning
+	size_t regionBytes;
+	size_t uniformAlignment;
+	unsigned int region;     // Written this frame
+	size_t head;             // Bytes of the region used this frame
+	GLsync fences[FRAME_COUNT];
+	bool frameActive;
+
+	// Statistics
+	size_t frameBytes;
+	unsigned int waits;
+
+public:
+	StreamBuffer();
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// bytesPerFrame is what one frame may write, alignment padding included
+	bool init(size_t bytesPerFrame);
+	void cleanup();
+	bool isValid() const { return buffer != 0; }
+	bool isPersistent() const { return mapped != nullptr; }
+
+	void beginFrame();
+	// Copies bytes of data to an offset that is a multiple of alignment;
+	// NO_OFFSET outside a frame or when the region is full
+	GLintptr write(const void* data, size_t bytes, size_t alignment);
+	void endFrame();
+
+	GLuint getBuffer() const { return buffer; }
+	// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, for blocks bound with glBindBufferRange
+	size_t getUniformAlignment() const { return uniformAlignment; }
+
+	// Bytes written in the current or last frame
+	size_t getFrameBytes() const { return frameBytes; }
+	// Times beginFrame() found the GPU still reading the region
+	unsigned int getWaitCount() const { return waits; }
+};
+
+#endif // !STREAMBUFFER_H
@@ -0,0 +1,52 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount) : stopping(false) {
+	threadCount = std::max<size_t>(1, threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (thread& worker : workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::getShared() {
+	// Leave one core for the render thread
+	static ThreadPool pool(std::max(1u, thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+void ThreadPool::discardPending() {
+	// Destroyed outside the lock, in case a job's captures do anything on the way out
+	queue<function<void()>> discarded;
+	{
+		lock_guard<mutex> lock(queueMutex);
+		swap(discarded, jobs);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	for (;;) {
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty()) {
+				return;
+			}
+			job = move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
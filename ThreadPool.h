@@ -0,0 +1,57 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size pool of worker threads consuming a FIFO of jobs.
+class ThreadPool {
+private:
+	vector<thread> workers;
+	queue<function<void()>> jobs;
+	mutex queueMutex;
+	condition_variable jobAvailable;
+	bool stopping;
+
+	void workerLoop();
+
+public:
+	ThreadPool(size_t threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Shared pool sized to the machine, created on first use
+	static ThreadPool& getShared();
+
+	size_t getThreadCount() const { return workers.size(); }
+
+	// Drops the jobs not yet started; their futures report broken_promise.
+	// Jobs already running are left to finish.
+	void discardPending();
+
+	template <typename Fn>
+	future<decltype(declval<Fn>()())> submit(Fn job) {
+		typedef decltype(declval<Fn>()()) Result;
+		auto task = make_shared<packaged_task<Result()>>(move(job));
+		future<Result> result = task->get_future();
+		{
+			lock_guard<mutex> lock(queueMutex);
+			jobs.push([task]() { (*task)(); });
+		}
+		jobAvailable.notify_one();
+		return result;
+	}
+};
+
+#endif // !THREADPOOL_H
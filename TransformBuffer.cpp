@@ -0,0 +1,137 @@
+#include "TransformBuffer.h"
+#include <algorithm>
+
+const char* const TransformBuffer::SAMPLER_NAME = "instanceTransforms";
+
+TransformBuffer::TransformBuffer()
+	: buffer(0), texture(0), stream(nullptr), gpuSlotCapacity(0), uploadedSlots(0), uploadCalls(0) {}
+
+TransformBuffer::~TransformBuffer() {
+	// GL objects are released in cleanup(), while the context is alive
+}
+
+void TransformBuffer::init() {
+	if (buffer != 0) {
+		return;
+	}
+
+	glGenBuffers(1, &buffer);
+	glGenTextures(1, &texture);
+	gpuSlotCapacity = 0;
+
+	// Everything set before init() still has to go up
+	dirtySlots.clear();
+	for (size_t slot = 0; slot < slotDirty.size(); ++slot) {
+		slotDirty[slot] = 1;
+		dirtySlots.push_back((unsigned int)slot);
+	}
+}
+
+void TransformBuffer::cleanup() {
+	if (texture != 0) {
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	gpuSlotCapacity = 0;
+}
+
+bool TransformBuffer::attach(ShaderProgram& program) {
+	UniformHandle sampler = program.getUniform(SAMPLER_NAME);
+	program.set(sampler, (int)TEXTURE_UNIT);
+	return sampler != INVALID_UNIFORM;
+}
+
+void TransformBuffer::set(unsigned int slot, const glm::mat4& model, const glm::mat3& normalMatrix) {
+	if (slot >= getSlotCount()) {
+		texels.resize((size_t)(slot + 1) * TEXELS_PER_SLOT, glm::vec4(0.0f));
+		slotDirty.resize(slot + 1, 0);
+	}
+
+	glm::vec4* texel = &texels[(size_t)slot * TEXELS_PER_SLOT];
+	for (int row = 0; row < 3; ++row) {
+		texel[row] = glm::vec4(model[0][row], model[1][row], model[2][row], model[3][row]);
+	}
+	for (int column = 0; column < 3; ++column) {
+		texel[3 + column] = glm::vec4(normalMatrix[column], 0.0f);
+	}
+
+	if (!slotDirty[slot]) {
+		slotDirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+}
+
+void TransformBuffer::upload() {
+	uploadedSlots = 0;
+	uploadCalls = 0;
+	if (buffer == 0) {
+		return;
+	}
+
+	size_t slotCount = getSlotCount();
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+	if (slotCount > gpuSlotCapacity) {
+		// Reallocating loses the contents, so send everything once
+		gpuSlotCapacity = max(slotCount, gpuSlotCapacity * 2);
+		glBufferData(GL_TEXTURE_BUFFER, gpuSlotCapacity * TEXELS_PER_SLOT * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+		uploadedSlots = slotCount;
+		uploadCalls = 1;
+
+		// The texture keeps pointing at the old storage until re-attached
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	else if (!dirtySlots.empty()) {
+		// One call per run of consecutive slots
+		sort(dirtySlots.begin(), dirtySlots.end());
+		bool staging = stream && stream->isPersistent();
+		if (staging) {
+			glBindBuffer(GL_COPY_READ_BUFFER, stream->getBuffer());
+		}
+		size_t first = 0;
+		while (first < dirtySlots.size()) {
+			size_t last = first + 1;
+			while (last < dirtySlots.size() && dirtySlots[last] == dirtySlots[last - 1] + 1) {
+				++last;
+			}
+
+			size_t slot = dirtySlots[first];
+			size_t count = last - first;
+			GLintptr offset = slot * TEXELS_PER_SLOT * sizeof(glm::vec4);
+			GLsizeiptr bytes = count * TEXELS_PER_SLOT * sizeof(glm::vec4);
+			GLintptr staged = staging ? stream->write(&texels[slot * TEXELS_PER_SLOT], bytes, sizeof(glm::vec4))
+				: StreamBuffer::NO_OFFSET;
+			if (staged != StreamBuffer::NO_OFFSET) {
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_TEXTURE_BUFFER, staged, offset, bytes);
+			}
+			else {
+				glBufferSubData(GL_TEXTURE_BUFFER, offset, bytes, &texels[slot * TEXELS_PER_SLOT]);
+			}
+			uploadedSlots += count;
+			++uploadCalls;
+			first = last;
+		}
+		if (staging) {
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	for (unsigned int slot : dirtySlots) {
+		slotDirty[slot] = 0;
+	}
+	dirtySlots.clear();
+}
+
+void TransformBuffer::bind() const {
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glActiveTexture(GL_TEXTURE0);
+}
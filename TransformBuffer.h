@@ -0,0 +1,76 @@
+#pragma once
+#ifndef TRANSFORMBUFFER_H
+#define TRANSFORMBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+
+using namespace std;
+
+// World transforms of a manager's objects, one slot per object, kept on the
+// GPU in a texture buffer. Shaders fetch their instance's slot with
+//
+//   uniform samplerBuffer instanceTransforms;
+//   texelFetch(instanceTransforms, slot * 6 + i)
+//
+// where texels 0-2 are the rows of the affine model matrix and texels 3-5
+// the columns of the normal matrix (xyz). Slots only change when an object
+// moves, so upload() sends just the slots set since the last upload, merged
+// into contiguous runs, instead of every transform every frame. With a
+// persistently mapped StreamBuffer the runs are staged there and copied on
+// the GPU (glCopyBufferSubData) rather than handed to glBufferSubData.
+class TransformBuffer {
+private:
+	GLuint buffer, texture;
+	StreamBuffer* stream;
+	vector<glm::vec4> texels;       // CPU mirror, TEXELS_PER_SLOT per slot
+	vector<unsigned int> dirtySlots;
+	vector<unsigned char> slotDirty;
+	size_t gpuSlotCapacity;
+
+	// Statistics of the last upload
+	size_t uploadedSlots;
+	unsigned int uploadCalls;
+
+public:
+	static const unsigned int TEXELS_PER_SLOT = 6;
+	// Texture unit the buffer is bound to; units below are used by Base and Skybox
+	static const GLint TEXTURE_UNIT = 4;
+	static const char* const SAMPLER_NAME;
+
+	TransformBuffer();
+	~TransformBuffer();
+
+	TransformBuffer(const TransformBuffer&) = delete;
+	TransformBuffer& operator=(const TransformBuffer&) = delete;
+
+	void init();
+	void cleanup();
+
+	// Points the program's instanceTransforms sampler at TEXTURE_UNIT; the
+	// program must be bound. Returns false if the sampler is not used.
+	static bool attach(ShaderProgram& program);
+
+	// For objects that do not cache theirs
+	static glm::mat3 computeNormalMatrix(const glm::mat4& model) { return glm::transpose(glm::inverse(glm::mat3(model))); }
+
+	// Stages uploads in buffer, which must outlive this; null or an
+	// orphaning buffer uploads directly
+	void setStreamBuffer(StreamBuffer* buffer) { stream = buffer; }
+
+	// model must be affine (last row 0, 0, 0, 1)
+	void set(unsigned int slot, const glm::mat4& model, const glm::mat3& normalMatrix);
+
+	// Sends the slots set since the last call; grows the buffer as needed
+	void upload();
+	void bind() const;
+
+	size_t getSlotCount() const { return texels.size() / TEXELS_PER_SLOT; }
+	size_t getUploadedSlotCount() const { return uploadedSlots; }
+	unsigned int getUploadCallCount() const { return uploadCalls; }
+};
+
+#endif // !TRANSFORMBUFFER_H
@@ -0,0 +1,288 @@
+#include "TriangleBvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace {
+	// Deep enough for any mesh we load; bounds the traversal stack
+	const unsigned int MAX_DEPTH = 48;
+	const unsigned int STACK_SIZE = 64;
+
+	float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	// Entry distance of the ray into a node box, or FLT_MAX when it misses
+	float intersectBounds(const glm::vec3& origin, const glm::vec3& inverseDirection,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, float maxDistance) {
+		glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 tSmall = glm::min(t0, t1);
+		glm::vec3 tLarge = glm::max(t0, t1);
+		float tNear = max(max(tSmall.x, tSmall.y), max(tSmall.z, 0.0f));
+		float tFar = min(min(tLarge.x, tLarge.y), min(tLarge.z, maxDistance));
+		return tNear <= tFar ? tNear : FLT_MAX;
+	}
+
+	glm::vec3 readPosition(const MeshData& data, const VertexAttribute& attribute, size_t vertex) {
+		const unsigned char* source = data.vertices + vertex * data.layout.stride + attribute.offset;
+		if (attribute.type == GL_UNSIGNED_SHORT) {
+			unsigned short packed[3];
+			memcpy(packed, source, sizeof(packed));
+			glm::vec3 normalized(packed[0], packed[1], packed[2]);
+			return normalized / 65535.0f * data.getPositionScale() + data.getPositionOffset();
+		}
+
+		float position[3];
+		memcpy(position, source, sizeof(position));
+		return glm::vec3(position[0], position[1], position[2]) * data.getPositionScale() + data.getPositionOffset();
+	}
+
+	size_t readIndex(const MeshData& data, size_t index) {
+		if (data.indexType == GL_UNSIGNED_SHORT) {
+			return ((const unsigned short*)data.indices)[index];
+		}
+		return ((const unsigned int*)data.indices)[index];
+	}
+}
+
+shared_ptr<TriangleBvh> TriangleBvh::build(const MeshData& data) {
+	auto bvh = make_shared<TriangleBvh>();
+
+	const VertexAttribute* positionAttribute = nullptr;
+	for (unsigned int i = 0; i < data.layout.attributeCount; ++i) {
+		if (data.layout.attributes[i].location == 0) {
+			positionAttribute = &data.layout.attributes[i];
+		}
+	}
+	if (!positionAttribute || data.isEmpty()) {
+		return bvh;
+	}
+
+	// Level 0 only; coarser levels are never picked against
+	size_t firstIndex = 0;
+	size_t indexCount = data.indexCount;
+	if (!data.lods.empty() && data.lods[0].subMeshCount > 0) {
+		firstIndex = data.subMeshes[data.lods[0].firstSubMesh].indexOffset;
+		indexCount = data.lods[0].indexCount;
+	}
+
+	size_t triangleCount = indexCount / 3;
+	vector<glm::vec3> sourceCorners(triangleCount * 3);
+	vector<BuildTriangle> triangles(triangleCount);
+	for (size_t i = 0; i < triangleCount; ++i) {
+		BuildTriangle& triangle = triangles[i];
+		for (size_t corner = 0; corner < 3; ++corner) {
+			size_t vertex = readIndex(data, firstIndex + i * 3 + corner);
+			sourceCorners[i * 3 + corner] = vertex < data.vertexCount
+				? readPosition(data, *positionAttribute, vertex) : glm::vec3(0.0f);
+		}
+		triangle.boundsMin = glm::min(sourceCorners[i * 3], glm::min(sourceCorners[i * 3 + 1], sourceCorners[i * 3 + 2]));
+		triangle.boundsMax = glm::max(sourceCorners[i * 3], glm::max(sourceCorners[i * 3 + 1], sourceCorners[i * 3 + 2]));
+		triangle.centroid = (triangle.boundsMin + triangle.boundsMax) * 0.5f;
+		triangle.id = (unsigned int)(i + firstIndex / 3);
+	}
+	if (triangles.empty()) {
+		return bvh;
+	}
+
+	// At most 2n - 1 nodes for n triangles
+	bvh->nodes.reserve(triangleCount * 2);
+	bvh->nodes.resize(1);
+	bvh->buildNode(0, triangles, 0, triangles.size(), 0);
+
+	// Leaves index into triangles as reordered by the build
+	bvh->corners.resize(triangleCount * 3);
+	bvh->triangleIds.resize(triangleCount);
+	for (size_t i = 0; i < triangleCount; ++i) {
+		size_t source = triangles[i].id - firstIndex / 3;
+		bvh->corners[i * 3] = sourceCorners[source * 3];
+		bvh->corners[i * 3 + 1] = sourceCorners[source * 3 + 1];
+		bvh->corners[i * 3 + 2] = sourceCorners[source * 3 + 2];
+		bvh->triangleIds[i] = triangles[i].id;
+	}
+	return bvh;
+}
+
+void TriangleBvh::buildNode(unsigned int nodeIndex, vector<BuildTriangle>& triangles, size_t begin, size_t end,
+	unsigned int depth) {
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (size_t i = begin; i < end; ++i) {
+		boundsMin = glm::min(boundsMin, triangles[i].boundsMin);
+		boundsMax = glm::max(boundsMax, triangles[i].boundsMax);
+		centroidMin = glm::min(centroidMin, triangles[i].centroid);
+		centroidMax = glm::max(centroidMax, triangles[i].centroid);
+	}
+	nodes[nodeIndex].boundsMin = boundsMin;
+	nodes[nodeIndex].boundsMax = boundsMax;
+
+	size_t count = end - begin;
+	if (count <= MAX_LEAF_TRIANGLES || depth >= MAX_DEPTH) {
+		nodes[nodeIndex].first = (unsigned int)begin;
+		nodes[nodeIndex].triangleCount = (unsigned int)count;
+		return;
+	}
+
+	// Cheapest split over every axis, evaluated at the bin boundaries
+	int bestAxis = -1;
+	unsigned int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		unsigned int binCounts[SAH_BINS] = {};
+		glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+		for (unsigned int bin = 0; bin < SAH_BINS; ++bin) {
+			binMin[bin] = glm::vec3(FLT_MAX);
+			binMax[bin] = glm::vec3(-FLT_MAX);
+		}
+
+		float binScale = SAH_BINS / extent;
+		for (size_t i = begin; i < end; ++i) {
+			unsigned int bin = min(SAH_BINS - 1, (unsigned int)((triangles[i].centroid[axis] - centroidMin[axis]) * binScale));
+			++binCounts[bin];
+			binMin[bin] = glm::min(binMin[bin], triangles[i].boundsMin);
+			binMax[bin] = glm::max(binMax[bin], triangles[i].boundsMax);
+		}
+
+		// Right-hand sides swept from the back, then left-hand sides from the front
+		float rightArea[SAH_BINS];
+		unsigned int rightCount[SAH_BINS];
+		glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		unsigned int sweepCount = 0;
+		for (unsigned int bin = SAH_BINS - 1; bin > 0; --bin) {
+			sweepMin = glm::min(sweepMin, binMin[bin]);
+			sweepMax = glm::max(sweepMax, binMax[bin]);
+			sweepCount += binCounts[bin];
+			rightArea[bin] = surfaceArea(sweepMin, sweepMax);
+			rightCount[bin] = sweepCount;
+		}
+
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (unsigned int split = 1; split < SAH_BINS; ++split) {
+			sweepMin = glm::min(sweepMin, binMin[split - 1]);
+			sweepMax = glm::max(sweepMax, binMax[split - 1]);
+			sweepCount += binCounts[split - 1];
+			if (sweepCount == 0 || rightCount[split] == 0) {
+				continue;
+			}
+
+			float cost = sweepCount * surfaceArea(sweepMin, sweepMax) + rightCount[split] * rightArea[split];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	size_t middle;
+	if (bestAxis < 0) {
+		// Every centroid in one spot: any split is as good as another
+		middle = begin + count / 2;
+	}
+	else {
+		float origin = centroidMin[bestAxis];
+		float binScale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto inLeft = [&](const BuildTriangle& triangle) {
+			return min(SAH_BINS - 1, (unsigned int)((triangle.centroid[bestAxis] - origin) * binScale)) < bestSplit;
+		};
+		middle = partition(triangles.begin() + begin, triangles.begin() + end, inLeft) - triangles.begin();
+	}
+
+	unsigned int left = (unsigned int)nodes.size();
+	nodes.resize(nodes.size() + 2);
+	nodes[nodeIndex].first = left;
+	nodes[nodeIndex].triangleCount = 0;
+	buildNode(left, triangles, begin, middle, depth + 1);
+	buildNode(left + 1, triangles, middle, end, depth + 1);
+}
+
+bool TriangleBvh::intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	TriangleHit& hit) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	// Zero components become huge slopes, which the slab test handles
+	glm::vec3 inverseDirection;
+	for (int axis = 0; axis < 3; ++axis) {
+		inverseDirection[axis] = fabs(direction[axis]) > 1e-12f ? 1.0f / direction[axis]
+			: (direction[axis] < 0.0f ? -1e30f : 1e30f);
+	}
+
+	float closest = maxDistance;
+	bool found = false;
+	unsigned int stack[STACK_SIZE];
+	unsigned int stackSize = 0;
+	if (intersectBounds(origin, inverseDirection, nodes[0].boundsMin, nodes[0].boundsMax, closest) == FLT_MAX) {
+		return false;
+	}
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+
+		if (node.triangleCount > 0) {
+			// Moller-Trumbore, both faces
+			for (unsigned int i = node.first; i < node.first + node.triangleCount; ++i) {
+				const glm::vec3& v0 = corners[i * 3];
+				glm::vec3 edge1 = corners[i * 3 + 1] - v0;
+				glm::vec3 edge2 = corners[i * 3 + 2] - v0;
+				glm::vec3 p = glm::cross(direction, edge2);
+				float determinant = glm::dot(edge1, p);
+				if (fabs(determinant) < 1e-12f) {
+					continue;
+				}
+
+				float inverseDeterminant = 1.0f / determinant;
+				glm::vec3 s = origin - v0;
+				float u = glm::dot(s, p) * inverseDeterminant;
+				if (u < 0.0f || u > 1.0f) {
+					continue;
+				}
+				glm::vec3 q = glm::cross(s, edge1);
+				float v = glm::dot(direction, q) * inverseDeterminant;
+				if (v < 0.0f || u + v > 1.0f) {
+					continue;
+				}
+
+				float t = glm::dot(edge2, q) * inverseDeterminant;
+				if (t >= 0.0f && t <= closest) {
+					closest = t;
+					hit.distance = t;
+					hit.triangle = triangleIds[i];
+					hit.u = u;
+					hit.v = v;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Nearer child on top of the stack; boxes behind the best hit are skipped
+		const Node& left = nodes[node.first];
+		const Node& right = nodes[node.first + 1];
+		float leftDistance = intersectBounds(origin, inverseDirection, left.boundsMin, left.boundsMax, closest);
+		float rightDistance = intersectBounds(origin, inverseDirection, right.boundsMin, right.boundsMax, closest);
+		unsigned int nearChild = node.first, farChild = node.first + 1;
+		if (rightDistance < leftDistance) {
+			swap(leftDistance, rightDistance);
+			swap(nearChild, farChild);
+		}
+		if (rightDistance != FLT_MAX) {
+			stack[stackSize++] = farChild;
+		}
+		if (leftDistance != FLT_MAX) {
+			stack[stackSize++] = nearChild;
+		}
+	}
+	return found;
+}
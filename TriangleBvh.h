@@ -0,0 +1,64 @@
+#pragma once
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "MeshData.h"
+
+using namespace std;
+
+// Nearest triangle along a ray
+struct TriangleHit {
+	float distance;         // Ray parameter: origin + direction * distance
+	unsigned int triangle;  // First index / 3 in the mesh's index buffer
+	float u, v;             // Barycentrics of vertices 1 and 2
+};
+
+// Bounding volume hierarchy over the triangles of one mesh's level 0, for
+// exact ray picking. Built once on a loader thread next to the rest of the
+// mesh data and shared by every instance; instances test it with the ray
+// moved into model space.
+//
+// Nodes split on the binned surface area heuristic. The triangle corners are
+// copied in leaf order so a leaf reads one contiguous run.
+class TriangleBvh {
+public:
+	static const unsigned int NO_TRIANGLE = 0xFFFFFFFF;
+	static const unsigned int MAX_LEAF_TRIANGLES = 4;
+	static const unsigned int SAH_BINS = 12;
+
+	struct Node {
+		glm::vec3 boundsMin;
+		unsigned int first;          // Left child (right is first + 1), or first triangle of a leaf
+		glm::vec3 boundsMax;
+		unsigned int triangleCount;  // 0 for inner nodes
+	};
+
+private:
+	vector<Node> nodes;
+	vector<glm::vec3> corners;        // Three per triangle, in leaf order
+	vector<unsigned int> triangleIds; // Leaf order to index buffer triangle
+
+	struct BuildTriangle {
+		glm::vec3 boundsMin, boundsMax, centroid;
+		unsigned int id;
+	};
+
+	void buildNode(unsigned int nodeIndex, vector<BuildTriangle>& triangles, size_t begin, size_t end, unsigned int depth);
+
+public:
+	// Decodes float or quantized positions; empty when data has no triangles
+	static shared_ptr<TriangleBvh> build(const MeshData& data);
+
+	// Nearest triangle hit in [0, maxDistance]; both faces count. direction
+	// need not be normalized and distance is in its units.
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, TriangleHit& hit) const;
+
+	size_t getTriangleCount() const { return triangleIds.size(); }
+	size_t getNodeCount() const { return nodes.size(); }
+	bool isEmpty() const { return triangleIds.empty(); }
+};
+
+#endif // !TRIANGLEBVH_H
@@ -0,0 +1,180 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// Frustum, occlusion and level of detail selection for GpuCuller: one
+// invocation per object slot. Survivors are appended to every draw command
+// of their level, which the renderer then draws with one
+// glMultiDrawElementsIndirect.
+
+// Mirrors GpuCuller::CullObject
+struct CullObject {
+    vec4 boundsMin;      // World AABB
+    vec4 boundsMax;
+    vec4 sphere;         // World bounding sphere, xyz center, w radius
+    vec4 color;          // rgb, a = 1 selected, 0.25 hovered
+    uint transformSlot;
+    uint pickId;
+    uint mesh;           // Entry in meshes, NO_MESH for an empty slot
+    uint padding;
+};
+
+// Mirrors GpuCuller::CullLod
+struct CullLod {
+    float error;         // Relative to the bounds diagonal, see MeshLod
+    uint firstCommand;
+    uint commandCount;
+    uint padding;
+};
+
+// Mirrors GpuCuller::CullData
+layout (std140) uniform CullData {
+    vec4 frustumPlanes[6];   // Frustum::getPlane()
+    mat4 view;
+    vec4 lodParams;          // projection[1][1], viewport height, max pixel error, hysteresis
+    uvec4 counts;            // x = slot count
+    mat4 pyramidViewProjection;   // Camera the depth pyramid was drawn with
+    vec4 pyramidParams;      // Screen width, height, level count; w = 0 skips occlusion
+};
+
+// HiZBuffer's pyramid: farthest depth per texel, level 0 at half the screen
+uniform sampler2D depthPyramid;
+
+layout (std430, binding = 0) readonly buffer Objects { CullObject objects[]; };
+// Per mesh: first entry in lods, level count
+layout (std430, binding = 1) readonly buffer Meshes { uvec2 meshes[]; };
+layout (std430, binding = 2) readonly buffer Lods { CullLod lods[]; };
+// DrawElementsIndirectCommands, 5 words each: count, instanceCount,
+// firstIndex, baseVertex, baseInstance. instanceCount starts at 0.
+layout (std430, binding = 3) buffer Commands { uint commands[]; };
+// InstanceData records, 7 words each: transformSlot, pickId, drawInfo, color
+layout (std430, binding = 4) writeonly buffer Instances { uint instances[]; };
+// Level each slot was drawn with last frame, for the hysteresis
+layout (std430, binding = 5) buffer LodState { uint lodState[]; };
+// Slots that passed the frustum test, in no particular order, and how many
+// of them were occluded
+layout (std430, binding = 6) buffer Visible {
+    uint visibleCount;
+    uint occludedCount;
+    uint visibleSlots[];
+};
+
+const uint NO_MESH = 0xFFFFFFFFu;
+const float FLT_MAX = 3.402823466e38;
+
+// Same test as Frustum::intersectsAABB
+bool intersectsFrustum(vec3 boundsMin, vec3 boundsMax) {
+    for (int i = 0; i < 6; ++i) {
+        vec3 normal = frustumPlanes[i].xyz;
+        vec3 positive = mix(boundsMin, boundsMax, greaterThanEqual(normal, vec3(0.0)));
+        if (dot(normal, positive) + frustumPlanes[i].w < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same test as HiZBuffer::isOccluded
+bool isOccluded(vec3 boundsMin, vec3 boundsMax) {
+    vec3 ndcMin = vec3(FLT_MAX);
+    vec3 ndcMax = vec3(-FLT_MAX);
+    for (int corner = 0; corner < 8; ++corner) {
+        vec3 point = mix(boundsMin, boundsMax, bvec3((corner & 1) != 0, (corner & 2) != 0, (corner & 4) != 0));
+        vec4 clip = pyramidViewProjection * vec4(point, 1.0);
+        if (clip.w <= 0.0) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    if (any(lessThan(ndcMin.xy, vec2(-1.0))) || any(greaterThan(ndcMax.xy, vec2(1.0)))) {
+        return false;
+    }
+
+    ivec2 screenSize = ivec2(pyramidParams.xy);
+    int levelCount = int(pyramidParams.z);
+    ivec2 first = min(ivec2((ndcMin.xy * 0.5 + 0.5) * pyramidParams.xy), screenSize - 1);
+    ivec2 last = min(ivec2((ndcMax.xy * 0.5 + 0.5) * pyramidParams.xy), screenSize - 1);
+    int level = 0;
+    while (level + 1 < levelCount && any(greaterThan((last >> (level + 1)) - (first >> (level + 1)), ivec2(1)))) {
+        ++level;
+    }
+
+    ivec2 levelSize = max(screenSize >> (level + 1), ivec2(1));
+    ivec2 firstTexel = min(first >> (level + 1), levelSize - 1);
+    ivec2 lastTexel = min(last >> (level + 1), levelSize - 1);
+    float farthest = 0.0;
+    for (int y = firstTexel.y; y <= lastTexel.y; ++y) {
+        for (int x = firstTexel.x; x <= lastTexel.x; ++x) {
+            farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).r);
+        }
+    }
+    return ndcMin.z * 0.5 + 0.5 > farthest;
+}
+
+// LodSelector::getScreenSize
+float getScreenSize(vec4 sphere) {
+    float depth = -(view * vec4(sphere.xyz, 1.0)).z;
+    if (depth <= sphere.w) {
+        return FLT_MAX;
+    }
+    return 2.0 * sphere.w * lodParams.x / depth * lodParams.y * 0.5;
+}
+
+// LodSelector::select
+uint selectLod(uint firstLod, uint lodCount, float screenSize, uint currentLod) {
+    if (lodCount <= 1u) {
+        return 0u;
+    }
+    currentLod = min(currentLod, lodCount - 1u);
+    float maxError = lodParams.z;
+    float hysteresis = lodParams.w;
+
+    uint lod = currentLod;
+    if (lods[firstLod + currentLod].error * screenSize > maxError * (1.0 + hysteresis)) {
+        while (lod > 0u && lods[firstLod + lod].error * screenSize > maxError) {
+            --lod;
+        }
+        return lod;
+    }
+    while (lod + 1u < lodCount && lods[firstLod + lod + 1u].error * screenSize <= maxError * (1.0 - hysteresis)) {
+        ++lod;
+    }
+    return lod;
+}
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= counts.x || objects[slot].mesh == NO_MESH) {
+        return;
+    }
+    CullObject object = objects[slot];
+
+    if (!intersectsFrustum(object.boundsMin.xyz, object.boundsMax.xyz)) {
+        return;
+    }
+    visibleSlots[atomicAdd(visibleCount, 1u)] = slot;
+    if (pyramidParams.w != 0.0 && isOccluded(object.boundsMin.xyz, object.boundsMax.xyz)) {
+        atomicAdd(occludedCount, 1u);
+        return;
+    }
+
+    uvec2 mesh = meshes[object.mesh];
+    uint lod = selectLod(mesh.x, mesh.y, getScreenSize(object.sphere), lodState[slot]);
+    lodState[slot] = lod;
+
+    // One copy per command, so each finds its material through drawInfo
+    CullLod level = lods[mesh.x + lod];
+    for (uint i = 0u; i < level.commandCount; ++i) {
+        uint command = level.firstCommand + i;
+        uint instance = commands[command * 5u + 4u] + atomicAdd(commands[command * 5u + 1u], 1u);
+        uint base = instance * 7u;
+        instances[base] = object.transformSlot;
+        instances[base + 1u] = object.pickId;
+        instances[base + 2u] = command;
+        instances[base + 3u] = floatBitsToUint(object.color.r);
+        instances[base + 4u] = floatBitsToUint(object.color.g);
+        instances[base + 5u] = floatBitsToUint(object.color.b);
+        instances[base + 6u] = floatBitsToUint(object.color.a);
+    }
+}
\ No newline at end of file
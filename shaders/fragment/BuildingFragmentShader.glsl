@@ -3,37 +3,49 @@ out vec4 FragColor;
 
 in vec3 Normal;
 in vec3 FragPos;
+flat in vec4 InstanceColor;
+// Per-submesh material from the model's .mtl (white / 32 when absent):
+// diffuse rgb, shininess
+flat in vec4 Material;
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
-uniform vec3 viewPos;
-uniform bool selected;
+// Per-frame camera and lighting, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+};
 
 void main() {
     // Ambient
     float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 ambient = ambientStrength * lightColor.rgb;
     
     // Diffuse
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(lightPos.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = diff * lightColor.rgb;
     
     // Specular
     float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;
+    // .mtl files often say Ns 0, and pow(0, 0) is undefined
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), max(Material.a, 1.0));
+    vec3 specular = specularStrength * spec * lightColor.rgb;
     
-    vec3 result = (ambient + diffuse + specular) * objectColor;
+    vec3 result = (ambient + diffuse + specular) * InstanceColor.rgb * Material.rgb;
     
-    // Highlight when selected
-    if (selected) {
+    // Highlight when selected, lighter under the cursor
+    if (InstanceColor.a > 0.5) {
         result += vec3(0.2, 0.2, 0.0);
     }
+    else if (InstanceColor.a > 0.0) {
+        result += vec3(0.08, 0.08, 0.08);
+    }
     
     FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+
+// One level of the depth pyramid: the farthest depth of the source texels
+// under this one. Sizes round down, so the last row and column of an odd
+// source fold into the last texel.
+uniform sampler2D source;   // The copied depth, or the level above (as the base level)
+
+out float FarDepth;
+
+void main() {
+    ivec2 sourceSize = textureSize(source, 0);
+    ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = first + 1;
+    if (first.x + 3 == sourceSize.x) {
+        last.x += 1;
+    }
+    if (first.y + 3 == sourceSize.y) {
+        last.y += 1;
+    }
+    last = min(last, sourceSize - 1);
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+        }
+    }
+    FarDepth = farthest;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 330 core
+flat in uint PickId;
+
+out uint FragId;
+
+void main() {
+    FragId = PickId;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+in vec2 FaceCoord;
+out vec4 FragColor;
+
+uniform sampler2D equirectTexture;
+// Direction of face coordinate (s, t) is faceBasis * vec3(s, t, 1), after
+// the cube map face table of the GL spec
+uniform mat3 faceBasis;
+
+const float PI = 3.14159265359;
+
+void main() {
+    vec3 direction = normalize(faceBasis * vec3(FaceCoord, 1.0));
+
+    // Same mapping the old sky sphere had: u around the y axis from +x
+    // towards +z, v from the bottom (-y) to the top
+    float u = fract(atan(direction.z, direction.x) / (2.0 * PI));
+    float v = 1.0 - acos(clamp(direction.y, -1.0, 1.0)) / PI;
+
+    // Level 0 only: the seam at u = 0 would pick a tiny mip otherwise
+    FragColor = vec4(textureLod(equirectTexture, vec2(u, v), 0.0).rgb, 1.0);
+}
\ No newline at end of file
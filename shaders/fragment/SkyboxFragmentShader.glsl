@@ -1,11 +1,11 @@
 #version 330 core
-in vec2 TexCoord;
+in vec3 Direction;
 out vec4 FragColor;
 
-uniform sampler2D skyboxTexture;
+uniform samplerCube skyboxTexture;
 
 void main() {
-    vec3 color = texture(skyboxTexture, TexCoord).rgb;
+    vec3 color = texture(skyboxTexture, Direction).rgb;
     
     // Optional: Enhance the skybox colors
     color = pow(color, vec3(0.8)); // Slight gamma correction
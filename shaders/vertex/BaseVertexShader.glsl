@@ -8,12 +8,22 @@ layout (location = 1) in vec2 aTexCoord;   // Texture coordinates
 out vec2 TexCoord;
 
 // Uniforms
-uniform mat4 mvp;  // Model-View-Projection matrix
+// Per-frame camera and lighting, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+};
+
+uniform mat4 model;
 
 void main()
 {
     // Transform vertex position
-    gl_Position = mvp * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
     
     // Pass texture coordinates to fragment shader
     TexCoord = aTexCoord;
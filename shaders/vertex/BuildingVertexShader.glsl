@@ -2,16 +2,55 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 
+// Per-instance attributes from InstanceRenderer
+layout (location = 3) in uint instanceTransform;   // Slot in instanceTransforms
+layout (location = 4) in vec4 instanceColor;   // rgb, a = 1 selected, 0.25 hovered
+layout (location = 6) in uint instanceDrawInfo;   // Entry in drawInfos
+
 out vec3 FragPos;
 out vec3 Normal;
+flat out vec4 InstanceColor;
+flat out vec4 Material;   // Diffuse rgb, shininess
+
+// Per-frame camera and lighting, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+};
+
+// Per-draw position decode and material, 3 texels per entry: position
+// scale (xyz) and shininess (w), position offset, diffuse color (see
+// InstanceRenderer.h). Quantized meshes store positions as 0..1 across the
+// mesh AABB; float meshes use scale 1 / offset 0.
+uniform samplerBuffer drawInfos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// World transforms, 6 texels per slot: the rows of the model matrix, then
+// the columns of the normal matrix (see TransformBuffer.h)
+uniform samplerBuffer instanceTransforms;
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    int base = int(instanceTransform) * 6;
+    mat4 model = transpose(mat4(texelFetch(instanceTransforms, base),
+                                texelFetch(instanceTransforms, base + 1),
+                                texelFetch(instanceTransforms, base + 2),
+                                vec4(0.0, 0.0, 0.0, 1.0)));
+    mat3 normalMatrix = mat3(texelFetch(instanceTransforms, base + 3).xyz,
+                             texelFetch(instanceTransforms, base + 4).xyz,
+                             texelFetch(instanceTransforms, base + 5).xyz);
+
+    int info = int(instanceDrawInfo) * 3;
+    vec4 positionScale = texelFetch(drawInfos, info);
+    vec3 positionOffset = texelFetch(drawInfos, info + 1).xyz;
+
+    vec3 position = aPos * positionScale.xyz + positionOffset;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = normalMatrix * aNormal;
+    InstanceColor = instanceColor;
+    Material = vec4(texelFetch(drawInfos, info + 2).rgb, positionScale.w);
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Per-instance attributes from InstanceRenderer
+layout (location = 3) in uint instanceTransform;   // Slot in instanceTransforms
+layout (location = 5) in uint instancePickId;
+layout (location = 6) in uint instanceDrawInfo;   // Entry in drawInfos
+
+flat out uint PickId;
+
+// Per-frame camera and lighting, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+};
+
+// Per-draw position decode and material, 3 texels per entry: position
+// scale (xyz) and shininess (w), position offset, diffuse color (see
+// InstanceRenderer.h). Quantized meshes store positions as 0..1 across the
+// mesh AABB; float meshes use scale 1 / offset 0.
+uniform samplerBuffer drawInfos;
+
+// Stretches the picked pixels over the whole pick buffer
+uniform mat4 pickTransform;
+
+// World transforms, see TransformBuffer.h
+uniform samplerBuffer instanceTransforms;
+
+void main() {
+    int base = int(instanceTransform) * 6;
+    mat4 model = transpose(mat4(texelFetch(instanceTransforms, base),
+                                texelFetch(instanceTransforms, base + 1),
+                                texelFetch(instanceTransforms, base + 2),
+                                vec4(0.0, 0.0, 0.0, 1.0)));
+
+    int info = int(instanceDrawInfo) * 3;
+    vec4 positionScale = texelFetch(drawInfos, info);
+    vec3 positionOffset = texelFetch(drawInfos, info + 1).xyz;
+
+    vec3 position = aPos * positionScale.xyz + positionOffset;
+    PickId = instancePickId;
+    gl_Position = pickTransform * viewProjection * model * vec4(position, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 330 core
+
+// Face coordinates of the cube face being rendered, -1 to 1
+out vec2 FaceCoord;
+
+// Fullscreen triangle without vertex buffers, one per face
+void main() {
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    FaceCoord = corner;
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
\ No newline at end of file
@@ -1,20 +1,26 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
 
-out vec2 TexCoord;
+out vec3 Direction;
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 model;
+// Per-frame camera and lighting, see FrameUniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 viewPos;
+};
 
+// Fullscreen triangle on the far plane, so only pixels the world left at
+// the cleared depth pass GL_LEQUAL
 void main() {
-    // Remove translation from view matrix to keep skybox centered on camera
-    mat4 viewNoTranslation = mat4(mat3(view));
-    
-    // Apply model transformation for the sphere
-    gl_Position = projection * viewNoTranslation * model * vec4(aPos, 1.0);
-    
-    // Pass texture coordinates to fragment shader
-    TexCoord = aTexCoord;
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(corner, 1.0, 1.0);
+
+    // View direction through the corner, without the camera's translation.
+    // The inverse leaves w the same at every corner, so the direction
+    // interpolates linearly without the divide.
+    mat4 inverseViewProjection = inverse(projection * mat4(mat3(view)));
+    Direction = (inverseViewProjection * gl_Position).xyz;
 }
\ No newline at end of file